@@ -1,10 +1,26 @@
+#define MYLOG_MODULE LogModule::Settings
+
 #include "AnchorSettings.h"
+#include "SchemeCodec.h"
 #include "SettingKeys.h"
 
-#include <QDir>
+#include "mylog/mylog.h"
+
+#include <QCoreApplication>
+#include <QFileInfo>
+
+#include <iterator>
 
 #define SETTINGS_FILE "MouseLineFocus.ini"
-#define PROFILE_SUB_DIR "profiles"
+
+// Flush after settings are quiet for this long.
+#define SETTINGS_FLUSH_IDLE_MS 1000
+
+// Flush at the latest this long after the first dirty key.
+#define SETTINGS_FLUSH_MAX_DELAY_MS 5000
+
+// Reload after the file is quiet for this long.
+#define SETTINGS_RELOAD_DELAY_MS 300
 
 AnchorSettings *AnchorSettings::s_instance = nullptr;
 
@@ -12,106 +28,266 @@ AnchorSettings::AnchorSettings(QObject *parent)
     : QSettings(SETTINGS_FILE, QSettings::IniFormat, parent)
 {
     s_instance = this;
-}
 
-int AnchorSettings::GetScreenIndex()
-{
-    return value(GROUP_COMMON "/" COMMON_SCREEN_INDEX, 0).toInt();
+    m_timerFlush.setSingleShot(true);
+    m_timerFlush.setInterval(SETTINGS_FLUSH_IDLE_MS);
+    connect(&m_timerFlush, &QTimer::timeout, this, &AnchorSettings::Flush);
+
+    // The event loop is gone after quit, flush while it still runs.
+    connect(qApp, &QCoreApplication::aboutToQuit, this, &AnchorSettings::Flush);
+
+    ApplyLogConfig(GetLogConfig());
+
+    m_timerReload.setSingleShot(true);
+    m_timerReload.setInterval(SETTINGS_RELOAD_DELAY_MS);
+    connect(&m_timerReload, &QTimer::timeout, this, &AnchorSettings::OnReloadTimeout);
+
+    // Missing file is added once it exists, see OnReloadTimeout().
+    if (QFileInfo::exists(fileName())) {
+        m_watcher.addPath(fileName());
+    }
+    connect(&m_watcher, &QFileSystemWatcher::fileChanged, this, &AnchorSettings::OnFileChanged);
 }
 
-void AnchorSettings::SetScreenIndex(int index)
+AnchorSettings::~AnchorSettings()
 {
-    setValue(GROUP_COMMON "/" COMMON_SCREEN_INDEX, index);
+    Flush();
 }
 
-QString AnchorSettings::GetCurrentProfile()
+void AnchorSettings::Flush()
 {
-    return value(GROUP_COMMON "/" COMMON_CURRENT_PROFILE, "").toString();
+    m_timerFlush.stop();
+    m_dirtyClock.invalidate();
+
+    if (m_dirty.isEmpty()) {
+        return;
+    }
+
+    for (auto it = m_dirty.cbegin(); it != m_dirty.cend(); ++it) {
+        setValue(it.key(), it.value());
+    }
+    int keyCount = m_dirty.size();
+    m_dirty.clear();
+
+    // QSettings writes the whole INI file through a temporary file.
+    sync();
+
+    if (!m_flushMinuteClock.isValid() || m_flushMinuteClock.elapsed() >= 60 * 1000) {
+        m_flushMinuteClock.start();
+        m_flushesInMinute = 0;
+    }
+    ++m_flushesInMinute;
+
+    if (status() != QSettings::NoError) {
+        L_ERROR("Failed to write settings, status: {}", static_cast<int>(status()));
+    } else {
+        L_DEBUG("Settings flushed, {} keys, {} writes this minute", keyCount, m_flushesInMinute);
+    }
+
+    // The file is replaced on write, which drops it from the watcher.
+    if (m_watcher.files().isEmpty()) {
+        m_watcher.addPath(fileName());
+    }
 }
 
-void AnchorSettings::SetCurrentProfile(QString profileName)
+void AnchorSettings::OnFileChanged()
 {
-    setValue(GROUP_COMMON "/" COMMON_CURRENT_PROFILE, profileName);
+    m_timerReload.start();
 }
 
-QVector<OverlayScheme::Ptr> AnchorSettings::GetAllProfiles()
+void AnchorSettings::OnReloadTimeout()
 {
-    QVector<OverlayScheme::Ptr> profiles;
-
-    // Ensure sub dir exists. Create if not exist.
-    QDir dir(PROFILE_SUB_DIR);
-    if (!dir.exists()) {
-        dir.mkpath(".");
+    // Replaced files are no longer watched.
+    if (m_watcher.files().isEmpty() && QFileInfo::exists(fileName())) {
+        m_watcher.addPath(fileName());
     }
 
-    // Get all files with extension ".dat".
-    QStringList files = dir.entryList(QStringList() << "*.dat", QDir::Files);
-    for (int i = 0; i != files.size(); ++i) {
-        QString fileName = files[i];
-        QString filePath = dir.absoluteFilePath(fileName);
+    // Read the file again. Dirty keys are held apart, and still win. Own
+    //   flushes also land here, which is harmless.
+    sync();
 
-        OverlayScheme::Ptr scheme = LoadSchemeFromFile(filePath);
-        if (scheme) {
-            profiles.push_back(scheme);
-        }
+    ApplyLogConfig(GetLogConfig());
+    L_DEBUG("Settings file changed, log configuration reloaded");
+}
+
+QVariant AnchorSettings::Value(const QString &key, const QVariant &defaultValue) const
+{
+    auto it = m_dirty.constFind(key);
+    if (it != m_dirty.cend()) {
+        return it.value();
     }
 
-    return profiles;
+    return value(key, defaultValue);
 }
 
-// Create or Update profile.
-bool AnchorSettings::SaveProfile(OverlayScheme::Ptr scheme)
+void AnchorSettings::SetValueDeferred(const QString &key, const QVariant &value)
 {
-    QString filename = scheme->schemeName + ".dat";
+    // Values read back from the INI file are strings, while written ones are
+    //   bool or int. All values stored here compare alike as strings.
+    QVariant current = Value(key);
+    if (current.isValid() && current.toString() == value.toString()) {
+        return;
+    }
+
+    m_dirty.insert(key, value);
 
-    QDir dir(PROFILE_SUB_DIR);
-    if (!dir.exists()) {
-        dir.mkpath(".");
+    if (!m_dirtyClock.isValid()) {
+        m_dirtyClock.start();
     }
-    QString filePath = dir.absoluteFilePath(filename);
 
-    return SaveSchemeToFile(scheme, filePath);
+    // Keep waiting for quiet, unless changes have kept coming for too long.
+    qint64 remainingMs = SETTINGS_FLUSH_MAX_DELAY_MS - m_dirtyClock.elapsed();
+    m_timerFlush.start(qBound<qint64>(0, remainingMs, SETTINGS_FLUSH_IDLE_MS));
 }
 
-void AnchorSettings::DeleteProfile(QString profileName)
+int AnchorSettings::GetScreenIndex()
 {
-    QString filename = profileName + ".dat";
+    return Value(GROUP_COMMON "/" COMMON_SCREEN_INDEX, 0).toInt();
+}
 
-    QDir dir(PROFILE_SUB_DIR);
-    if (!dir.exists()) {
-        return;
-    }
-    QString filePath = dir.absoluteFilePath(filename);
+void AnchorSettings::SetScreenIndex(int index)
+{
+    SetValueDeferred(GROUP_COMMON "/" COMMON_SCREEN_INDEX, index);
+}
+
+QString AnchorSettings::GetCurrentProfile()
+{
+    return Value(GROUP_COMMON "/" COMMON_CURRENT_PROFILE, "").toString();
+}
 
-    QFile::remove(filePath);
+void AnchorSettings::SetCurrentProfile(QString profileName)
+{
+    SetValueDeferred(GROUP_COMMON "/" COMMON_CURRENT_PROFILE, profileName);
 }
 
 bool AnchorSettings::GetEnabled()
 {
-    return value(GROUP_COMMON "/" COMMON_ENABLED, true).toBool();
+    return Value(GROUP_COMMON "/" COMMON_ENABLED, true).toBool();
 }
 
 void AnchorSettings::SetEnabled(bool enabled)
 {
-    setValue(GROUP_COMMON "/" COMMON_ENABLED, enabled);
+    SetValueDeferred(GROUP_COMMON "/" COMMON_ENABLED, enabled);
 }
 
 bool AnchorSettings::GetInverted()
 {
-    return value(GROUP_COMMON "/" COMMON_INVERTED, false).toBool();
+    return Value(GROUP_COMMON "/" COMMON_INVERTED, false).toBool();
 }
 
 void AnchorSettings::SetInverted(bool inverted)
 {
-    setValue(GROUP_COMMON "/" COMMON_INVERTED, inverted);
+    SetValueDeferred(GROUP_COMMON "/" COMMON_INVERTED, inverted);
 }
 
 bool AnchorSettings::GetEnableEdit()
 {
-    return value(GROUP_COMMON "/" COMMON_ENABLE_EDIT, true).toBool();
+    return Value(GROUP_COMMON "/" COMMON_ENABLE_EDIT, true).toBool();
 }
 
 void AnchorSettings::SetEnableEdit(bool bEnable)
 {
-    setValue(GROUP_COMMON "/" COMMON_ENABLE_EDIT, bEnable);
+    SetValueDeferred(GROUP_COMMON "/" COMMON_ENABLE_EDIT, bEnable);
+}
+
+int AnchorSettings::GetTransitionMs()
+{
+    return qMax(0, Value(GROUP_COMMON "/" COMMON_TRANSITION_MS, 200).toInt());
+}
+
+OverlayScheme::Ptr AnchorSettings::GetLastScheme()
+{
+    QByteArray data = QByteArray::fromBase64(Value(GROUP_COMMON "/" COMMON_LAST_SCHEME).toByteArray());
+    if (data.isEmpty()) {
+        return nullptr;
+    }
+
+    return DecodeScheme(data);
+}
+
+void AnchorSettings::SetLastScheme(const OverlayScheme &scheme)
+{
+    SetValueDeferred(GROUP_COMMON "/" COMMON_LAST_SCHEME, QString::fromLatin1(EncodeScheme(scheme).toBase64()));
+}
+
+QString AnchorSettings::GetHotkey(QString actionKey, QString defaultHotkey)
+{
+    return Value(GROUP_HOTKEYS "/" + actionKey, defaultHotkey).toString();
+}
+
+void AnchorSettings::SetHotkey(QString actionKey, QString hotkey)
+{
+    SetValueDeferred(GROUP_HOTKEYS "/" + actionKey, hotkey);
+}
+
+HotkeyRepeatPolicy AnchorSettings::GetHotkeyRepeatPolicy(QString actionKey,
+                                                         HotkeyRepeatPolicy defaultPolicy)
+{
+    QString policy = Value(GROUP_HOTKEYS "/" + actionKey + HOTKEYS_REPEAT_SUFFIX).toString();
+
+    if (policy == "fire") {
+        return HotkeyRepeatPolicy::Fire;
+    } else if (policy == "ignore") {
+        return HotkeyRepeatPolicy::Ignore;
+    } else if (policy == "collapse") {
+        return HotkeyRepeatPolicy::Collapse;
+    }
+
+    return defaultPolicy;
+}
+
+int AnchorSettings::GetHookLatencyBudgetMs()
+{
+    return Value(GROUP_HOOK "/" HOOK_LATENCY_BUDGET_MS, 300).toInt();
+}
+
+// Parse level name into level, keep level if unknown.
+static void ParseLogLevel(QVariant text, int *level)
+{
+    static const char *const names[] = { "trace", "debug", "info", "warn", "error", "critical", "off" };
+
+    QString name = text.toString().trimmed().toLower();
+    if (name.isEmpty()) {
+        return;
+    }
+
+    for (int i = 0; i != int(std::size(names)); ++i) {
+        if (name == names[i]) {
+            *level = i;
+            return;
+        }
+    }
+
+    L_WARN("Unknown log level: {}", name);
+}
+
+LogConfig AnchorSettings::GetLogConfig()
+{
+    LogConfig config;
+
+    int level = -1;
+    ParseLogLevel(Value(GROUP_LOG "/" LOG_LEVEL), &level);
+    for (int i = 0; i != int(LogModule::Count); ++i) {
+        if (level != -1) {
+            config.moduleLevels[i] = level;
+        }
+
+        QString key = QString(GROUP_LOG "/") + GetLogModuleName(LogModule(i)) + LOG_MODULE_LEVEL_SUFFIX;
+        ParseLogLevel(Value(key), &config.moduleLevels[i]);
+    }
+
+    config.bConsole = Value(GROUP_LOG "/" LOG_CONSOLE, config.bConsole).toBool();
+    ParseLogLevel(Value(GROUP_LOG "/" LOG_CONSOLE_LEVEL), &config.consoleLevel);
+    ParseLogLevel(Value(GROUP_LOG "/" LOG_FILE_LEVEL), &config.fileLevel);
+
+    QString pattern = Value(GROUP_LOG "/" LOG_CONSOLE_PATTERN).toString();
+    if (!pattern.isEmpty()) {
+        config.consolePattern = pattern.toStdString();
+    }
+    pattern = Value(GROUP_LOG "/" LOG_FILE_PATTERN).toString();
+    if (!pattern.isEmpty()) {
+        config.filePattern = pattern.toStdString();
+    }
+
+    return config;
 }
@@ -1,12 +1,25 @@
 #ifndef ANCHORSETTINGS_H
 #define ANCHORSETTINGS_H
 
+#include "HotkeyHook/HotkeyEventQueue.h"
 #include "OverlayScheme.h"
+#include "mylog/mylog.h"
 
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
+#include <QHash>
 #include <QSettings>
-#include <QVector>
+#include <QTimer>
+#include <QVariant>
 
 // Fake singleton. Rely on main() to initialize it.
+//
+// Setters only mark keys dirty. Dirty keys are written together, in one
+//   file write, once settings have been quiet for a while, at the latest
+//   after a few seconds, and on exit.
+//
+// Log configuration (group "log") is applied at start, and again whenever
+//   the file is changed outside.
 class AnchorSettings : public QSettings
 {
     Q_OBJECT
@@ -14,6 +27,10 @@ public:
     static AnchorSettings *Instance() { return s_instance; }
 
     AnchorSettings(QObject *parent = nullptr);
+    ~AnchorSettings();
+
+    // Write dirty keys to disk now. Synchronous, for exit paths.
+    void Flush();
 
     // Get stored screen index. Default: 0
     int GetScreenIndex();
@@ -23,13 +40,6 @@ public:
     QString GetCurrentProfile();
     void SetCurrentProfile(QString profileName);
 
-    // Get all profiles from settings.
-    QVector<OverlayScheme::Ptr> GetAllProfiles();
-    bool SaveProfile(OverlayScheme::Ptr scheme);
-
-    // Delete profile with name.
-    void DeleteProfile(QString profileName);
-
     // Whether the application is enabled.
     bool GetEnabled();
     void SetEnabled(bool enabled);
@@ -40,8 +50,58 @@ public:
     bool GetEnableEdit();
     void SetEnableEdit(bool bEnable);
 
+    // Duration of animated profile transitions in milliseconds. 0 disables
+    //   them. Default: 200
+    int GetTransitionMs();
+
+    // Scheme last shown, so the overlay draws it at start before profiles
+    //   are loaded. nullptr if none or unreadable.
+    OverlayScheme::Ptr GetLastScheme();
+    void SetLastScheme(const OverlayScheme &scheme);
+
+    // Hotkey string of an action (see ShortcutDefine.h). Empty if unbound.
+    QString GetHotkey(QString actionKey, QString defaultHotkey);
+    void SetHotkey(QString actionKey, QString hotkey);
+
+    // Auto-repeat policy of an action: "fire", "ignore" or "collapse".
+    HotkeyRepeatPolicy GetHotkeyRepeatPolicy(QString actionKey, HotkeyRepeatPolicy defaultPolicy);
+
+    // Keyboard hook latency budget in milliseconds. Default: 300
+    int GetHookLatencyBudgetMs();
+
+    // Log levels, patterns and console switch. Missing keys keep the
+    //   defaults of LogConfig.
+    LogConfig GetLogConfig();
+
+private slots:
+    void OnFileChanged();
+    void OnReloadTimeout();
+
 private:
+    // Dirty value if any, else stored value.
+    QVariant Value(const QString &key, const QVariant &defaultValue = QVariant()) const;
+
+    // Mark key dirty and schedule a flush. Nothing if value is unchanged.
+    void SetValueDeferred(const QString &key, const QVariant &value);
+
     static AnchorSettings *s_instance;
+
+    QHash<QString, QVariant> m_dirty;
+
+    // Restarted by each change, fires when settings are quiet.
+    QTimer m_timerFlush;
+
+    // Since first dirty key, to bound the delay of continuous changes.
+    QElapsedTimer m_dirtyClock;
+
+    // Flushes in current minute, for the log.
+    int m_flushesInMinute = 0;
+    QElapsedTimer m_flushMinuteClock;
+
+    QFileSystemWatcher m_watcher;
+
+    // Editors write a file in several steps, reload once they are done.
+    QTimer m_timerReload;
 };
 
 #endif // ANCHORSETTINGS_H
@@ -0,0 +1,24 @@
+#include "BenchReport.h"
+#include "mylog/mylog.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+void ReportBenchResult(QString line)
+{
+    L_INFO("Benchmark: {}", line);
+
+#ifdef _WIN32
+    static bool bAttached = false;
+    if (!bAttached && AttachConsole(ATTACH_PARENT_PROCESS)) {
+        std::freopen("CONOUT$", "w", stdout);
+    }
+    bAttached = true;
+#endif
+
+    std::printf("%s\n", line.toUtf8().constData());
+    std::fflush(stdout);
+}
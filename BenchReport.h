@@ -0,0 +1,10 @@
+#ifndef BENCHREPORT_H
+#define BENCHREPORT_H
+
+#include <QString>
+
+// Print a benchmark result line to the console the app was started from, and
+//   log it. A GUI build has no console of its own.
+void ReportBenchResult(QString line);
+
+#endif // BENCHREPORT_H
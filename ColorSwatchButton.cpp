@@ -0,0 +1,52 @@
+#include "ColorSwatchButton.h"
+
+#include <QPainter>
+#include <QStyleOptionButton>
+#include <QStylePainter>
+
+// Size of checkerboard squares behind translucent colors.
+#define SWATCH_CHECKER_SIZE 4
+
+ColorSwatchButton::ColorSwatchButton(QWidget *parent)
+    : QPushButton(parent)
+{
+}
+
+void ColorSwatchButton::SetColor(QColor color)
+{
+    if (color == m_color) {
+        return;
+    }
+
+    m_color = color;
+    update();
+}
+
+void ColorSwatchButton::paintEvent(QPaintEvent * /*event*/)
+{
+    QStylePainter painter(this);
+
+    QStyleOptionButton option;
+    initStyleOption(&option);
+    painter.drawControl(QStyle::CE_PushButtonBevel, option);
+
+    QRect swatch = style()->subElementRect(QStyle::SE_PushButtonContents, &option, this);
+
+    if (m_color.alpha() != 255) {
+        static const QPixmap checker = []() {
+            QPixmap pixmap(2 * SWATCH_CHECKER_SIZE, 2 * SWATCH_CHECKER_SIZE);
+            pixmap.fill(Qt::white);
+            QPainter checkerPainter(&pixmap);
+            checkerPainter.fillRect(0, 0, SWATCH_CHECKER_SIZE, SWATCH_CHECKER_SIZE, Qt::lightGray);
+            checkerPainter.fillRect(SWATCH_CHECKER_SIZE, SWATCH_CHECKER_SIZE,
+                                    SWATCH_CHECKER_SIZE, SWATCH_CHECKER_SIZE, Qt::lightGray);
+            return pixmap;
+        }();
+        painter.drawTiledPixmap(swatch, checker);
+    }
+    painter.fillRect(swatch, m_color);
+
+    if (!isEnabled()) {
+        painter.fillRect(swatch, QColor(255, 255, 255, 128));
+    }
+}
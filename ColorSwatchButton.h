@@ -0,0 +1,26 @@
+#ifndef COLORSWATCHBUTTON_H
+#define COLORSWATCHBUTTON_H
+
+#include <QColor>
+#include <QPushButton>
+
+// Button showing a color, alpha over a checkerboard. The color is painted
+//   directly, setting it does not restyle the widget.
+class ColorSwatchButton : public QPushButton
+{
+    Q_OBJECT
+
+public:
+    explicit ColorSwatchButton(QWidget *parent = nullptr);
+
+    void SetColor(QColor color);
+    QColor GetColor() const { return m_color; }
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    QColor m_color;
+};
+
+#endif // COLORSWATCHBUTTON_H
@@ -0,0 +1,333 @@
+#include "FlightRecorder.h"
+#include "mylog/mylog.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QMutex>
+#include <QTextStream>
+#include <QVector>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <csignal>
+#include <exception>
+#include <iterator>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define FLIGHT_DUMP_MAGIC       0x52464C4D  // "MLFR"
+#define FLIGHT_DUMP_VERSION     1
+
+// Least interval between spike dumps.
+#define FLIGHT_SPIKE_DUMP_INTERVAL_MS (60 * 1000)
+
+// Dumps kept in the dump directory, besides the crash dump.
+#define FLIGHT_MAX_DUMPS 20
+
+#define FLIGHT_CRASH_DUMP_FILE "flight-crash.bin"
+
+// Dump file header, followed by each ring as thread index(4) next(4) records.
+struct FlightDumpHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t ringCount;
+    uint32_t capacity;
+    uint32_t reserved;
+    int64_t dumpTimeNs;
+};
+
+FlightRecorder::Ring FlightRecorder::s_rings[kMaxThreads];
+std::atomic<int> FlightRecorder::s_ringCount{ 0 };
+std::atomic<uint32_t> FlightRecorder::s_threadCount{ 0 };
+
+static QString g_dumpDir = "./log";
+
+// Crash dump path in native form, prepared ahead since nothing may be
+//   allocated or converted then. Empty if it does not fit.
+static FlightRecorder::PathChar g_crashDumpPath[1024];
+
+FlightRecorder::Ring *FlightRecorder::AcquireRing()
+{
+    for (int i = 0; i != kMaxThreads; ++i) {
+        Ring &ring = s_rings[i];
+        bool bInUse = false;
+        if (!ring.bInUse.compare_exchange_strong(bInUse, true, std::memory_order_acquire)) {
+            continue;
+        }
+
+        // Records of the thread which had the ring before are dropped.
+        ring.threadIndex.store(s_threadCount.fetch_add(1, std::memory_order_relaxed),
+                               std::memory_order_relaxed);
+        ring.next.store(0, std::memory_order_release);
+
+        int count = s_ringCount.load(std::memory_order_relaxed);
+        while (count < i + 1 && !s_ringCount.compare_exchange_weak(count, i + 1, std::memory_order_relaxed)) {
+        }
+
+        return &ring;
+    }
+
+    return nullptr;
+}
+
+void FlightRecorder::ReleaseRing(Ring *ring)
+{
+    if (ring) {
+        ring->bInUse.store(false, std::memory_order_release);
+    }
+}
+
+void FlightRecorder::Install(QString dumpDir)
+{
+    g_dumpDir = dumpDir;
+    QDir().mkpath(dumpDir);
+
+    QString crashPath = QDir(dumpDir).filePath(FLIGHT_CRASH_DUMP_FILE);
+#ifdef _WIN32
+    QString nativePath = QDir::toNativeSeparators(crashPath);
+    if (nativePath.size() < int(std::size(g_crashDumpPath))) {
+        g_crashDumpPath[nativePath.toWCharArray(g_crashDumpPath)] = L'\0';
+    }
+#else
+    QByteArray nativePath = QFile::encodeName(crashPath);
+    if (nativePath.size() < int(std::size(g_crashDumpPath))) {
+        qstrncpy(g_crashDumpPath, nativePath.constData(), sizeof(g_crashDumpPath));
+    }
+#endif
+
+    for (int signal : { SIGSEGV, SIGABRT, SIGFPE, SIGILL }) {
+        std::signal(signal, &FlightRecorder::OnFatalSignal);
+    }
+
+    std::set_terminate([]() {
+        WriteDump(g_crashDumpPath);
+        std::abort();
+    });
+
+#ifdef _WIN32
+    SetUnhandledExceptionFilter([](EXCEPTION_POINTERS *) -> LONG {
+        WriteDump(g_crashDumpPath);
+        return EXCEPTION_CONTINUE_SEARCH;
+    });
+#endif
+}
+
+QString FlightRecorder::Dump(QString reason)
+{
+    QString fileName = QString("flight-%1-%2.bin")
+        .arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss"), reason);
+    QString filePath = QDir(g_dumpDir).filePath(fileName);
+
+#ifdef _WIN32
+    std::wstring nativePath = QDir::toNativeSeparators(filePath).toStdWString();
+#else
+    std::string nativePath = QFile::encodeName(filePath).toStdString();
+#endif
+    if (!WriteDump(nativePath.c_str())) {
+        L_ERROR("Write flight recorder dump failed: {}", filePath);
+        return QString();
+    }
+
+    L_INFO("Flight recorder dumped: {}", filePath);
+    return filePath;
+}
+
+void FlightRecorder::DumpOnSpike(QString reason)
+{
+    static QMutex mutex;
+    static int64_t lastDumpNs = 0;
+
+    {
+        QMutexLocker locker(&mutex);
+        int64_t now = NowNs();
+        if (lastDumpNs != 0 && now - lastDumpNs < int64_t(FLIGHT_SPIKE_DUMP_INTERVAL_MS) * 1000000) {
+            return;
+        }
+        lastDumpNs = now;
+    }
+
+    // Writing takes a while, do not make the spike longer.
+    QtConcurrent::run([reason]() {
+        Dump(reason);
+        PruneDumps();
+    });
+}
+
+void FlightRecorder::PruneDumps()
+{
+    // Names start with the time, newest last. The crash dump does not match.
+    QDir dir(g_dumpDir);
+    QStringList fileNames = dir.entryList({ "flight-*-*.bin" }, QDir::Files, QDir::Name);
+
+    int removed = 0;
+    for (int i = 0; i < fileNames.size() - FLIGHT_MAX_DUMPS; ++i) {
+        if (dir.remove(fileNames[i])) {
+            ++removed;
+        }
+    }
+
+    if (removed != 0) {
+        L_INFO("Removed {} old flight recorder dumps", removed);
+    }
+}
+
+// Write all of size bytes to a native file.
+#ifdef _WIN32
+static bool WriteAll(HANDLE file, const void *data, size_t size)
+{
+    DWORD written = 0;
+    return WriteFile(file, data, DWORD(size), &written, nullptr) && written == size;
+}
+#else
+static bool WriteAll(int file, const void *data, size_t size)
+{
+    const char *bytes = static_cast<const char *>(data);
+    while (size != 0) {
+        ssize_t written = ::write(file, bytes, size);
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= size_t(written);
+    }
+    return true;
+}
+#endif
+
+bool FlightRecorder::WriteDump(const PathChar *filePath)
+{
+    if (filePath[0] == 0) {
+        return false;
+    }
+
+#ifdef _WIN32
+    HANDLE file = CreateFileW(filePath, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+#else
+    int file = ::open(filePath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0) {
+        return false;
+    }
+#endif
+
+    int ringCount = std::min(s_ringCount.load(std::memory_order_relaxed), kMaxThreads);
+
+    FlightDumpHeader header = {};
+    header.magic = FLIGHT_DUMP_MAGIC;
+    header.version = FLIGHT_DUMP_VERSION;
+    header.recordSize = sizeof(FlightRecord);
+    header.ringCount = ringCount;
+    header.capacity = kCapacity;
+    header.dumpTimeNs = NowNs();
+
+    bool bOk = WriteAll(file, &header, sizeof(header));
+
+    for (int i = 0; bOk && i != ringCount; ++i) {
+        const Ring &ring = s_rings[i];
+        uint32_t ringHeader[2] = { ring.threadIndex.load(std::memory_order_relaxed),
+                                   ring.next.load(std::memory_order_acquire) };
+
+        bOk = WriteAll(file, ringHeader, sizeof(ringHeader))
+            && WriteAll(file, ring.records, sizeof(ring.records));
+    }
+
+#ifdef _WIN32
+    return CloseHandle(file) && bOk;
+#else
+    return ::close(file) == 0 && bOk;
+#endif
+}
+
+void FlightRecorder::OnFatalSignal(int signal)
+{
+    WriteDump(g_crashDumpPath);
+
+    std::signal(signal, SIG_DFL);
+    std::raise(signal);
+}
+
+static const char *GetFlightEventName(uint32_t event)
+{
+    switch (event) {
+    case FLIGHT_REFRESH_TICK:   return "refresh_tick";
+    case FLIGHT_PAINT_BEGIN:    return "paint_begin";
+    case FLIGHT_PAINT_END:      return "paint_end";
+    case FLIGHT_HOOK_KEY:       return "hook_key";
+    case FLIGHT_HOOK_HOTKEY:    return "hook_hotkey";
+    case FLIGHT_PROFILE_SWITCH: return "profile_switch";
+    case FLIGHT_LATENCY_SPIKE:  return "latency_spike";
+    default:                    return nullptr;
+    }
+}
+
+bool FlightRecorder::Decode(QString filePath, QString *text)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    FlightDumpHeader header;
+    if (file.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header)
+        || header.magic != FLIGHT_DUMP_MAGIC || header.version > FLIGHT_DUMP_VERSION
+        || header.recordSize != sizeof(FlightRecord) || header.ringCount > kMaxThreads
+        || header.capacity == 0 || header.capacity > (1u << 24)
+        || (header.capacity & (header.capacity - 1)) != 0) {
+        return false;
+    }
+
+    struct Entry {
+        uint32_t thread;
+        FlightRecord record;
+    };
+    QVector<Entry> entries;
+
+    QVector<FlightRecord> records(header.capacity);
+    for (uint32_t i = 0; i != header.ringCount; ++i) {
+        uint32_t ringHeader[2];
+        qint64 recordsSize = qint64(header.capacity) * sizeof(FlightRecord);
+        if (file.read(reinterpret_cast<char *>(ringHeader), sizeof(ringHeader)) != sizeof(ringHeader)
+            || file.read(reinterpret_cast<char *>(records.data()), recordsSize) != recordsSize) {
+            return false;
+        }
+
+        // Only the last capacity records are kept.
+        uint32_t next = ringHeader[1];
+        uint32_t count = std::min(next, header.capacity);
+        for (uint32_t k = next - count; k != next; ++k) {
+            entries.append({ ringHeader[0], records[k & (header.capacity - 1)] });
+        }
+    }
+
+    std::stable_sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.record.timestampNs < b.record.timestampNs;
+    });
+
+    QTextStream stream(text);
+    stream << "# " << entries.size() << " records, times in ms before dump\n";
+    for (const Entry &entry : entries) {
+        const FlightRecord &record = entry.record;
+        double beforeMs = (header.dumpTimeNs - record.timestampNs) / 1e6;
+        const char *name = GetFlightEventName(record.event);
+
+        stream << QString::number(-beforeMs, 'f', 3) << " t" << entry.thread << ' ';
+        if (name) {
+            stream << name;
+        } else {
+            stream << "event_" << record.event;
+        }
+        stream << ' ' << record.arg0 << ' ' << record.arg1 << '\n';
+    }
+
+    return true;
+}
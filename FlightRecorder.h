@@ -0,0 +1,123 @@
+#ifndef FLIGHTRECORDER_H
+#define FLIGHTRECORDER_H
+
+#include <QString>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Event ids of flight records. Never reuse a number, dumps are decoded
+//   offline by another build.
+enum FlightEvent : uint32_t {
+    FLIGHT_REFRESH_TICK     = 1,    // arg0: ms since last tick, arg1: 1 if mouse moved.
+    FLIGHT_PAINT_BEGIN      = 2,    // arg0, arg1: width, height of painted rect.
+    FLIGHT_PAINT_END        = 3,    // arg0: paint time in us.
+    FLIGHT_HOOK_KEY         = 4,    // arg0: virtual key code, arg1: window message.
+    FLIGHT_HOOK_HOTKEY      = 5,    // arg0: shortcut id, arg1: 1 repeat, 2 release.
+    FLIGHT_PROFILE_SWITCH   = 6,    // arg0: profile id, arg1: 1 if prefetched.
+    FLIGHT_LATENCY_SPIKE    = 7,    // arg0: latency in ms, arg1: event id which was late.
+};
+
+// Compact binary record, 24 bytes.
+struct FlightRecord {
+    int64_t timestampNs;    // steady_clock.
+    uint32_t event;
+    int32_t arg0;
+    int32_t arg1;
+    uint32_t reserved;
+};
+
+// Always-on recorder of hot path events.
+//
+// Each thread writes its own ring of the last kCapacity records, without locks
+//   or allocation, so recording costs a clock read and a few stores. A ring is
+//   freed for another thread when its thread exits. Rings are
+//   written to a file on demand, on a fatal signal or unhandled exception, and
+//   on latency spikes. A dump taken while threads are recording may contain a
+//   few torn records at the write positions.
+class FlightRecorder
+{
+public:
+    static constexpr int kMaxThreads = 16;
+    static constexpr uint32_t kCapacity = 4096;    // Per thread, power of two.
+
+    static int64_t NowNs()
+    {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+    }
+
+    // Record an event on the calling thread. Dropped if more than
+    //   kMaxThreads threads record at once.
+    static void Record(FlightEvent event, int32_t arg0 = 0, int32_t arg1 = 0)
+    {
+        thread_local RingLease lease;
+        Ring *ring = lease.ring;
+        if (!ring) {
+            return;
+        }
+
+        uint32_t index = ring->next.load(std::memory_order_relaxed);
+        FlightRecord &record = ring->records[index & (kCapacity - 1)];
+        record.timestampNs = NowNs();
+        record.event = event;
+        record.arg0 = arg0;
+        record.arg1 = arg1;
+        ring->next.store(index + 1, std::memory_order_release);
+    }
+
+    // Set directory of dump files, and dump on fatal signals, unhandled
+    //   exceptions and std::terminate().
+    static void Install(QString dumpDir);
+
+    // Write all rings into a new file in the dump directory. Return file
+    //   path, empty on failure.
+    static QString Dump(QString reason);
+
+    // Dump on a background thread, at most once per minute. Only the newest
+    //   dumps are kept.
+    static void DumpOnSpike(QString reason);
+
+    // Turn a dump into text, one record per line, sorted by time. Return
+    //   false if filePath is not a dump.
+    static bool Decode(QString filePath, QString *text);
+
+private:
+    struct Ring {
+        std::atomic<uint32_t> next{ 0 };
+        std::atomic<uint32_t> threadIndex{ 0 };
+        std::atomic<bool> bInUse{ false };
+        FlightRecord records[kCapacity];
+    };
+
+    // Ring of a thread, freed when the thread exits.
+    struct RingLease {
+        Ring *ring = AcquireRing();
+        ~RingLease() { ReleaseRing(ring); }
+    };
+
+    static Ring *AcquireRing();
+    static void ReleaseRing(Ring *ring);
+
+#ifdef _WIN32
+    using PathChar = wchar_t;
+#else
+    using PathChar = char;
+#endif
+
+    // Write dump with system calls only, no allocation, usable while
+    //   crashing. filePath is native.
+    static bool WriteDump(const PathChar *filePath);
+
+    static void OnFatalSignal(int signal);
+
+    // Remove all but the newest dumps.
+    static void PruneDumps();
+
+    static Ring s_rings[kMaxThreads];
+    static std::atomic<int> s_ringCount;            // Rings ever used.
+    static std::atomic<uint32_t> s_threadCount;     // Threads ever recorded.
+};
+
+#endif // FLIGHTRECORDER_H
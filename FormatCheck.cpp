@@ -0,0 +1,226 @@
+#define MYLOG_MODULE LogModule::Profiles
+
+#include "FormatCheck.h"
+#include "OverlaySchemeFormat.h"
+#include "ProfileStore.h"
+#include "SchemeCodec.h"
+#include "mylog/mylog.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QtEndian>
+
+// Same header layout as in SchemeCodec.cpp.
+#define CHECK_SCHEME_HEADER_SIZE    16
+
+// Tag no version uses yet.
+#define CHECK_UNKNOWN_TAG           0x7FFF
+
+static QVector<OverlayScheme::Ptr> MakeSchemes()
+{
+    QVector<OverlayScheme::Ptr> schemes;
+
+    OverlayScheme::Ptr scheme = std::make_shared<OverlayScheme>();
+    scheme->schemeName = "Default";
+    schemes.push_back(scheme);
+
+    scheme = std::make_shared<OverlayScheme>();
+    scheme->schemeName = QString::fromUtf8("\xE9\x98\x85\xE8\xAF\xBB \xF0\x9F\x93\x96");
+    scheme->bEnableHLine = false;
+    scheme->vLineWidth = SCHEME_MAX_LINE_WIDTH;
+    scheme->vLineColor = QColor(255, 0, 128, 200);
+    schemes.push_back(scheme);
+
+    scheme = std::make_shared<OverlayScheme>();
+    scheme->schemeName = QString(SCHEME_MAX_NAME_LENGTH, QChar('n'));
+    scheme->hLineWidth = SCHEME_MIN_LINE_WIDTH;
+    scheme->invertedBgColor = QColor(0, 0, 0, 0);
+    schemes.push_back(scheme);
+
+    return schemes;
+}
+
+static bool IsSame(const OverlayScheme &a, const OverlayScheme &b)
+{
+    return EncodeScheme(a) == EncodeScheme(b);
+}
+
+static bool CheckScheme(const OverlayScheme &scheme)
+{
+    QByteArray data = EncodeScheme(scheme);
+    int failures = 0;
+
+    OverlayScheme::Ptr decoded = DecodeScheme(data);
+    if (!decoded || !IsSame(*decoded, scheme)) {
+        L_ERROR("Scheme not read back: {}", scheme);
+        ++failures;
+    }
+
+    for (int size = 0; size != data.size(); ++size) {
+        if (DecodeScheme(data.left(size))) {
+            L_ERROR("Truncated scheme accepted: {}, size: {} of {}", scheme.schemeName, size, data.size());
+            ++failures;
+        }
+    }
+
+    // Flipping header flags may fall back to the tagged decoder, which must
+    //   still read the same.
+    for (int i = 0; i != data.size() * 8; ++i) {
+        QByteArray damaged = data;
+        damaged[i / 8] = char(damaged[i / 8] ^ (1 << (i % 8)));
+
+        OverlayScheme::Ptr read = DecodeScheme(damaged);
+        if (read && !IsSame(*read, scheme)) {
+            L_ERROR("Damaged scheme read wrong: {}, bit: {}", scheme.schemeName, i);
+            ++failures;
+        }
+    }
+
+    // Field of a newer version, after the known ones.
+    QByteArray payload = data.mid(CHECK_SCHEME_HEADER_SIZE);
+    uchar field[4 + 3] = {};
+    qToLittleEndian<quint16>(CHECK_UNKNOWN_TAG, field);
+    qToLittleEndian<quint16>(3, field + 2);
+    payload.append(reinterpret_cast<const char *>(field), sizeof(field));
+
+    QByteArray newer = data.left(CHECK_SCHEME_HEADER_SIZE) + payload;
+    uchar *header = reinterpret_cast<uchar *>(newer.data());
+    qToLittleEndian<quint32>(payload.size(), header + 8);
+    qToLittleEndian<quint32>(Crc32(payload.constData(), payload.size()), header + 12);
+
+    decoded = DecodeScheme(newer);
+    if (!decoded || !IsSame(*decoded, scheme)) {
+        L_ERROR("Scheme with unknown field not read: {}", scheme.schemeName);
+        ++failures;
+    }
+
+    return failures == 0;
+}
+
+static bool WriteFile(QString filePath, const QByteArray &data)
+{
+    QFile file(filePath);
+    return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+}
+
+static QByteArray ReadFile(QString filePath)
+{
+    QFile file(filePath);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+// Open damaged store and check what is read. Every profile read must be one
+//   of the versions written, and the store must take new profiles. A store
+//   which is not opened must be left as it is.
+static bool CheckDamagedStore(QString storePath, QString legacyDir, const QByteArray &data,
+                              const QHash<QString, QVector<OverlayScheme::Ptr>> &written)
+{
+    QDir dir = QFileInfo(storePath).absoluteDir();
+    for (const QString &fileName : dir.entryList({ QFileInfo(storePath).fileName() + ".bad*" }, QDir::Files)) {
+        dir.remove(fileName);
+    }
+
+    if (!WriteFile(storePath, data)) {
+        L_ERROR("Write damaged store failed: {}", storePath);
+        return false;
+    }
+
+    ProfileStore store;
+    if (!store.Open(storePath, legacyDir)) {
+        if (ReadFile(storePath) != data) {
+            L_ERROR("Damaged store not opened, but changed. size: {}", data.size());
+            return false;
+        }
+        return true;
+    }
+
+    for (const OverlayScheme::Ptr &scheme : store.LoadAll()) {
+        bool bWritten = false;
+        for (const OverlayScheme::Ptr &version : written.value(scheme->schemeName)) {
+            bWritten = bWritten || IsSame(*version, *scheme);
+        }
+        if (!bWritten) {
+            L_ERROR("Damaged store read wrong profile: {}, size: {}", *scheme, data.size());
+            return false;
+        }
+    }
+
+    OverlayScheme::Ptr added = std::make_shared<OverlayScheme>();
+    added->schemeName = "Added";
+    if (!store.Save(added) || !store.Reload() || !store.Load(added->schemeName)) {
+        L_ERROR("Damaged store does not take new profiles, size: {}", data.size());
+        return false;
+    }
+
+    return true;
+}
+
+static bool CheckStore(QString workDir)
+{
+    QString storePath = QDir(workDir).filePath("check.pack");
+    QString legacyDir = QDir(workDir).filePath("legacy");
+    QDir(legacyDir).mkpath(".");
+    QFile::remove(storePath);
+
+    // Short names keep the file small, it is opened once per byte twice.
+    QVector<OverlayScheme::Ptr> schemes = MakeSchemes().mid(0, 2);
+    QHash<QString, QVector<OverlayScheme::Ptr>> written;
+    {
+        ProfileStore store;
+        if (!store.Open(storePath, legacyDir)) {
+            L_ERROR("Create store failed: {}", storePath);
+            return false;
+        }
+
+        for (const OverlayScheme::Ptr &scheme : schemes) {
+            store.Save(scheme);
+            written[scheme->schemeName].push_back(scheme);
+        }
+
+        OverlayScheme::Ptr changed = std::make_shared<OverlayScheme>(*schemes[0]);
+        changed->hLineWidth = 3;
+        store.Save(changed);
+        written[changed->schemeName].push_back(changed);
+
+        store.Remove(schemes[1]->schemeName);
+
+        OverlayScheme::Ptr loaded = store.Load(changed->schemeName);
+        if (store.LoadAll().size() != 1 || !loaded || !IsSame(*loaded, *changed)
+                || store.Load(schemes[1]->schemeName)) {
+            L_ERROR("Store not read back as written");
+            return false;
+        }
+    }
+
+    QByteArray data = ReadFile(storePath);
+
+    int failures = 0;
+    for (int size = 0; size != data.size(); ++size) {
+        failures += CheckDamagedStore(storePath, legacyDir, data.left(size), written) ? 0 : 1;
+    }
+
+    // Every bit would be slow with a store opened for each, one per byte.
+    for (int i = 0; i != data.size(); ++i) {
+        QByteArray damaged = data;
+        damaged[i] = char(damaged[i] ^ (1 << (i % 8)));
+        failures += CheckDamagedStore(storePath, legacyDir, damaged, written) ? 0 : 1;
+    }
+
+    return failures == 0;
+}
+
+bool CheckFileFormats(QString workDir)
+{
+    bool bOk = true;
+
+    for (const OverlayScheme::Ptr &scheme : MakeSchemes()) {
+        bOk = CheckScheme(*scheme) && bOk;
+    }
+    bOk = CheckStore(workDir) && bOk;
+
+    L_INFO("File format check {}", bOk ? "passed" : "FAILED");
+
+    return bOk;
+}
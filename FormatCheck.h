@@ -0,0 +1,13 @@
+#ifndef FORMATCHECK_H
+#define FORMATCHECK_H
+
+#include <QString>
+
+// Check that damaged scheme and profile store files never decode to wrong
+//   profiles: every truncation and every single bit flip of files written
+//   by this build must be rejected, or read back as what was written. Also
+//   check that fields of newer versions are skipped. Files are written in
+//   workDir. Log each failure, return true if none.
+bool CheckFileFormats(QString workDir);
+
+#endif // FORMATCHECK_H
@@ -0,0 +1,76 @@
+#define MYLOG_MODULE LogModule::Hotkey
+
+#include "HotkeyEdit.h"
+#include "HotkeyHook/KeyboardHook.h"
+#include "mylog/mylog.h"
+
+#include <QKeyEvent>
+
+HotkeyEdit::HotkeyEdit(QWidget *parent) :
+    QLineEdit(parent)
+{
+    setReadOnly(true);
+    setPlaceholderText("Press keys...");
+}
+
+void HotkeyEdit::SetHotkey(Hotkey hotkey)
+{
+    m_hotkey = hotkey;
+
+    if (hotkey.getVkCode() == 0) {
+        clear();
+    } else {
+        setText(hotkey.toStr());
+    }
+}
+
+void HotkeyEdit::keyPressEvent(QKeyEvent *event)
+{
+    // Wait for the non-modifier key.
+    int key = event->key();
+    if (key == Qt::Key_Control || key == Qt::Key_Shift || key == Qt::Key_Alt
+            || key == Qt::Key_Meta || key == Qt::Key_AltGr) {
+        return;
+    }
+
+    Qt::KeyboardModifiers modifiers = event->modifiers();
+    unsigned int vkCode = event->nativeVirtualKey();
+
+    // Backspace alone clears the binding.
+    Qt::KeyboardModifiers hotkeyModifiers = Qt::ControlModifier | Qt::ShiftModifier
+            | Qt::AltModifier | Qt::MetaModifier;
+    if (vkCode == VK_BACK && !(modifiers & hotkeyModifiers)) {
+        SetHotkey(Hotkey());
+        emit SigHotkeyCaptured(m_hotkey);
+        return;
+    }
+
+    // Only keys which can be saved and parsed back.
+    if (Hotkey::vkCodeToKeyName(vkCode) == "Unknown") {
+        L_TRACE("Unsupported hotkey key. vkCode: {}", vkCode);
+        return;
+    }
+
+    Hotkey hotkey(modifiers.testFlag(Qt::ControlModifier),
+                  modifiers.testFlag(Qt::ShiftModifier),
+                  modifiers.testFlag(Qt::AltModifier),
+                  modifiers.testFlag(Qt::MetaModifier),
+                  vkCode);
+
+    SetHotkey(hotkey);
+    emit SigHotkeyCaptured(m_hotkey);
+}
+
+void HotkeyEdit::focusInEvent(QFocusEvent *event)
+{
+    KeyboardHook::getInstance().setPaused(true);
+
+    QLineEdit::focusInEvent(event);
+}
+
+void HotkeyEdit::focusOutEvent(QFocusEvent *event)
+{
+    KeyboardHook::getInstance().setPaused(false);
+
+    QLineEdit::focusOutEvent(event);
+}
@@ -0,0 +1,35 @@
+#ifndef HOTKEYEDIT_H
+#define HOTKEYEDIT_H
+
+#include "HotkeyHook/Hotkey.h"
+
+#include <QLineEdit>
+
+// Read-only line edit recording the key combination pressed in it.
+// The global keyboard hook is paused while it has focus, so registered
+//   hotkeys can be captured too.
+class HotkeyEdit : public QLineEdit
+{
+    Q_OBJECT
+
+public:
+    explicit HotkeyEdit(QWidget *parent = nullptr);
+
+    // Show hotkey without emitting SigHotkeyCaptured.
+    void SetHotkey(Hotkey hotkey);
+    Hotkey GetHotkey() const { return m_hotkey; }
+
+signals:
+    // Emitted when a new combination is pressed, or cleared by Backspace.
+    void SigHotkeyCaptured(Hotkey hotkey);
+
+protected:
+    void keyPressEvent(QKeyEvent *event) override;
+    void focusInEvent(QFocusEvent *event) override;
+    void focusOutEvent(QFocusEvent *event) override;
+
+private:
+    Hotkey m_hotkey;
+};
+
+#endif // HOTKEYEDIT_H
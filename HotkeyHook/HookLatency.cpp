@@ -0,0 +1,61 @@
+#include "HookLatency.h"
+
+void HookLatency::Record(int64_t elapsedNs)
+{
+    int64_t us = elapsedNs / 1000;
+
+    m_buckets[BucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+
+    int64_t oldMax = m_maxUs.load(std::memory_order_relaxed);
+    while (us > oldMax
+           && !m_maxUs.compare_exchange_weak(oldMax, us, std::memory_order_relaxed)) {
+    }
+}
+
+HookLatency::Snapshot HookLatency::TakeSnapshot()
+{
+    Snapshot snapshot;
+
+    for (int i = 0; i != kBucketCount; ++i) {
+        snapshot.buckets[i] = m_buckets[i].exchange(0, std::memory_order_relaxed);
+        snapshot.count += snapshot.buckets[i];
+    }
+    snapshot.maxUs = m_maxUs.exchange(0, std::memory_order_relaxed);
+
+    return snapshot;
+}
+
+int HookLatency::BucketIndex(int64_t us)
+{
+    int index = 0;
+    while (us > 1 && index < kBucketCount - 1) {
+        us >>= 1;
+        ++index;
+    }
+
+    return index;
+}
+
+int64_t HookLatency::Snapshot::PercentileUs(double p) const
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    // Rank of the sample we are looking for, at least the first one.
+    uint64_t rank = static_cast<uint64_t>(p * count + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i != kBucketCount; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            int64_t upperUs = int64_t(1) << (i + 1);
+            return upperUs < maxUs ? upperUs : maxUs;
+        }
+    }
+
+    return maxUs;
+}
@@ -0,0 +1,72 @@
+#ifndef HOOK_LATENCY_H
+#define HOOK_LATENCY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Lock-free latency histogram for keyboard hook callbacks.
+//
+// It has no platform dependency, so any hook backend can feed it and the
+// numbers reported are comparable. Buckets are powers of two in microseconds;
+// recording is a few relaxed atomic operations, safe to call from the hook.
+class HookLatency
+{
+public:
+    // Bucket i holds samples in [2^i, 2^(i+1)) us. Bucket 0 also holds < 1 us.
+    static constexpr int kBucketCount = 24;
+
+    // Counts taken out of the histogram by TakeSnapshot().
+    struct Snapshot {
+        uint32_t buckets[kBucketCount] = {};
+        uint32_t count = 0;
+        int64_t maxUs = 0;
+
+        // Approximate percentile in microseconds (upper bound of the bucket).
+        // p is in [0, 1]. Return 0 if no samples.
+        int64_t PercentileUs(double p) const;
+    };
+
+    // steady_clock now, in nanoseconds.
+    static int64_t NowNs()
+    {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+    }
+
+    void Record(int64_t elapsedNs);
+
+    // Move current counts into a snapshot and restart the window.
+    Snapshot TakeSnapshot();
+
+private:
+    static int BucketIndex(int64_t us);
+
+    std::atomic<uint32_t> m_buckets[kBucketCount] = {};
+    std::atomic<int64_t> m_maxUs{ 0 };
+};
+
+// Time a scope and record the elapsed time into a HookLatency.
+class HookLatencyScope
+{
+public:
+    explicit HookLatencyScope(HookLatency &latency)
+        : m_latency(latency), m_start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~HookLatencyScope()
+    {
+        auto elapsed = std::chrono::steady_clock::now() - m_start;
+        m_latency.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+    HookLatencyScope(const HookLatencyScope &) = delete;
+    HookLatencyScope &operator=(const HookLatencyScope &) = delete;
+
+private:
+    HookLatency &m_latency;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+#endif // HOOK_LATENCY_H
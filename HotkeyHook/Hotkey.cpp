@@ -102,6 +102,20 @@ QString Hotkey::toStr()
     return keyStr;
 }
 
+quint32 Hotkey::pack() const
+{
+    return pack(modCtrl, modShift, modAlt, modWin, vkCode);
+}
+
+quint32 Hotkey::pack(bool ctrl, bool shift, bool alt, bool win, unsigned int key)
+{
+    return (key & 0xFFFF)
+            | (ctrl ? 1u << 16 : 0)
+            | (shift ? 1u << 17 : 0)
+            | (alt ? 1u << 18 : 0)
+            | (win ? 1u << 19 : 0);
+}
+
 void Hotkey::setModWin(bool value)
 {
     modWin = value;
@@ -59,6 +59,10 @@ public:
     static QList<KeyNameCode> getKeyNameCodes();
     QString toStr();
 
+    // Modifiers and key packed into one integer. Equal hotkeys pack equally.
+    quint32 pack() const;
+    static quint32 pack(bool ctrl, bool shift, bool alt, bool win, unsigned int key);
+
 private:
     bool modCtrl;
     bool modShift;
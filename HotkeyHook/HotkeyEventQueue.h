@@ -0,0 +1,67 @@
+#ifndef HOTKEY_EVENT_QUEUE_H
+#define HOTKEY_EVENT_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Hotkey event passed from the hook thread to the GUI thread.
+struct HotkeyEvent {
+    int id;
+    int64_t timestampNs;    // steady_clock time when the hook saw the key.
+    bool bRepeat;           // Auto-repeat of a key which is held down.
+    bool bReleased;         // Key of the hotkey released.
+};
+
+// What to do with auto-repeated presses of a hotkey.
+enum class HotkeyRepeatPolicy {
+    Fire,       // Deliver every repeat.
+    Ignore,     // Deliver only the initial press.
+    Collapse,   // Deliver at most one repeat per GUI wakeup.
+};
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// Items are copied in and out, so T should be a small POD.
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    // Producer only. Return false if full.
+    bool Push(const T &item)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+
+        m_items[tail & (Capacity - 1)] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Consumer only. Return false if empty.
+    bool Pop(T &item)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        item = m_items[head & (Capacity - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+private:
+    T m_items[Capacity];
+
+    // Separate cache lines, so both sides do not bounce the same line.
+    alignas(64) std::atomic<size_t> m_head{ 0 };
+    alignas(64) std::atomic<size_t> m_tail{ 0 };
+};
+
+#endif // HOTKEY_EVENT_QUEUE_H
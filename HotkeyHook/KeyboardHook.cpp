@@ -17,50 +17,90 @@ You should have received a copy of the GNU General Public License
 along with Capture2Text.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#define MYLOG_MODULE LogModule::Hotkey
+
 #include "KeyboardHook.h"
+#include "mylog/mylog.h"
+#include "FlightRecorder.h"
+
+#include <QTimer>
+#include <QVarLengthArray>
+
+// How often the watchdog checks hook latency and liveness.
+#define WATCHDOG_INTERVAL_MS 2000
+
+// Raw keyboard events needed in one interval, with none seen by the hook,
+//   before the hook is considered removed.
+#define WATCHDOG_MIN_RAW_EVENTS 4
 
 void KeyboardHook::run()
 {
     if(hHook == nullptr)
     {
-        hHook = SetWindowsHookEx(WH_KEYBOARD_LL, hookProc, nullptr, 0);
-
-        if (hHook == nullptr)
+        if (!installHook())
         {
             qDebug() << "Keyboard Hook Failed!";
             return;
         }
     }
 
+    createRawInputWindow();
+
+    // Created in this thread, so the checks run on the hook thread.
+    QTimer watchdog;
+    connect(&watchdog, &QTimer::timeout, &watchdog, [this]() {
+        checkHookHealth();
+    });
+    watchdog.start(WATCHDOG_INTERVAL_MS);
+
     QEventLoop eventLoop;
     eventLoop.exec();
 }
 
-void KeyboardHook::addHotkey(int id, Hotkey hotkey)
+bool KeyboardHook::addHotkey(int id, Hotkey hotkey)
 {
-    if(hotkeys.contains(id))
+    if(hotkey.getVkCode() == 0)
     {
-        if(hotkey.getVkCode() == 0)
-        {
-            hotkeys.remove(id);
-        }
-        else
-        {
-            hotkeys[id] = hotkey;
-        }
+        removeHotkey(id);
+        return true;
     }
-    else
+
+    int existingId = findHotkey(hotkey);
+    if(existingId != -1 && existingId != id)
+    {
+        return false;
+    }
+
+    auto table = std::make_shared<HotkeyTable>(*std::atomic_load(&hotkeyTable));
+
+    if(table->byId.contains(id))
     {
-        hotkeys.insert(id, hotkey);
+        table->byKey.remove(table->byId[id].pack());
     }
+    table->byId[id] = hotkey;
+    table->byKey[hotkey.pack()] = id;
+
+    std::atomic_store(&hotkeyTable, std::shared_ptr<const HotkeyTable>(table));
+
+    return true;
 }
 
 void KeyboardHook::removeHotkey(int id)
 {
-    if(hotkeys.contains(id))
+    if(!std::atomic_load(&hotkeyTable)->byId.contains(id))
     {
-        hotkeys.remove(id);
+        return;
     }
+
+    auto table = std::make_shared<HotkeyTable>(*std::atomic_load(&hotkeyTable));
+    table->byKey.remove(table->byId.take(id).pack());
+
+    std::atomic_store(&hotkeyTable, std::shared_ptr<const HotkeyTable>(table));
+}
+
+int KeyboardHook::findHotkey(const Hotkey &hotkey)
+{
+    return std::atomic_load(&hotkeyTable)->byKey.value(hotkey.pack(), -1);
 }
 
 void KeyboardHook::endThread()
@@ -74,16 +114,250 @@ void KeyboardHook::endThread()
     exit(0);
 }
 
+bool KeyboardHook::installHook()
+{
+    hHook = SetWindowsHookEx(WH_KEYBOARD_LL, hookProc, nullptr, 0);
+
+    return hHook != nullptr;
+}
+
+void KeyboardHook::createRawInputWindow()
+{
+    const wchar_t *className = L"MouseLineFocusRawInput";
+
+    WNDCLASSW wc;
+    memset(&wc, 0, sizeof(wc));
+    wc.lpfnWndProc = rawInputWndProc;
+    wc.hInstance = GetModuleHandleW(nullptr);
+    wc.lpszClassName = className;
+    RegisterClassW(&wc);
+
+    // Message-only window, receiving raw keyboard input in the background.
+    hRawInputWnd = CreateWindowExW(0, className, L"", 0, 0, 0, 0, 0,
+                                   HWND_MESSAGE, nullptr, wc.hInstance, nullptr);
+    if (hRawInputWnd == nullptr)
+    {
+        L_WARN("Create raw input window failed: {}. Hook liveness check disabled.", GetLastError());
+        return;
+    }
+
+    RAWINPUTDEVICE device;
+    device.usUsagePage = 0x01;  // Generic desktop controls.
+    device.usUsage = 0x06;      // Keyboard.
+    device.dwFlags = RIDEV_INPUTSINK;
+    device.hwndTarget = hRawInputWnd;
+
+    if (!RegisterRawInputDevices(&device, 1, sizeof(device)))
+    {
+        L_WARN("Register raw input failed: {}. Hook liveness check disabled.", GetLastError());
+        DestroyWindow(hRawInputWnd);
+        hRawInputWnd = nullptr;
+    }
+}
+
+void KeyboardHook::checkHookHealth()
+{
+    // Latency.
+    HookLatency::Snapshot snapshot = latency.TakeSnapshot();
+    if (snapshot.count != 0)
+    {
+        int64_t p99Us = snapshot.PercentileUs(0.99);
+        int64_t budgetUs = int64_t(latencyBudgetMs.load()) * 1000;
+
+        // Warn at 80% of the budget.
+        if (p99Us * 5 >= budgetUs * 4)
+        {
+            L_WARN("Keyboard hook p99 latency {} us near budget {} ms. Samples: {}, max: {} us",
+                p99Us, latencyBudgetMs.load(), snapshot.count, snapshot.maxUs);
+
+            FlightRecorder::Record(FLIGHT_LATENCY_SPIKE, int32_t(snapshot.maxUs / 1000), FLIGHT_HOOK_KEY);
+            FlightRecorder::DumpOnSpike("hook");
+        }
+    }
+
+    // Delivery to the GUI thread. Each wakeup is one queued call allocation.
+    HookLatency::Snapshot delivery = deliveryLatency.TakeSnapshot();
+    if (delivery.count != 0)
+    {
+        L_DEBUG("Hotkey delivery. events: {}, wakeups: {}, dropped: {}, p50: {} us, p99: {} us",
+            queuedEventCount.exchange(0), wakeupCount.exchange(0), droppedEventCount.exchange(0),
+            delivery.PercentileUs(0.5), delivery.PercentileUs(0.99));
+    }
+
+    // Liveness.
+    unsigned int hookEvents = hookEventCount.load(std::memory_order_relaxed);
+    unsigned int rawEvents = rawEventCount.load(std::memory_order_relaxed);
+    unsigned int hookDelta = hookEvents - lastHookEventCount;
+    unsigned int rawDelta = rawEvents - lastRawEventCount;
+    lastHookEventCount = hookEvents;
+    lastRawEventCount = rawEvents;
+
+    if (hRawInputWnd == nullptr || hookDelta != 0 || rawDelta < WATCHDOG_MIN_RAW_EVENTS)
+    {
+        return;
+    }
+
+    L_WARN("Keyboard hook got no events while raw input got {}. Reinstall hook.", rawDelta);
+
+    if (hHook != nullptr)
+    {
+        UnhookWindowsHookEx(hHook);
+        hHook = nullptr;
+    }
+
+    resetKeyState();
+
+    if (!installHook())
+    {
+        L_ERROR("Reinstall keyboard hook failed: {}", GetLastError());
+    }
+}
+
+void KeyboardHook::resetKeyState()
+{
+    keysDown.reset();
+
+    for (int &pressedId : pressedIds)
+    {
+        if (pressedId != -1)
+        {
+            postEvent({ pressedId, HookLatency::NowNs(), false, true });
+            pressedId = -1;
+        }
+    }
+}
+
+void KeyboardHook::postEvent(const HotkeyEvent &event)
+{
+    if (eventQueue.Push(event))
+    {
+        queuedEventCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    else if (event.bReleased && event.id >= 0 && event.id < 256)
+    {
+        overflowReleases[event.id / 64].fetch_or(uint64_t(1) << (event.id % 64),
+                                                 std::memory_order_release);
+    }
+    else
+    {
+        droppedEventCount.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    if (!wakeupPending.exchange(true))
+    {
+        wakeupCount.fetch_add(1, std::memory_order_relaxed);
+
+        // This object lives in the GUI thread.
+        QMetaObject::invokeMethod(this, [this]() { drainEvents(); }, Qt::QueuedConnection);
+    }
+}
+
+void KeyboardHook::drainEvents()
+{
+    // Clear before draining, so an event pushed from now on posts a new wakeup.
+    wakeupPending.store(false);
+
+    // Ids with a repeat already delivered in this batch.
+    QVarLengthArray<int, 8> repeatedIds;
+
+    HotkeyEvent event;
+    while (eventQueue.Pop(event))
+    {
+        if (event.bReleased)
+        {
+            emit keyReleased(event.id);
+            continue;
+        }
+
+        if (event.bRepeat)
+        {
+            HotkeyRepeatPolicy policy = repeatPolicies.value(event.id, HotkeyRepeatPolicy::Fire);
+            if (policy == HotkeyRepeatPolicy::Ignore)
+            {
+                continue;
+            }
+            if (policy == HotkeyRepeatPolicy::Collapse)
+            {
+                if (repeatedIds.contains(event.id))
+                {
+                    continue;
+                }
+                repeatedIds.append(event.id);
+            }
+        }
+
+        deliveryLatency.Record(HookLatency::NowNs() - event.timestampNs);
+
+        emit keyPressed(event.id);
+    }
+
+    // Releases of a full queue, after the presses before them.
+    for (int word = 0; word != int(std::size(overflowReleases)); ++word)
+    {
+        uint64_t bits = overflowReleases[word].exchange(0, std::memory_order_acquire);
+        for (int bit = 0; bits != 0; ++bit, bits >>= 1)
+        {
+            if (bits & 1)
+            {
+                emit keyReleased(word * 64 + bit);
+            }
+        }
+    }
+}
+
+LRESULT CALLBACK KeyboardHook::rawInputWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
+{
+    if (msg == WM_INPUT)
+    {
+        KeyboardHook::getInstance().rawEventCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return DefWindowProcW(hWnd, msg, wParam, lParam);
+}
+
 LRESULT CALLBACK KeyboardHook::hookProc(int nCode, WPARAM wParam, LPARAM lParam)
 {
+    HookLatencyScope latencyScope(KeyboardHook::getInstance().latency);
+
     if(nCode < 0)
     {
         return CallNextHookEx(KeyboardHook::getInstance().getHHook(), nCode, wParam, lParam);
     }
 
+    KeyboardHook::getInstance().hookEventCount.fetch_add(1, std::memory_order_relaxed);
+
     KBDLLHOOKSTRUCT kbData = *((KBDLLHOOKSTRUCT*)lParam);
+    FlightRecorder::Record(FLIGHT_HOOK_KEY, int32_t(kbData.vkCode), int32_t(wParam));
+    L_TRACE_LIMITED(10, "Hook key. vk: {}, message: {}", kbData.vkCode, wParam);
 
+    // Track held keys, a key down while already down is an auto-repeat.
+    //   A key up the hook missed leaves a key marked down, so the key must
+    //   also be down for the system. Low level hooks see the state before
+    //   this event.
+    bool bRepeat = false;
     if (wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN)
+    {
+        bRepeat = KeyboardHook::getInstance().keysDown.test(kbData.vkCode & 0xFF)
+            && (GetAsyncKeyState(int(kbData.vkCode)) & 0x8000) != 0;
+        KeyboardHook::getInstance().keysDown.set(kbData.vkCode & 0xFF);
+    }
+    else if (wParam == WM_KEYUP || wParam == WM_SYSKEYUP)
+    {
+        KeyboardHook::getInstance().keysDown.reset(kbData.vkCode & 0xFF);
+
+        // Release of a hotkey, whatever the modifiers are now.
+        int &pressedId = KeyboardHook::getInstance().pressedIds[kbData.vkCode & 0xFF];
+        if (pressedId != -1)
+        {
+            FlightRecorder::Record(FLIGHT_HOOK_HOTKEY, pressedId, 2);
+            KeyboardHook::getInstance().postEvent({ pressedId, HookLatency::NowNs(), false, true });
+            pressedId = -1;
+        }
+    }
+
+    if ((wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN)
+            && !KeyboardHook::getInstance().paused.load(std::memory_order_relaxed))
     {
         bool modCtrl = (GetKeyState(VK_CONTROL) & 0x8000) != 0;
         bool modShift = (GetKeyState(VK_SHIFT) & 0x8000) != 0;
@@ -92,37 +366,35 @@ LRESULT CALLBACK KeyboardHook::hookProc(int nCode, WPARAM wParam, LPARAM lParam)
 
         //qDebug() << "Key Pressed: " << kbData.vkCode;
 
-        for(auto id : KeyboardHook::getInstance().getHotkeys().keys())
+        std::shared_ptr<const HotkeyTable> table = std::atomic_load(&KeyboardHook::getInstance().hotkeyTable);
+        auto it = table->byKey.constFind(Hotkey::pack(modCtrl, modShift, modAlt, modWin, kbData.vkCode));
+
+        if(it != table->byKey.constEnd())
         {
-            Hotkey key = KeyboardHook::getInstance().getHotkeys()[id];
+            int id = it.value();
 
-            if(key.getVkCode() == kbData.vkCode
-                    && (key.getModCtrl() == modCtrl)
-                    && (key.getModShift() == modShift)
-                    && (key.getModAlt() == modAlt)
-                    && (key.getModWin() == modWin))
-            {
-                // qDebug() << "Hotkey ID: " << id;
-                emit KeyboardHook::getInstance().keyPressed(id);
+            // qDebug() << "Hotkey ID: " << id;
+            FlightRecorder::Record(FLIGHT_HOOK_HOTKEY, id, bRepeat ? 1 : 0);
+            KeyboardHook::getInstance().postEvent({ id, HookLatency::NowNs(), bRepeat, false });
+            KeyboardHook::getInstance().pressedIds[kbData.vkCode & 0xFF] = id;
 
-                // Suppress Start Menu and Alt Menu by sending a Ctrl up/down keypress.
-                // So WinKey becomes WinKey+Ctrl and Alt becomes Alt+Ctrl.
-                if(!modCtrl && !modShift
-                        && ((modWin && !modAlt) || (modAlt && !modWin)))
-                {
-                    int numInputs = 1;
-                    INPUT input;
-                    memset(&input, 0, sizeof(INPUT));
-                    input.type = INPUT_KEYBOARD;
-                    input.ki.wVk = VK_CONTROL;
-                    SendInput(numInputs, &input, sizeof(INPUT)); // Ctrl down
-
-                    input.ki.dwFlags = KEYEVENTF_KEYUP;
-                    SendInput(numInputs, &input, sizeof(INPUT)); // Ctrl up
-                }
+            // Suppress Start Menu and Alt Menu by sending a Ctrl up/down keypress.
+            // So WinKey becomes WinKey+Ctrl and Alt becomes Alt+Ctrl.
+            if(!modCtrl && !modShift
+                    && ((modWin && !modAlt) || (modAlt && !modWin)))
+            {
+                int numInputs = 1;
+                INPUT input;
+                memset(&input, 0, sizeof(INPUT));
+                input.type = INPUT_KEYBOARD;
+                input.ki.wVk = VK_CONTROL;
+                SendInput(numInputs, &input, sizeof(INPUT)); // Ctrl down
 
-                return 1;
+                input.ki.dwFlags = KEYEVENTF_KEYUP;
+                SendInput(numInputs, &input, sizeof(INPUT)); // Ctrl up
             }
+
+            return 1;
         }
     }
 
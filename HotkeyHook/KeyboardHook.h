@@ -23,9 +23,17 @@ along with Capture2Text.  If not, see <http://www.gnu.org/licenses/>.
 #include <QThread>
 #include <QEventLoop>
 #include <QDebug>
+#include <QHash>
 #include <QMap>
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <iterator>
+#include <memory>
 #include "Windows.h"
 #include "Hotkey.h"
+#include "HookLatency.h"
+#include "HotkeyEventQueue.h"
 
 class KeyboardHook : public QThread
 {
@@ -40,26 +48,114 @@ public:
     }
 
     HHOOK getHHook() const { return hHook; }
-    QMap<int, Hotkey> getHotkeys() { return hotkeys; }
+    QMap<int, Hotkey> getHotkeys() { return std::atomic_load(&hotkeyTable)->byId; }
 
-    void addHotkey(int id, Hotkey hotkey);
+    // Register or replace hotkey of id. A hotkey with vkCode 0 unregisters it.
+    // Return false if the key combination is already used by another id.
+    // Safe to call while the hook is running.
+    bool addHotkey(int id, Hotkey hotkey);
     void removeHotkey(int id);
 
+    // Id bound to the same key combination, -1 if none.
+    int findHotkey(const Hotkey &hotkey);
+
+    // Let all keys pass through, e.g. while capturing a new hotkey.
+    void setPaused(bool bPaused) { paused = bPaused; }
+
+    // How auto-repeat of hotkey id is delivered. Default: Fire. GUI thread only.
+    void setRepeatPolicy(int id, HotkeyRepeatPolicy policy) { repeatPolicies[id] = policy; }
+
     void endThread();
 
+    // Warn when p99 of hookProc gets close to this. Windows removes the hook
+    // silently once a callback exceeds LowLevelHooksTimeout.
+    void setLatencyBudgetMs(int budgetMs) { latencyBudgetMs = budgetMs; }
+
 signals:
+    // Emitted on the GUI thread.
     void keyPressed(int id);
+    void keyReleased(int id);
 
 private:
-    HHOOK hHook;
-    QMap<int, Hotkey> hotkeys;
+    // Registered hotkeys. Never modified once published; changes build a new
+    //   table and swap it in, so hookProc reads it without locking.
+    struct HotkeyTable {
+        QMap<int, Hotkey> byId;
+        QHash<quint32, int> byKey;  // Hotkey::pack() -> id.
+    };
 
-    KeyboardHook(): hHook(nullptr)
+    HHOOK hHook;
+    std::shared_ptr<const HotkeyTable> hotkeyTable;
+    std::atomic<bool> paused;
+
+    // Timing of hookProc, drained by the watchdog.
+    HookLatency latency;
+    std::atomic<int> latencyBudgetMs;
+
+    // Keyboard events seen by hookProc and by raw input. If raw input keeps
+    //   counting while the hook does not, the hook has been removed.
+    std::atomic<unsigned int> hookEventCount;
+    std::atomic<unsigned int> rawEventCount;
+    unsigned int lastHookEventCount = 0;
+    unsigned int lastRawEventCount = 0;
+    HWND hRawInputWnd = nullptr;
+
+    // Matched hotkeys, from hookProc to the GUI thread. hookProc only posts a
+    //   wakeup when none is pending, so a burst costs one queued call.
+    SpscQueue<HotkeyEvent, 64> eventQueue;
+    std::atomic<bool> wakeupPending;
+    std::atomic<unsigned int> queuedEventCount;
+    std::atomic<unsigned int> wakeupCount;
+    std::atomic<unsigned int> droppedEventCount;
+
+    // Releases which did not fit into eventQueue, one bit per hotkey id
+    //   below 256. Releases are never dropped, or held actions never stop.
+    std::atomic<uint64_t> overflowReleases[4];
+
+    // From hookProc to keyPressed emission.
+    HookLatency deliveryLatency;
+
+    // Keys currently down, to tell auto-repeat. Hook thread only.
+    std::bitset<256> keysDown;
+
+    // Hotkey id pressed by each key, -1 if none. Hook thread only.
+    int pressedIds[256];
+
+    // GUI thread only.
+    QHash<int, HotkeyRepeatPolicy> repeatPolicies;
+
+    KeyboardHook()
+        : hHook(nullptr), hotkeyTable(std::make_shared<HotkeyTable>()), paused(false),
+          latencyBudgetMs(300), hookEventCount(0), rawEventCount(0),
+          wakeupPending(false), queuedEventCount(0), wakeupCount(0), droppedEventCount(0)
     {
+        std::fill(std::begin(pressedIds), std::end(pressedIds), -1);
+        for (std::atomic<uint64_t> &bits : overflowReleases)
+        {
+            bits.store(0);
+        }
+
         start();
     }
 
+    bool installHook();
+
+    // Forget held keys, and release their hotkeys. Key ups may have been
+    //   missed while the hook was gone. Hook thread only.
+    void resetKeyState();
+    void createRawInputWindow();
+
+    // Called periodically on the hook thread.
+    void checkHookHealth();
+
+    // Queue event from hookProc.
+    void postEvent(const HotkeyEvent &event);
+
+    // Deliver queued events on the GUI thread.
+    void drainEvents();
+
     static LRESULT CALLBACK hookProc(int nCode, WPARAM wParam, LPARAM lParam);
+    static LRESULT CALLBACK rawInputWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 };
 
 #endif // KEYBOARD_HOOK_H
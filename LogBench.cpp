@@ -0,0 +1,241 @@
+#include "LogBench.h"
+#include "BenchReport.h"
+#include "mylog/mylog.h"
+
+#include <spdlog/async.h>
+
+#include <QRect>
+#include <QStringList>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iterator>
+#include <new>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+// As many loggers as the app has busy threads: GUI, hook, I/O and one more.
+#define LOG_BENCH_THREADS           4
+#define LOG_BENCH_MESSAGES          200000
+
+// Longest wait for the logging thread to catch up.
+#define LOG_BENCH_DRAIN_TIMEOUT_MS  60000
+
+#define LOG_FORMAT_BENCH_MESSAGES   1000000
+
+typedef std::chrono::steady_clock BenchClock;
+
+// Calls of operator new while counting.
+static std::atomic<bool> g_bCountAllocs{ false };
+static std::atomic<int64_t> g_allocCount{ 0 };
+
+void *operator new(std::size_t size)
+{
+    if (g_bCountAllocs.load(std::memory_order_relaxed)) {
+        g_allocCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+// The std::ostream operators the formatters replaced, for comparison.
+struct OstreamQString {
+    const QString &value;
+};
+
+struct OstreamQStringList {
+    const QStringList &value;
+};
+
+static std::ostream &operator<<(std::ostream &os, const OstreamQString &s)
+{
+    return os << s.value.toStdString();
+}
+
+static std::ostream &operator<<(std::ostream &os, const OstreamQStringList &list)
+{
+    return os << "[" << list.value.join(", ").toStdString() << "]";
+}
+
+static double ToMs(BenchClock::duration duration)
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// Latency of each call, in ns.
+static std::vector<int64_t> LogMessages(int thread)
+{
+    std::vector<int64_t> latencies(LOG_BENCH_MESSAGES);
+    QString profile = QString("Bench profile %1").arg(thread);
+    QRect geometry(0, 0, 1920, 1080);
+
+    for (int i = 0; i != LOG_BENCH_MESSAGES; ++i) {
+        BenchClock::time_point start = BenchClock::now();
+        L_INFO("Bench message {} of thread {}, profile: {}, geometry: {}", i, thread, profile, geometry);
+        latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - start).count();
+    }
+
+    return latencies;
+}
+
+// Latency at fraction of sorted latencies, in us.
+static double Percentile(const std::vector<int64_t> &sorted, double fraction)
+{
+    size_t index = std::min(sorted.size() - 1, size_t(fraction * sorted.size()));
+    return sorted[index] / 1e3;
+}
+
+bool RunLogBench(QString policyName)
+{
+    // Only the file is measured.
+    LogConfig config;
+    for (int &level : config.moduleLevels) {
+        level = spdlog::level::info;
+    }
+    config.bConsole = false;
+    ApplyLogConfig(config);
+
+    std::shared_ptr<spdlog::details::thread_pool> pool = spdlog::thread_pool();
+    if (!pool) {
+        L_ERROR("Log benchmark needs the async log");
+        return false;
+    }
+    pool->reset_overrun_counter();
+
+    std::vector<std::vector<int64_t>> latencies(LOG_BENCH_THREADS);
+    std::vector<std::thread> threads;
+
+    BenchClock::time_point start = BenchClock::now();
+    for (int t = 0; t != LOG_BENCH_THREADS; ++t) {
+        threads.emplace_back([t, &latencies]() {
+            latencies[t] = LogMessages(t);
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    BenchClock::time_point logged = BenchClock::now();
+
+    // Messages still queued are written by the logging thread.
+    while (pool->queue_size() != 0) {
+        if (ToMs(BenchClock::now() - logged) > LOG_BENCH_DRAIN_TIMEOUT_MS) {
+            L_ERROR("Log benchmark queue not written: {}", pool->queue_size());
+            return false;
+        }
+        QThread::msleep(1);
+    }
+    BenchClock::time_point drained = BenchClock::now();
+    size_t dropped = pool->overrun_counter();
+
+    std::vector<int64_t> all;
+    all.reserve(size_t(LOG_BENCH_THREADS) * LOG_BENCH_MESSAGES);
+    for (const std::vector<int64_t> &threadLatencies : latencies) {
+        all.insert(all.end(), threadLatencies.begin(), threadLatencies.end());
+    }
+    std::sort(all.begin(), all.end());
+
+    double loggedMs = ToMs(logged - start);
+    ReportBenchResult(QString("log policy: %1, threads: %2, messages: %3, calls_per_s: %4, p50_us: %5, "
+                              "p99_us: %6, p999_us: %7, max_us: %8, log_ms: %9, drain_ms: %10, dropped: %11")
+        .arg(policyName).arg(LOG_BENCH_THREADS).arg(all.size()).arg(qint64(all.size() / (loggedMs / 1e3)))
+        .arg(Percentile(all, 0.5), 0, 'f', 2).arg(Percentile(all, 0.99), 0, 'f', 2)
+        .arg(Percentile(all, 0.999), 0, 'f', 2).arg(all.back() / 1e3, 0, 'f', 2)
+        .arg(loggedMs, 0, 'f', 2).arg(ToMs(drained - logged), 0, 'f', 2).arg(dropped));
+
+    return true;
+}
+
+struct FormatTiming {
+    double nsPerMessage = 0;
+    double allocsPerMessage = 0;
+};
+
+// Format each message into a fresh buffer, as spdlog does per call.
+template <typename FormatMessage>
+static FormatTiming TimeFormat(FormatMessage formatMessage)
+{
+    size_t totalSize = 0;
+
+    g_allocCount.store(0);
+    g_bCountAllocs.store(true);
+    BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i != LOG_FORMAT_BENCH_MESSAGES; ++i) {
+        fmt::memory_buffer buffer;
+        formatMessage(buffer, i);
+        totalSize += buffer.size();
+    }
+    BenchClock::duration elapsed = BenchClock::now() - start;
+    g_bCountAllocs.store(false);
+
+    // Keep the work from being optimized away.
+    if (totalSize == 0) {
+        L_WARN("Log format benchmark formatted nothing");
+    }
+
+    FormatTiming timing;
+    timing.nsPerMessage = std::chrono::duration<double, std::nano>(elapsed).count() / LOG_FORMAT_BENCH_MESSAGES;
+    timing.allocsPerMessage = double(g_allocCount.load()) / LOG_FORMAT_BENCH_MESSAGES;
+    return timing;
+}
+
+static void ReportFormatTiming(const char *name, const FormatTiming &formatter, const FormatTiming &ostream)
+{
+    ReportBenchResult(QString("log_format case: %1, messages: %2, fmt_ns: %3, fmt_allocs: %4, "
+                              "ostream_ns: %5, ostream_allocs: %6")
+        .arg(name).arg(LOG_FORMAT_BENCH_MESSAGES)
+        .arg(formatter.nsPerMessage, 0, 'f', 1).arg(formatter.allocsPerMessage, 0, 'f', 2)
+        .arg(ostream.nsPerMessage, 0, 'f', 1).arg(ostream.allocsPerMessage, 0, 'f', 2));
+}
+
+bool RunLogFormatBench()
+{
+    QString name = QString::fromUtf8("Reading \xE9\x98\x85\xE8\xAF\xBB profile");
+    QStringList names = { "Default", "Night", name };
+    QRect geometry(-1920, 0, 1920, 1080);
+
+    auto out = [](fmt::memory_buffer &buffer) { return std::back_inserter(buffer); };
+
+    ReportFormatTiming("qstring",
+        TimeFormat([&](fmt::memory_buffer &buffer, int i) {
+            fmt::format_to(out(buffer), "Profile {} selected: {}", i, name);
+        }),
+        TimeFormat([&](fmt::memory_buffer &buffer, int i) {
+            fmt::format_to(out(buffer), "Profile {} selected: {}", i, fmt::streamed(OstreamQString{ name }));
+        }));
+
+    ReportFormatTiming("qstringlist",
+        TimeFormat([&](fmt::memory_buffer &buffer, int i) {
+            fmt::format_to(out(buffer), "Profiles {}: {}", i, names);
+        }),
+        TimeFormat([&](fmt::memory_buffer &buffer, int i) {
+            fmt::format_to(out(buffer), "Profiles {}: {}", i, fmt::streamed(OstreamQStringList{ names }));
+        }));
+
+    // Before the formatters, rects were logged as four ints.
+    ReportFormatTiming("qrect",
+        TimeFormat([&](fmt::memory_buffer &buffer, int i) {
+            fmt::format_to(out(buffer), "Screen {} geometry: {}", i, geometry);
+        }),
+        TimeFormat([&](fmt::memory_buffer &buffer, int i) {
+            fmt::format_to(out(buffer), "Screen {} geometry: {}, {}, {}, {}", i,
+                           geometry.x(), geometry.y(), geometry.width(), geometry.height());
+        }));
+
+    return true;
+}
@@ -0,0 +1,20 @@
+#ifndef LOGBENCH_H
+#define LOGBENCH_H
+
+#include <QString>
+
+// Log from several threads as fast as they can, with the overflow policy
+//   given to InitLog(), and print throughput, latency of single calls, time
+//   to write the backlog, and messages dropped. Floods the log file, so the
+//   log must be in a scratch directory. Console output is turned off.
+//   policyName names the policy in the result line.
+bool RunLogBench(QString policyName);
+
+// Format QString, QStringList and QRect messages into a buffer as spdlog
+//   does, through the fmt formatters and through the std::ostream operators
+//   they replaced, and print time and operator new calls per message for
+//   both. Counting replaces the global operator new of the program; Qt's own
+//   buffers are allocated by malloc and not counted.
+bool RunLogFormatBench();
+
+#endif // LOGBENCH_H
@@ -2,9 +2,37 @@
 #include "./ui_MainWindow.h"
 
 #include "mylog/mylog.h"
+#include "FlightRecorder.h"
+#include "AnchorSettings.h"
+#include "ProfilePickerDialog.h"
+#include "ProfileRepository.h"
 #include "ShortcutDefine.h"
+#include "StartupTrace.h"
 #include "HotkeyHook/KeyboardHook.h"
 
+#include <QFileInfo>
+
+// Above this many profiles, the tray menu offers a searchable picker instead
+//   of one action per profile.
+#define TRAY_PROFILE_MENU_MAX 30
+
+// Steps of held adjusting hotkeys, per frame.
+#define LIVE_ADJUST_WIDTH_STEP 1
+#define LIVE_ADJUST_OPACITY_STEP 2
+
+// Longest hold of an adjusting hotkey, in case its release is lost.
+#define LIVE_ADJUST_MAX_HOLD_MS 10000
+
+// Delay after release before saving adjusted profile.
+#define LIVE_ADJUST_PERSIST_DELAY_MS 1000
+
+// Create settings dialog this long after start at the latest, in case the
+//   first overlay frame is late.
+#define SETTINGS_DIALOG_MAX_DELAY_MS 1000
+
+// Apply screen changes once screens are quiet for this long.
+#define SCREENS_SETTLE_DELAY_MS 500
+
 static OverlayScheme::Ptr GetNormalScheme()
 {
     OverlayScheme::Ptr pScheme = std::make_shared<OverlayScheme>();
@@ -41,17 +69,24 @@ MainWindow::MainWindow(QWidget *parent)
     //setWindowFlag(Qt::WindowTransparentForInput);
     setAttribute(Qt::WA_TranslucentBackground);
 
-    InitSettings();
-
+    // The overlay comes first. Settings dialog is built once the overlay has
+    //   drawn its first frame.
     InitOverlayWidget();
+    StartupTrace::Phase("overlay");
 
     InitTrayIcon();
+    StartupTrace::Phase("tray");
 
     InitHotkeys();
+    StartupTrace::Phase("hotkeys");
 
-    QTimer::singleShot(50, [this]() {
-        hide();
-        });
+    InitScreens();
+
+    connect(m_overlayWidget, &OverlayWidget::SigFirstFramePainted, this, [this]() {
+        StartupTrace::FirstFrame();
+        QTimer::singleShot(0, this, &MainWindow::GetSettingsDialog);
+    });
+    QTimer::singleShot(SETTINGS_DIALOG_MAX_DELAY_MS, this, &MainWindow::GetSettingsDialog);
 }
 
 MainWindow::~MainWindow()
@@ -62,14 +97,8 @@ MainWindow::~MainWindow()
 void MainWindow::resizeEvent(QResizeEvent *event)
 {
     QTimer::singleShot(0, [this]() {
-        // Make overlay widget the same size.
-        m_overlayWidget->resize(size());
-
-        // Get global pos.
-        QPoint globalStartPos = mapToGlobal(QPoint(0, 0));
-
-        //m_overlayWidget->move(0, 0);
-        m_overlayWidget->move(globalStartPos);
+        // Make overlay widget the same size, at the same global pos.
+        SetWindowGeometry(m_overlayWidget, QRect(mapToGlobal(QPoint(0, 0)), size()));
     });
 }
 
@@ -122,7 +151,18 @@ void MainWindow::InitTrayIcon()
 
     m_subMenuProfiles = new QMenu("Profiles", this);
     m_menuTray->addMenu(m_subMenuProfiles);
-
+    connect(m_subMenuProfiles, &QMenu::aboutToShow, this, &MainWindow::OnTrayProfilesAboutToShow);
+    m_groupProfiles = new QActionGroup(this);
+
+    ProfileRepository *profiles = ProfileRepository::Instance();
+    connect(profiles, &ProfileRepository::SigLoaded, this, &MainWindow::OnProfilesUpdate);
+    connect(profiles, &ProfileRepository::SigProfilesReset, this, &MainWindow::OnProfilesUpdate);
+    connect(profiles, &ProfileRepository::SigProfileAdded, this, &MainWindow::OnProfileAdded);
+    connect(profiles, &ProfileRepository::SigProfileRemoved, this, &MainWindow::OnProfileRemoved);
+    connect(profiles, &ProfileRepository::SigProfileChanged, this, &MainWindow::SchedulePrefetch);
+    connect(profiles, &ProfileRepository::SigProfileLoaded, this, &MainWindow::SchedulePrefetch);
+
+    m_menuTray->addAction("Dump flight recorder", this, &MainWindow::OnDumpFlightRecorder);
     m_menuTray->addAction("Exit", this, &MainWindow::OnExit);
 
     m_trayIcon->setContextMenu(m_menuTray);
@@ -132,15 +172,33 @@ void MainWindow::InitTrayIcon()
 
 void MainWindow::InitOverlayWidget()
 {
+    AnchorSettings *settings = AnchorSettings::Instance();
+
     m_overlayWidget = new OverlayWidget(this);
+
+    // Last shown state, until settings dialog has the current profile.
+    OverlayScheme::Ptr pScheme = settings->GetLastScheme();
+    m_overlayWidget->SetOverlayScheme(pScheme ? pScheme : GetNormalScheme());
+    m_overlayWidget->SetEnabled(settings->GetEnabled());
+    m_overlayWidget->SetInverted(settings->GetInverted());
+
+    if (QScreen *screen = QApplication::primaryScreen()) {
+        SetWindowGeometry(m_overlayWidget, screen->virtualGeometry());
+    }
     m_overlayWidget->show();
 
-    m_overlayWidget->SetOverlayScheme(GetNormalScheme());
+    // After the first scheme, so startup does not animate.
+    m_overlayWidget->SetTransitionDuration(AnchorSettings::Instance()->GetTransitionMs());
 }
 
-void MainWindow::InitSettings()
+SettingsDialog *MainWindow::GetSettingsDialog()
 {
-    Q_ASSERT(m_settingsDialog == nullptr);
+    if (m_settingsDialog) {
+        return m_settingsDialog;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
 
     // Create settings dialog.
     m_settingsDialog = new SettingsDialog(this);
@@ -152,38 +210,112 @@ void MainWindow::InitSettings()
         this, &MainWindow::OnOverlayInverted);
     connect(m_settingsDialog, &SettingsDialog::SigOverlaySchemeChanged,
         this, &MainWindow::OnOverlaySchemeChanged);
+    connect(m_settingsDialog, &SettingsDialog::SigOverlaySchemePreviewed,
+        this, &MainWindow::OnOverlaySchemePreviewed);
     connect(m_settingsDialog, &SettingsDialog::SigScreenChanged,
         this, &MainWindow::OnScreenChanged);
-    connect(m_settingsDialog, &SettingsDialog::SigProfilesUpdated,
-        this, &MainWindow::OnProfilesUpdate);
 
     connect(m_settingsDialog, &SettingsDialog::SigDialogHided,
         [this]() {
             hide();
         });
+
+    L_INFO("Settings dialog created in {} us", timer.nsecsElapsed() / 1000);
+
+    return m_settingsDialog;
 }
 
 void MainWindow::InitHotkeys()
 {
     connect(&KeyboardHook::getInstance(), &KeyboardHook::keyPressed,
             this, &MainWindow::OnHotkeyPressed);
+    connect(&KeyboardHook::getInstance(), &KeyboardHook::keyReleased,
+            this, &MainWindow::OnHotkeyReleased);
+
+    m_timerLiveAdjust.setInterval(1000 / 60);
+    connect(&m_timerLiveAdjust, &QTimer::timeout, this, &MainWindow::StepLiveAdjust);
+
+    m_timerPrefetch.setSingleShot(true);
+    m_timerPrefetch.setInterval(0);
+    connect(&m_timerPrefetch, &QTimer::timeout, this, &MainWindow::PrefetchAdjacentProfiles);
+
+    m_timerPersistLiveAdjust.setSingleShot(true);
+    m_timerPersistLiveAdjust.setInterval(LIVE_ADJUST_PERSIST_DELAY_MS);
+    connect(&m_timerPersistLiveAdjust, &QTimer::timeout, this, &MainWindow::OnPersistLiveAdjust);
+
+    AnchorSettings *settings = AnchorSettings::Instance();
+
+    KeyboardHook::getInstance().setLatencyBudgetMs(settings->GetHookLatencyBudgetMs());
 
     // Register hotkeys.
-    Hotkey hotkeyToggleOverlay("Ctrl+Shift+T");
-    Hotkey hotkeyToggleInverted("Ctrl+Shift+I");
+    for (const ShortcutAction &action : SHORTCUT_ACTIONS) {
+        Hotkey hotkey(settings->GetHotkey(action.key, action.defaultHotkey));
 
-    Hotkey hotkeyToggleHLine("Ctrl+Shift+H");
-    Hotkey hotkeyToggleVLine("Ctrl+Shift+V");
+        if (!KeyboardHook::getInstance().addHotkey(action.id, hotkey)) {
+            L_WARN("Hotkey {} of {} already used by another action. Ignored.",
+                hotkey.toStr(), action.key);
+        }
 
-    Hotkey hotkeyPreviousProfile("Ctrl+Shift+P");
-    Hotkey hotkyeNextProfile("Ctrl+Shift+N");
+        KeyboardHook::getInstance().setRepeatPolicy(action.id,
+            settings->GetHotkeyRepeatPolicy(action.key, action.repeatPolicy));
+    }
+}
 
-    KeyboardHook::getInstance().addHotkey(SC_ID_TOGGLE_OVERLAY, hotkeyToggleOverlay);
-    KeyboardHook::getInstance().addHotkey(SC_ID_TOGGLE_INVERTED, hotkeyToggleInverted);
-    KeyboardHook::getInstance().addHotkey(SC_ID_TOGGLE_HLINE, hotkeyToggleHLine);
-    KeyboardHook::getInstance().addHotkey(SC_ID_TOGGLE_VLINE, hotkeyToggleVLine);
-    KeyboardHook::getInstance().addHotkey(SC_ID_PREVIOUS_PROFILE, hotkeyPreviousProfile);
-    KeyboardHook::getInstance().addHotkey(SC_ID_NEXT_PROFILE, hotkyeNextProfile);
+void MainWindow::SetDialogEnabledUI(bool bEnabled)
+{
+    // Saved directly until the dialog exists, it reads settings when created.
+    if (m_settingsDialog) {
+        m_settingsDialog->SetOverlayEnabledUI(bEnabled);
+    } else {
+        AnchorSettings::Instance()->SetEnabled(bEnabled);
+    }
+}
+
+void MainWindow::SetDialogInvertedUI(bool bInverted)
+{
+    if (m_settingsDialog) {
+        m_settingsDialog->SetOverlayInvertedUI(bInverted);
+    } else {
+        AnchorSettings::Instance()->SetInverted(bInverted);
+    }
+}
+
+void MainWindow::InitScreens()
+{
+    m_timerScreens.setSingleShot(true);
+    m_timerScreens.setInterval(SCREENS_SETTLE_DELAY_MS);
+    connect(&m_timerScreens, &QTimer::timeout, this, &MainWindow::OnScreensSettled);
+
+    for (QScreen *screen : QGuiApplication::screens()) {
+        ConnectScreen(screen);
+    }
+
+    connect(qApp, &QGuiApplication::screenAdded, this, [this](QScreen *screen) {
+        L_INFO("Screen added: {} {}", screen->name(), screen->geometry());
+        ConnectScreen(screen);
+        ScheduleScreensUpdate();
+    });
+    connect(qApp, &QGuiApplication::screenRemoved, this, [this](QScreen *screen) {
+        L_INFO("Screen removed: {}", screen->name());
+        ScheduleScreensUpdate();
+    });
+    connect(qApp, &QGuiApplication::primaryScreenChanged,
+            this, &MainWindow::ScheduleScreensUpdate);
+}
+
+void MainWindow::ConnectScreen(QScreen *screen)
+{
+    // Connections go with the screen when it is removed.
+    connect(screen, &QScreen::geometryChanged, this, &MainWindow::ScheduleScreensUpdate);
+    connect(screen, &QScreen::logicalDotsPerInchChanged, this, [this]() {
+        m_bScreenDpiChanged = true;
+        ScheduleScreensUpdate();
+    });
+}
+
+void MainWindow::ScheduleScreensUpdate()
+{
+    m_timerScreens.start();
 }
 
 void MainWindow::SetActionEnabledUI(bool bEnabled)
@@ -211,70 +343,185 @@ void MainWindow::MoveToScreen(QScreen *screen)
     if (nullptr == screen) {
         L_ERROR("No screen detected!");
         qApp->exit(1);
+        return;
     }
 
     QRect rect = screen->geometry();
     if (bWholeScreens) {
         rect = screen->virtualGeometry();
     }
-    L_INFO("Screen: {}, {}, {}, {}", rect.x(), rect.y(), rect.width(), rect.height());
+    L_INFO("Screen: {}", rect);
 
-    // Resize window to fit screen.
-    move(rect.x(), rect.y());
-    resize(rect.width(), rect.height());
+    // Resize windows to fit screen. The main window is hidden unless
+    //   settings are shown, and a hidden window does not pass its size on,
+    //   so the overlay is set directly.
+    SetWindowGeometry(this, rect);
+    SetWindowGeometry(m_overlayWidget, rect);
+}
 
-    show();
+void MainWindow::SetWindowGeometry(QWidget *widget, QRect rect)
+{
+    // The windows span all screens, and resizing reallocates their large
+    //   backing stores. Moving does not, so change only what differs.
+    if (widget->pos() != rect.topLeft()) {
+        widget->move(rect.topLeft());
+    }
+    if (widget->size() != rect.size()) {
+        widget->resize(rect.size());
+    }
 }
 
 void MainWindow::UpdateTrayProfileActive(QString profileName)
 {
     L_TRACE("Active profile name: {}", profileName);
 
-    for (auto actionProfile : m_actionProfiles) {
-        actionProfile->blockSignals(true);
+    // Current profile is shown as text above TRAY_PROFILE_MENU_MAX.
+    if (m_actionCurrentProfile) {
+        m_actionCurrentProfile->setText(profileName);
+    }
 
-        if (actionProfile->text() == profileName) {
-            actionProfile->setChecked(true);
-        } else {
-            actionProfile->setChecked(false);
-        }
+    if (m_bTrayProfilesDirty) {
+        return;
+    }
 
-        actionProfile->blockSignals(false);
+    // Checking one action of the exclusive group unchecks the other.
+    //   setChecked() does not trigger the action.
+    ProfileRepository *profiles = ProfileRepository::Instance();
+    QAction *action = m_actionProfiles.value(profiles->IndexOf(profileName), nullptr);
+    if (action) {
+        action->setChecked(true);
+    } else if (QAction *checked = m_groupProfiles->checkedAction()) {
+        checked->setChecked(false);
     }
 }
 
+QAction *MainWindow::CreateTrayProfileAction(int id)
+{
+    QAction *action = new QAction(ProfileRepository::Instance()->GetName(id), m_subMenuProfiles);
+    action->setData(id);
+    action->setCheckable(true);
+    action->setActionGroup(m_groupProfiles);
+    connect(action, &QAction::triggered, this, &MainWindow::OnTrayProfileActionTriggered);
+
+    return action;
+}
+
+void MainWindow::SwitchProfile(QString profileName, bool bPrefetched)
+{
+    FlightRecorder::Record(FLIGHT_PROFILE_SWITCH, ProfileRepository::Instance()->GetId(profileName), bPrefetched);
+
+    UpdateTrayProfileActive(profileName);
+
+    // Update settings dialog.
+    GetSettingsDialog()->SetCurrentProfile(profileName);
+}
+
 void MainWindow::SwitchProfileRelatively(int offset)
 {
     L_TRACE("Switch profile relatively. Offset: {}", offset);
 
-    int index = GetCurrentActiveProfileIndex();
-    index += offset;
+    QElapsedTimer switchTimer;
+    switchTimer.start();
+
+    ProfileRepository *profiles = ProfileRepository::Instance();
+    QString currentProfile = AnchorSettings::Instance()->GetCurrentProfile();
+    QString profileName = profiles->GetRelativeName(currentProfile, offset);
+    if (profileName.isEmpty()) {
+        L_WARN("No profile to switch to.");
+        return;
+    }
 
-    if (index < 0) {
-        index += m_actionProfiles.size();
-    } else if (index >= m_actionProfiles.size()) {
-        index -= m_actionProfiles.size();
+    // Draw the prefetched state first. Everything else follows, and the
+    //   overlay skips the scheme it already has.
+    RenderState::Ptr state = m_prefetched.take(profileName);
+    bool bPrefetched = state && state->source == profiles->Get(profileName);
+    m_overlayWidget->TraceNextFrame(
+        QString("Switch to %1, prefetched: %2").arg(profileName).arg(bPrefetched), switchTimer);
+    if (bPrefetched) {
+        m_overlayWidget->SetRenderState(state);
+        m_overlayWidget->repaint();
     }
 
-    if (index < 0 || index >= m_actionProfiles.size()) {
-        L_ERROR("Invalid index: {}", index);
+    SwitchProfile(profileName, bPrefetched);
+}
+
+void MainWindow::SchedulePrefetch()
+{
+    m_timerPrefetch.start();
+}
+
+void MainWindow::PrefetchAdjacentProfiles()
+{
+    ProfileRepository *profiles = ProfileRepository::Instance();
+    QString currentProfile = AnchorSettings::Instance()->GetCurrentProfile();
+
+    QHash<QString, RenderState::Ptr> prefetched;
+    for (int offset : { -1, 1 }) {
+        QString profileName = profiles->GetRelativeName(currentProfile, offset);
+        if (profileName.isEmpty() || profileName == currentProfile || prefetched.contains(profileName)) {
+            continue;
+        }
+
+        // Prefetched again once decoded, on SigProfileLoaded().
+        OverlayScheme::Ptr scheme = profiles->Get(profileName);
+        if (!scheme) {
+            continue;
+        }
+
+        // Reuse if the profile is not changed since.
+        RenderState::Ptr state = m_prefetched.value(profileName);
+        if (!state || state->source != scheme) {
+            state = RenderState::Build(scheme);
+        }
+        prefetched.insert(profileName, state);
+    }
+
+    m_prefetched.swap(prefetched);
+}
+
+void MainWindow::SwitchProfileToSlot(int slot)
+{
+    L_TRACE("Switch profile to slot: {}", slot);
+
+    ProfileRepository *profiles = ProfileRepository::Instance();
+    if (slot < 0 || slot >= profiles->Count()) {
+        L_WARN("No profile at slot {}. Profile count: {}", slot + 1, profiles->Count());
         return;
     }
 
-    m_actionProfiles[index]->trigger();
+    SwitchProfile(profiles->NameAt(slot));
 }
 
-int MainWindow::GetCurrentActiveProfileIndex()
+void MainWindow::StepLiveAdjust()
 {
-    int index = -1;
-    for (int i = 0; i != m_actionProfiles.size(); ++i) {
-        if (m_actionProfiles[i]->isChecked()) {
-            index = i;
-            break;
-        }
+    // A release may be lost, e.g. on the secure desktop or while the hook is
+    //   reinstalled. Stop once the key is up, or after a long hold.
+    unsigned int vkCode = KeyboardHook::getInstance().getHotkeys().value(m_liveAdjustId).getVkCode();
+    bool bKeyDown = vkCode != 0 && (GetAsyncKeyState(int(vkCode)) & 0x8000) != 0;
+    if (m_liveAdjustClock.isValid()
+        && (!bKeyDown || m_liveAdjustClock.elapsed() > LIVE_ADJUST_MAX_HOLD_MS)) {
+        L_WARN("Live adjust {} stopped without release", m_liveAdjustId);
+        StopLiveAdjust();
+        return;
     }
 
-    return index;
+    switch (m_liveAdjustId) {
+    case SC_ID_WIDTH_INCREASE:
+        m_overlayWidget->AdjustLineWidth(LIVE_ADJUST_WIDTH_STEP);
+        break;
+    case SC_ID_WIDTH_DECREASE:
+        m_overlayWidget->AdjustLineWidth(-LIVE_ADJUST_WIDTH_STEP);
+        break;
+    case SC_ID_OPACITY_INCREASE:
+        m_overlayWidget->AdjustOpacity(LIVE_ADJUST_OPACITY_STEP);
+        break;
+    case SC_ID_OPACITY_DECREASE:
+        m_overlayWidget->AdjustOpacity(-LIVE_ADJUST_OPACITY_STEP);
+        break;
+    default:
+        m_timerLiveAdjust.stop();
+        break;
+    }
 }
 
 void MainWindow::OnHotkeyPressed(int id)
@@ -296,6 +543,52 @@ void MainWindow::OnHotkeyPressed(int id)
         SwitchProfileRelatively(-1);
     } else if (id == SC_ID_NEXT_PROFILE) {
         SwitchProfileRelatively(1);
+    } else if (id >= SC_ID_PROFILE_SLOT_FIRST && id <= SC_ID_PROFILE_SLOT_LAST) {
+        SwitchProfileToSlot(id - SC_ID_PROFILE_SLOT_FIRST);
+    } else if (id >= SC_ID_WIDTH_INCREASE && id <= SC_ID_OPACITY_DECREASE) {
+        m_timerPersistLiveAdjust.stop();
+
+        // The adjusted overlay is saved, which must not take unsaved edits
+        //   of the dialog along.
+        if (m_settingsDialog) {
+            m_settingsDialog->RevertPreview();
+        }
+
+        // The first step is taken at once, the key is known to be down.
+        m_liveAdjustId = id;
+        m_liveAdjustClock.invalidate();
+        StepLiveAdjust();
+        m_liveAdjustClock.start();
+        m_timerLiveAdjust.start();
+    }
+}
+
+void MainWindow::OnHotkeyReleased(int id)
+{
+    if (id != m_liveAdjustId) {
+        return;
+    }
+
+    L_TRACE("Live adjust released: {}", id);
+
+    StopLiveAdjust();
+}
+
+void MainWindow::StopLiveAdjust()
+{
+    m_liveAdjustId = -1;
+    m_liveAdjustClock.invalidate();
+    m_timerLiveAdjust.stop();
+    m_timerPersistLiveAdjust.start();
+}
+
+void MainWindow::OnPersistLiveAdjust()
+{
+    OverlayScheme::Ptr saved = GetSettingsDialog()->SaveAdjustedProfile(m_overlayWidget->GetOverlayScheme());
+
+    // Next start draws the adjusted lines from the first frame.
+    if (saved) {
+        AnchorSettings::Instance()->SetLastScheme(*saved);
     }
 }
 
@@ -350,11 +643,11 @@ void MainWindow::OnOverlayEnabled(bool bEnabled)
     if (objSender == m_settingsDialog) {
         SetActionEnabledUI(bEnabled);
     } else if (objSender == m_actionEnable) {
-        m_settingsDialog->SetOverlayEnabledUI(bEnabled);
+        SetDialogEnabledUI(bEnabled);
     } else {
         // Triggered by hotkey.
         SetActionEnabledUI(bEnabled);
-        m_settingsDialog->SetOverlayEnabledUI(bEnabled);
+        SetDialogEnabledUI(bEnabled);
     }
 }
 
@@ -368,11 +661,11 @@ void MainWindow::OnOverlayInverted(bool bInverted)
     if (objSender == m_settingsDialog) {
         SetActionInvertedUI(bInverted);
     } else if (objSender == m_actionInverted) {
-        m_settingsDialog->SetOverlayInvertedUI(bInverted);
+        SetDialogInvertedUI(bInverted);
     } else {
         // Triggered by hotkey.
         SetActionInvertedUI(bInverted);
-        m_settingsDialog->SetOverlayInvertedUI(bInverted);
+        SetDialogInvertedUI(bInverted);
     }
 }
 
@@ -381,9 +674,13 @@ void MainWindow::OnOverlaySchemeChanged(OverlayScheme::Ptr pOverlayScheme)
     L_TRACE("MainWindow::OnOverlaySchemeChanged: {}", pOverlayScheme->schemeName);
 
     m_overlayWidget->SetOverlayScheme(pOverlayScheme);
+    AnchorSettings::Instance()->SetLastScheme(*pOverlayScheme);
 
     UpdateTrayProfileActive(pOverlayScheme->schemeName);
 
+    // Neighbours changed.
+    SchedulePrefetch();
+
     // Update hline/vline toggle state.
     // Since this is the only point to receive scheme changes from settings dialog
     //   (and from system tray -> setting dialog -> here), it's sufficient to
@@ -391,6 +688,17 @@ void MainWindow::OnOverlaySchemeChanged(OverlayScheme::Ptr pOverlayScheme)
     OnUpdateLinesToggleState(pOverlayScheme->bEnableHLine, pOverlayScheme->bEnableVLine);
 }
 
+void MainWindow::OnOverlaySchemePreviewed(OverlayScheme::Ptr pOverlayScheme)
+{
+    L_TRACE("MainWindow::OnOverlaySchemePreviewed: {}", pOverlayScheme->schemeName);
+
+    // Same profile, tray and prefetched neighbours stay valid. Each edit is
+    //   shown as it is made, a transition would lag behind.
+    m_overlayWidget->SetOverlayScheme(pOverlayScheme, false);
+
+    OnUpdateLinesToggleState(pOverlayScheme->bEnableHLine, pOverlayScheme->bEnableVLine);
+}
+
 void MainWindow::OnScreenChanged(int screenIndex)
 {
     L_INFO("Screen changed. index: {}", screenIndex);
@@ -408,24 +716,148 @@ void MainWindow::OnScreenChanged(int screenIndex)
     MoveToScreen(screens[screenIndex]);
 }
 
-void MainWindow::OnProfilesUpdate(QVector<OverlayScheme::Ptr> profiles)
+void MainWindow::OnScreensSettled()
 {
-    // Update profiles in system tray.
-    for (auto action : m_actionProfiles) {
-        m_subMenuProfiles->removeAction(action);
-        delete action;
+    QScreen *screen = QApplication::primaryScreen();
+    if (nullptr == screen) {
+        // All screens gone, e.g. while undocking. Wait for one to be added.
+        L_WARN("No screen after screen change");
+        return;
+    }
+
+    L_INFO("Screens settled. count: {}", QGuiApplication::screens().size());
+    MoveToScreen(nullptr);
+
+    // Screens added or removed since the dialog was built.
+    if (m_settingsDialog) {
+        m_settingsDialog->RefreshScreenList();
+    }
+
+    // Same size at another scale still needs a repaint.
+    if (m_bScreenDpiChanged) {
+        m_bScreenDpiChanged = false;
+        m_overlayWidget->update();
+    }
+}
+
+void MainWindow::OnProfilesUpdate()
+{
+    // All profiles replaced.
+    m_bTrayProfilesDirty = true;
+
+    SchedulePrefetch();
+}
+
+void MainWindow::OnProfileAdded(int id, int index)
+{
+    SchedulePrefetch();
+
+    if (m_bTrayProfilesDirty) {
+        return;
+    }
+
+    // Switching between list and chooser is rare, rebuild then.
+    ProfileRepository *profiles = ProfileRepository::Instance();
+    if ((profiles->Count() > TRAY_PROFILE_MENU_MAX) != (m_actionChooseProfile != nullptr)) {
+        m_bTrayProfilesDirty = true;
+        return;
+    }
+
+    if (m_actionChooseProfile) {
+        m_actionChooseProfile->setText(QString("Choose from %1 profiles...").arg(profiles->Count()));
+        return;
     }
+
+    QAction *action = CreateTrayProfileAction(id);
+    m_subMenuProfiles->insertAction(m_actionProfiles.value(index, nullptr), action);
+    m_actionProfiles.insert(index, action);
+
+    if (action->text() == AnchorSettings::Instance()->GetCurrentProfile()) {
+        action->setChecked(true);
+    }
+}
+
+void MainWindow::OnProfileRemoved(int id, int index)
+{
+    SchedulePrefetch();
+
+    if (m_bTrayProfilesDirty) {
+        return;
+    }
+
+    ProfileRepository *profiles = ProfileRepository::Instance();
+    if ((profiles->Count() > TRAY_PROFILE_MENU_MAX) != (m_actionChooseProfile != nullptr)) {
+        m_bTrayProfilesDirty = true;
+        return;
+    }
+
+    if (m_actionChooseProfile) {
+        m_actionChooseProfile->setText(QString("Choose from %1 profiles...").arg(profiles->Count()));
+        return;
+    }
+
+    QAction *action = m_actionProfiles.value(index, nullptr);
+    if (!action || action->data().toInt() != id) {
+        L_WARN("Tray profile actions out of order, rebuild them.");
+        m_bTrayProfilesDirty = true;
+        return;
+    }
+
+    // Leaves menu and group.
+    m_actionProfiles.removeAt(index);
+    delete action;
+}
+
+void MainWindow::OnTrayProfilesAboutToShow()
+{
+    if (!m_bTrayProfilesDirty) {
+        return;
+    }
+    m_bTrayProfilesDirty = false;
+
+    ProfileRepository *profiles = ProfileRepository::Instance();
+
+    // Update profiles in system tray.
+    m_subMenuProfiles->clear();
     m_actionProfiles.clear();
+    m_actionCurrentProfile = nullptr;
+    m_actionChooseProfile = nullptr;
+
+    if (profiles->Count() > TRAY_PROFILE_MENU_MAX) {
+        QString currentProfile = AnchorSettings::Instance()->GetCurrentProfile();
+        m_actionCurrentProfile = m_subMenuProfiles->addAction(currentProfile);
+        m_actionCurrentProfile->setEnabled(false);
+
+        m_actionChooseProfile = m_subMenuProfiles->addAction(
+            QString("Choose from %1 profiles...").arg(profiles->Count()),
+            this, &MainWindow::OnChooseProfile);
+        return;
+    }
 
     // Add.
-    for (auto scheme : profiles) {
-        QAction *action = new QAction(scheme->schemeName, this);
-        action->setCheckable(true);
-        action->setChecked(false);
-        connect(action, &QAction::triggered, this, &MainWindow::OnTrayProfileActionTriggered);
+    m_actionProfiles.reserve(profiles->Count());
+    for (int i = 0; i != profiles->Count(); ++i) {
+        QAction *action = CreateTrayProfileAction(profiles->GetId(profiles->NameAt(i)));
         m_subMenuProfiles->addAction(action);
         m_actionProfiles.push_back(action);
     }
+
+    UpdateTrayProfileActive(AnchorSettings::Instance()->GetCurrentProfile());
+}
+
+void MainWindow::OnChooseProfile()
+{
+    ProfilePickerDialog dialog;
+    dialog.SetCurrentProfile(AnchorSettings::Instance()->GetCurrentProfile());
+
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+
+    QString profileName = dialog.GetSelectedProfile();
+    if (!profileName.isEmpty()) {
+        SwitchProfile(profileName);
+    }
 }
 
 void MainWindow::OnTrayProfileActionTriggered()
@@ -433,20 +865,33 @@ void MainWindow::OnTrayProfileActionTriggered()
     QAction *action = dynamic_cast<QAction *>(sender());
     Q_ASSERT(action);
 
-    QString profileName = action->text();
+    QString profileName = ProfileRepository::Instance()->GetName(action->data().toInt());
+    if (profileName.isEmpty()) {
+        return;
+    }
+
     L_TRACE("Profile action triggered: {}", profileName);
 
-    UpdateTrayProfileActive(profileName);
+    SwitchProfile(profileName);
+}
 
-    // Update settings dialog.
-    m_settingsDialog->SetCurrentProfile(profileName);
+void MainWindow::OnDumpFlightRecorder()
+{
+    QString filePath = FlightRecorder::Dump("manual");
+    if (filePath.isEmpty()) {
+        m_trayIcon->showMessage("Flight recorder", "Failed to write dump.", QSystemTrayIcon::Warning);
+        return;
+    }
+
+    m_trayIcon->showMessage("Flight recorder", QString("Dumped to %1").arg(QFileInfo(filePath).absoluteFilePath()));
 }
 
 void MainWindow::OnShowSettings()
 {
-    m_settingsDialog->show();
-    m_settingsDialog->raise();
-    m_settingsDialog->activateWindow();
+    SettingsDialog *settingsDialog = GetSettingsDialog();
+    settingsDialog->show();
+    settingsDialog->raise();
+    settingsDialog->activateWindow();
 }
 
 void MainWindow::OnTrayIconActivated(QSystemTrayIcon::ActivationReason reason)
@@ -5,11 +5,15 @@
 #include "OverlayScheme.h"
 #include "SettingsDialog.h"
 
+#include <QActionGroup>
 #include <QApplication>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QMainWindow>
 #include <QMenu>
 #include <QScreen>
 #include <QSystemTrayIcon>
+#include <QTimer>
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -31,28 +35,59 @@ private:
 
     void InitOverlayWidget();
 
-    void InitSettings();
+    // Settings dialog, created on first use.
+    SettingsDialog *GetSettingsDialog();
 
     void InitHotkeys();
 
+    // Follow screens being added, removed, moved and rescaled.
+    void InitScreens();
+    void ConnectScreen(QScreen *screen);
+    void ScheduleScreensUpdate();
+
     // Update UI according to parameters. (No triggers)
     void SetActionEnabledUI(bool bEnabled);
     void SetActionInvertedUI(bool bEnabled);
+    void SetDialogEnabledUI(bool bEnabled);
+    void SetDialogInvertedUI(bool bInverted);
 
     // Move to specified screen, or to all screens if nullptr.
     void MoveToScreen(QScreen *screen = nullptr);
 
+    // Move and resize a top level widget, only where it differs from rect.
+    void SetWindowGeometry(QWidget *widget, QRect rect);
+
     // Update system tray menu profiles current active one.
     void UpdateTrayProfileActive(QString profileName);
 
+    QAction *CreateTrayProfileAction(int id);
+
+    // Make profile current, as chosen from tray menu. bPrefetched is only
+    //   recorded, for the flight recorder.
+    void SwitchProfile(QString profileName, bool bPrefetched = false);
+
     // Switch to profile relative to current profile in tray menu.
     void SwitchProfileRelatively(int offset);
 
-    // Get active profile index in m_actionProfiles.
-    int GetCurrentActiveProfileIndex();
+    // Build render states of the neighbours of current profile, when idle.
+    void SchedulePrefetch();
+    void PrefetchAdjacentProfiles();
+
+    // Switch to profile at slot (0-based position in tray menu).
+    void SwitchProfileToSlot(int slot);
+
+    // Apply one step of the held adjusting hotkey.
+    void StepLiveAdjust();
+
+    // Adjusting hotkey released, save the result later.
+    void StopLiveAdjust();
 
 private slots:
     void OnHotkeyPressed(int id);
+    void OnHotkeyReleased(int id);
+
+    // Save live adjusted scheme to current profile.
+    void OnPersistLiveAdjust();
     
     void OnExit() { qApp->quit(); }
 
@@ -75,11 +110,28 @@ private slots:
     void OnOverlayInverted(bool bInverted);
 
     void OnOverlaySchemeChanged(OverlayScheme::Ptr pOverlayScheme);
+
+    // Unsaved edits of current profile. Only the overlay shows them.
+    void OnOverlaySchemePreviewed(OverlayScheme::Ptr pOverlayScheme);
     void OnScreenChanged(int screenIndex);
 
-    void OnProfilesUpdate(QVector<OverlayScheme::Ptr> profiles);
+    // Tray profile actions are rebuilt when the menu is shown next, after
+    //   profiles are loaded. Single profiles added or removed only touch
+    //   their own action.
+    void OnProfilesUpdate();
+    void OnProfileAdded(int id, int index);
+    void OnProfileRemoved(int id, int index);
+    void OnTrayProfilesAboutToShow();
     void OnTrayProfileActionTriggered();
 
+    // Searchable picker, for when there are too many profiles for the menu.
+    void OnChooseProfile();
+
+    void OnDumpFlightRecorder();
+
+    // Screens have been quiet for a while after a change.
+    void OnScreensSettled();
+
 private:
     Ui::MainWindow *ui;
 
@@ -95,8 +147,31 @@ private:
     QAction *m_actionToggleHLine = nullptr;
     QAction *m_actionToggleVLine = nullptr;
 
-    // Sub menu of profiles.
+    // Sub menu of profiles. Actions are in ProfileRepository order, with
+    //   profile id as data, in one exclusive group. Empty if there are too
+    //   many profiles; then the current profile and a chooser are shown.
     QMenu *m_subMenuProfiles = nullptr;
+    QActionGroup *m_groupProfiles = nullptr;
     QVector<QAction *> m_actionProfiles;
+    QAction *m_actionCurrentProfile = nullptr;
+    QAction *m_actionChooseProfile = nullptr;
+    bool m_bTrayProfilesDirty = true;
+
+    // Held adjusting hotkey. Steps at display rate while held, and the
+    //   result is saved once after release.
+    int m_liveAdjustId = -1;
+    QElapsedTimer m_liveAdjustClock;
+    QTimer m_timerLiveAdjust;
+    QTimer m_timerPersistLiveAdjust;
+
+    // Render states of the profiles before and after the current one, so
+    //   switching by hotkey draws at once. Profile name -> state.
+    QHash<QString, RenderState::Ptr> m_prefetched;
+    QTimer m_timerPrefetch;
+
+    // Docking sends a burst of screen changes while the system settles,
+    //   they are applied once when it is over.
+    QTimer m_timerScreens;
+    bool m_bScreenDpiChanged = false;
 };
 #endif // MAINWINDOW_H
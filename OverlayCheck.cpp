@@ -0,0 +1,228 @@
+#define MYLOG_MODULE LogModule::Overlay
+
+#include "OverlayCheck.h"
+#include "BenchReport.h"
+#include "OverlayWidget.h"
+#include "mylog/mylog.h"
+
+#include <QComboBox>
+#include <QCursor>
+#include <QElapsedTimer>
+#include <QEvent>
+#include <QEventLoop>
+#include <QGuiApplication>
+#include <QImage>
+#include <QScreen>
+#include <QTimer>
+#include <QVector>
+#include <algorithm>
+
+#define FRAME_CHECK_WIDTH       1920
+#define FRAME_CHECK_HEIGHT      1080
+
+// Frames of each mode, after the warm up.
+#define FRAME_CHECK_FRAMES      600
+#define FRAME_CHECK_WARMUP      60
+
+// Trace may cost this much more than no trace, in percent of the median
+//   frame, plus a little for timer noise.
+#define FRAME_CHECK_MAX_OVERHEAD_PERCENT    5
+#define FRAME_CHECK_SLACK_US                20
+
+// A few refresh ticks of the overlay.
+#define FRAME_CHECK_SETTLE_MS   100
+
+// Notifications of a screen change burst, closer together than the settle
+//   delay of MainWindow.
+#define SCREEN_CHECK_NOTIFICATIONS  8
+#define SCREEN_CHECK_INTERVAL_MS    100
+
+// Longer than the settle delay of MainWindow.
+#define SCREEN_CHECK_SETTLE_MS      1000
+
+// Counts moves and resizes of a widget.
+class GeometryEventCounter : public QObject
+{
+public:
+    int moves = 0;
+    int resizes = 0;
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override
+    {
+        if (event->type() == QEvent::Move) {
+            ++moves;
+        } else if (event->type() == QEvent::Resize) {
+            ++resizes;
+        }
+        return QObject::eventFilter(watched, event);
+    }
+};
+
+static void RunEventsFor(int ms)
+{
+    QEventLoop loop;
+    QTimer::singleShot(ms, &loop, &QEventLoop::quit);
+    loop.exec();
+}
+
+struct FrameTimes {
+    double medianUs = 0;
+    double p99Us = 0;
+};
+
+static FrameTimes GetFrameTimes(QVector<qint64> framesNs)
+{
+    std::sort(framesNs.begin(), framesNs.end());
+
+    FrameTimes times;
+    times.medianUs = framesNs[framesNs.size() / 2] / 1e3;
+    times.p99Us = framesNs[framesNs.size() * 99 / 100] / 1e3;
+    return times;
+}
+
+// Paint time of one frame, in ns.
+static qint64 RenderFrame(OverlayWidget &overlay, QImage &image)
+{
+    image.fill(Qt::transparent);
+
+    QElapsedTimer timer;
+    timer.start();
+    overlay.render(&image);
+    return timer.nsecsElapsed();
+}
+
+// Paint times with trace level off and on, frames of both interleaved so
+//   they see the same machine load.
+static bool CheckMode(OverlayWidget &overlay, const char *mode)
+{
+    spdlog::logger *logger = GetModuleLogger(LogModule::Overlay);
+    QImage image(FRAME_CHECK_WIDTH, FRAME_CHECK_HEIGHT, QImage::Format_ARGB32_Premultiplied);
+
+    QVector<qint64> offNs;
+    QVector<qint64> onNs;
+    for (int i = 0; i != FRAME_CHECK_WARMUP + FRAME_CHECK_FRAMES; ++i) {
+        logger->set_level(spdlog::level::info);
+        qint64 off = RenderFrame(overlay, image);
+
+        logger->set_level(spdlog::level::trace);
+        qint64 on = RenderFrame(overlay, image);
+
+        if (i >= FRAME_CHECK_WARMUP) {
+            offNs.push_back(off);
+            onNs.push_back(on);
+        }
+    }
+    logger->set_level(spdlog::level::info);
+
+    FrameTimes off = GetFrameTimes(offNs);
+    FrameTimes on = GetFrameTimes(onNs);
+    ReportBenchResult(QString("overlay_frame mode: %1, frames: %2, off_median_us: %3, off_p99_us: %4, "
+                              "trace_median_us: %5, trace_p99_us: %6")
+        .arg(mode).arg(FRAME_CHECK_FRAMES)
+        .arg(off.medianUs, 0, 'f', 1).arg(off.p99Us, 0, 'f', 1)
+        .arg(on.medianUs, 0, 'f', 1).arg(on.p99Us, 0, 'f', 1));
+
+    double maxMedianUs = off.medianUs * (100 + FRAME_CHECK_MAX_OVERHEAD_PERCENT) / 100 + FRAME_CHECK_SLACK_US;
+    if (on.medianUs > maxMedianUs) {
+        L_ERROR("Trace slows {} frames: median {} us, without trace {} us", mode, on.medianUs, off.medianUs);
+        return false;
+    }
+
+    return true;
+}
+
+bool CheckOverlayFrameTime()
+{
+    // Trace goes to the file only, as it would in production.
+    LogConfig config;
+    config.bConsole = false;
+    ApplyLogConfig(config);
+
+    OverlayWidget overlay;
+    overlay.resize(FRAME_CHECK_WIDTH, FRAME_CHECK_HEIGHT);
+
+    // Lines through the middle, picked up by the next refresh tick.
+    QCursor::setPos(overlay.mapToGlobal(QPoint(FRAME_CHECK_WIDTH / 2, FRAME_CHECK_HEIGHT / 2)));
+    QEventLoop loop;
+    QTimer::singleShot(FRAME_CHECK_SETTLE_MS, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    bool bOk = CheckMode(overlay, "lines");
+
+    // Inverted mode fills the whole screen but the lines.
+    overlay.SetTransitionDuration(0);
+    overlay.SetInverted(true);
+    bOk = CheckMode(overlay, "inverted") && bOk;
+
+    return bOk;
+}
+
+bool CheckScreenChanges(QWidget *mainWindow)
+{
+    QScreen *screen = QGuiApplication::primaryScreen();
+    OverlayWidget *overlay = mainWindow->findChild<OverlayWidget *>();
+    if (!screen || !overlay) {
+        L_ERROR("Screen check needs a screen and the overlay");
+        return false;
+    }
+    QRect expected = screen->virtualGeometry();
+
+    // Let startup finish, the settings dialog is built after the first frame.
+    RunEventsFor(SCREEN_CHECK_SETTLE_MS);
+    QComboBox *comboScreens = mainWindow->findChild<QComboBox *>("comboScreens");
+    if (!comboScreens) {
+        L_ERROR("Screen check found no screen list");
+        return false;
+    }
+
+    // As a hot-plug leaves them: overlay of the old size, stale screen list.
+    QRect stale(expected.topLeft(), expected.size() / 2);
+    overlay->setGeometry(stale);
+    comboScreens->blockSignals(true);
+    comboScreens->clear();
+    comboScreens->blockSignals(false);
+    RunEventsFor(SCREEN_CHECK_INTERVAL_MS);
+
+    GeometryEventCounter counter;
+    overlay->installEventFilter(&counter);
+
+    bool bOk = true;
+    for (int i = 0; i != SCREEN_CHECK_NOTIFICATIONS; ++i) {
+        emit screen->geometryChanged(screen->geometry());
+        RunEventsFor(SCREEN_CHECK_INTERVAL_MS);
+
+        if (overlay->geometry() != stale) {
+            L_ERROR("Overlay changed before screens settled: {}, notification {}", overlay->geometry(), i);
+            bOk = false;
+            break;
+        }
+    }
+
+    RunEventsFor(SCREEN_CHECK_SETTLE_MS);
+    overlay->removeEventFilter(&counter);
+
+    if (overlay->geometry() != expected) {
+        L_ERROR("Overlay not on screens after they settled: {}, expected: {}", overlay->geometry(), expected);
+        bOk = false;
+    }
+
+    // Same top left, so no move.
+    if (counter.moves != 0 || counter.resizes != 1) {
+        L_ERROR("Overlay not changed once. moves: {}, resizes: {}", counter.moves, counter.resizes);
+        bOk = false;
+    }
+
+    if (comboScreens->count() != QGuiApplication::screens().size()) {
+        L_ERROR("Screen list not refreshed. items: {}, screens: {}",
+            comboScreens->count(), QGuiApplication::screens().size());
+        bOk = false;
+    }
+
+    ReportBenchResult(QString("screen_changes notifications: %1, geometry: %2, moves: %3, resizes: %4, ok: %5")
+        .arg(SCREEN_CHECK_NOTIFICATIONS)
+        .arg(QString("%1,%2 %3x%4").arg(overlay->x()).arg(overlay->y()).arg(overlay->width()).arg(overlay->height()))
+        .arg(counter.moves).arg(counter.resizes).arg(bOk ? "yes" : "no"));
+
+    return bOk;
+}
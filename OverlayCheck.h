@@ -0,0 +1,21 @@
+#ifndef OVERLAYCHECK_H
+#define OVERLAYCHECK_H
+
+// Check that trace logging on the overlay's paint path costs no measurable
+//   frame time: render full screen frames into an image, alternately with
+//   trace level on and off, and compare the median and p99 paint times.
+//   Print the times, log each failure, return true if none. Run with
+//   -platform offscreen to stay off screen.
+bool CheckOverlayFrameTime();
+
+class QWidget;
+
+// Check how mainWindow follows screen changes: a burst of screen change
+//   notifications must not move or resize the overlay until it has settled,
+//   then the overlay must cover all screens after one resize, and the screen
+//   list of the settings dialog must be filled again. Notifications are
+//   emitted by the check, screens stay as they are. Log each failure, return
+//   true if none. Run with -platform offscreen to stay off screen.
+bool CheckScreenChanges(QWidget *mainWindow);
+
+#endif // OVERLAYCHECK_H
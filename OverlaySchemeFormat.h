@@ -0,0 +1,22 @@
+#ifndef OVERLAYSCHEMEFORMAT_H
+#define OVERLAYSCHEMEFORMAT_H
+
+#include "OverlayScheme.h"
+#include "mylog/mylog.h"
+
+// Log formatter of OverlayScheme. Apart from OverlayScheme.h, which is used
+//   all over without logging.
+// name{h: on 25 #3300ff00, v: on 25 #3300ff00, bg: #3300ff00}
+template <>
+struct fmt::formatter<OverlayScheme> : NoSpecFormatter {
+    template <typename FormatContext>
+    auto format(const OverlayScheme &s, FormatContext &ctx) const -> decltype(ctx.out())
+    {
+        return fmt::format_to(ctx.out(), "{}{{h: {} {} {}, v: {} {} {}, bg: {}}}", s.schemeName,
+                              s.bEnableHLine ? "on" : "off", s.hLineWidth, s.hLineColor,
+                              s.bEnableVLine ? "on" : "off", s.vLineWidth, s.vLineColor,
+                              s.invertedBgColor);
+    }
+};
+
+#endif // OVERLAYSCHEMEFORMAT_H
@@ -1,12 +1,104 @@
+#define MYLOG_MODULE LogModule::Overlay
+
 #include "OverlayWidget.h"
 #include "ui_OverlayWidget.h"
 
 #include "mylog/mylog.h"
+#include "FlightRecorder.h"
 
 #include <QMouseEvent>
 #include <QPainter>
 #include <QStyleOption>
 #include <QTimer>
+#include <QtMath>
+#include <climits>
+
+// Refresh ticks later than this are latency spikes.
+#define REFRESH_SPIKE_MS 100
+
+// Longer gaps are the system sleeping, or the timer stopped, not spikes.
+#define REFRESH_SUSPEND_MS 5000
+
+// Frame interval of transitions.
+#define TRANSITION_FRAME_MS (1000 / 60)
+
+// Blend colors in premultiplied alpha, so a fading color does not darken.
+static QColor LerpColor(QColor from, QColor to, qreal t)
+{
+    qreal fromAlpha = from.alphaF();
+    qreal toAlpha = to.alphaF();
+    qreal alpha = fromAlpha + (toAlpha - fromAlpha) * t;
+    if (alpha <= 0) {
+        return QColor(0, 0, 0, 0);
+    }
+
+    auto lerpChannel = [&](qreal fromChannel, qreal toChannel) {
+        qreal premultiplied = fromChannel * fromAlpha + (toChannel * toAlpha - fromChannel * fromAlpha) * t;
+        return qBound(0.0, premultiplied / alpha, 1.0);
+    };
+
+    return QColor::fromRgbF(lerpChannel(from.redF(), to.redF()),
+                            lerpChannel(from.greenF(), to.greenF()),
+                            lerpChannel(from.blueF(), to.blueF()),
+                            alpha);
+}
+
+static int LerpWidth(int from, int to, qreal t)
+{
+    return qRound(from + (to - from) * t);
+}
+
+// A disabled line fades out at its own width.
+static void LerpLine(bool bFromEnabled, int fromWidth, QColor fromColor,
+                     bool bToEnabled, int toWidth, QColor toColor, qreal t,
+                     bool &bEnabled, int &width, QColor &color)
+{
+    if (!bFromEnabled) {
+        fromWidth = toWidth;
+        fromColor.setAlpha(0);
+    }
+    if (!bToEnabled) {
+        toWidth = fromWidth;
+        toColor.setAlpha(0);
+    }
+
+    bEnabled = bFromEnabled || bToEnabled;
+    width = LerpWidth(fromWidth, toWidth, t);
+    color = LerpColor(fromColor, toColor, t);
+}
+
+// Ease in and out.
+static qreal TransitionProgress(const QElapsedTimer &clock, int durationMs)
+{
+    if (!clock.isValid() || durationMs <= 0) {
+        return 1;
+    }
+
+    qreal t = qMin<qreal>(1, 1.0 * clock.elapsed() / durationMs);
+    return t * t * (3 - 2 * t);
+}
+
+RenderState::Ptr RenderState::Build(OverlayScheme::Ptr source)
+{
+    RenderState::Ptr state = std::make_shared<RenderState>();
+    state->source = source;
+    state->scheme = std::make_shared<OverlayScheme>(*source);
+    state->Update();
+
+    return state;
+}
+
+void RenderState::Update()
+{
+    hLinePen = QPen(scheme->hLineColor);
+    hLineBrush = QBrush(scheme->hLineColor);
+    vLinePen = QPen(scheme->vLineColor);
+    vLineBrush = QBrush(scheme->vLineColor);
+    invertedBgBrush = QBrush(scheme->invertedBgColor);
+
+    hLineWidth = scheme->hLineColor.alpha() == 0 ? 0 : scheme->hLineWidth;
+    vLineWidth = scheme->vLineColor.alpha() == 0 ? 0 : scheme->vLineWidth;
+}
 
 OverlayWidget::OverlayWidget(QWidget *parent) :
     QWidget(parent),
@@ -26,8 +118,13 @@ OverlayWidget::OverlayWidget(QWidget *parent) :
     m_timerRefresh.setSingleShot(false);
     m_timerRefresh.start(1000 / 60);
 
+    // Runs only during transitions.
+    connect(&m_timerTransition, &QTimer::timeout,
+        this, &OverlayWidget::OnTransitionFrame);
+    m_timerTransition.setInterval(TRANSITION_FRAME_MS);
+
     // Create a default overlay scheme.
-    m_scheme = std::make_shared<OverlayScheme>();
+    SetRenderState(RenderState::Build(std::make_shared<OverlayScheme>()));
 }
 
 OverlayWidget::~OverlayWidget()
@@ -51,15 +148,69 @@ void OverlayWidget::SetEnabled(bool bEnabled)
 
 void OverlayWidget::SetInverted(bool bInverted)
 {
+    if (m_bInverted == bInverted) {
+        return;
+    }
     m_bInverted = bInverted;
 
+    StartInvertedTransition();
+}
+
+void OverlayWidget::SetOverlayScheme(OverlayScheme::Ptr pOverlayScheme, bool bAnimate)
+{
+    // Already swapped in by SetRenderState().
+    if (m_state && m_state->source == pOverlayScheme) {
+        return;
+    }
+
+    SetRenderState(RenderState::Build(pOverlayScheme), bAnimate);
+}
+
+void OverlayWidget::SetRenderState(RenderState::Ptr state, bool bAnimate)
+{
+    // What is on screen now, where a transition starts from.
+    RenderState::Ptr shown = m_transitionState ? m_transitionState : m_state;
+
+    m_state = state;
+    m_scheme = m_state->scheme.get();
+
+    if (bAnimate && shown && m_transitionMs > 0 && isVisible() && m_bEnabled) {
+        m_transitionFrom = *shown->scheme;
+        StartSchemeTransition();
+    } else {
+        m_transitionState.reset();
+        update();
+    }
+}
+
+void OverlayWidget::TraceNextFrame(QString what, QElapsedTimer start)
+{
+    m_traceFrameWhat = what;
+    m_traceFrameStart = start;
+}
+
+void OverlayWidget::AdjustLineWidth(int delta)
+{
+    m_scheme->hLineWidth = qBound(SCHEME_MIN_LINE_WIDTH, m_scheme->hLineWidth + delta, SCHEME_MAX_LINE_WIDTH);
+    m_scheme->vLineWidth = qBound(SCHEME_MIN_LINE_WIDTH, m_scheme->vLineWidth + delta, SCHEME_MAX_LINE_WIDTH);
+    m_state->Update();
+
     update();
 }
 
-void OverlayWidget::SetOverlayScheme(OverlayScheme::Ptr pOverlayScheme)
+void OverlayWidget::AdjustOpacity(int delta)
 {
-    m_scheme = std::make_shared<OverlayScheme>(*pOverlayScheme);
-    //m_scheme = pOverlayScheme;
+    if (m_bInverted) {
+        QColor &color = m_scheme->invertedBgColor;
+        color.setAlpha(qBound(0, color.alpha() + delta, 255));
+    } else {
+        QColor &hColor = m_scheme->hLineColor;
+        hColor.setAlpha(qBound(0, hColor.alpha() + delta, 255));
+
+        QColor &vColor = m_scheme->vLineColor;
+        vColor.setAlpha(qBound(0, vColor.alpha() + delta, 255));
+    }
+    m_state->Update();
 
     update();
 }
@@ -78,50 +229,169 @@ void OverlayWidget::ToggleVLine()
     update();
 }
 
+void OverlayWidget::StartSchemeTransition()
+{
+    m_schemeClock.start();
+    if (!m_transitionState) {
+        m_transitionState = RenderState::Build(m_state->scheme);
+    }
+
+    m_timerTransition.start();
+    OnTransitionFrame();
+}
+
+void OverlayWidget::StartInvertedTransition()
+{
+    qreal target = m_bInverted ? 1 : 0;
+
+    if (m_transitionMs <= 0 || !isVisible() || !m_bEnabled) {
+        m_invertedLevel = target;
+        m_invertedClock.invalidate();
+        update();
+        return;
+    }
+
+    m_invertedFrom = m_invertedLevel;
+    m_invertedClock.start();
+
+    m_timerTransition.start();
+    OnTransitionFrame();
+}
+
+QRegion OverlayWidget::GetTransitionRegion() const
+{
+    if (m_invertedLevel > 0) {
+        return rect();
+    }
+
+    // Widest of both ends, and 1 pixel more for rounding.
+    int hWidth = qMax(m_transitionFrom.hLineWidth, m_scheme->hLineWidth) + 2;
+    int vWidth = qMax(m_transitionFrom.vLineWidth, m_scheme->vLineWidth) + 2;
+
+    QRegion region;
+    region += QRect(0, m_mousePos.y() - hWidth / 2, width(), hWidth);
+    region += QRect(m_mousePos.x() - vWidth / 2, 0, vWidth, height());
+
+    return region;
+}
+
+void OverlayWidget::OnTransitionFrame()
+{
+    bool bRunning = false;
+
+    if (m_transitionState) {
+        qreal t = TransitionProgress(m_schemeClock, m_transitionMs);
+
+        // m_state may be adjusted during transition, so blend every frame.
+        const OverlayScheme &from = m_transitionFrom;
+        const OverlayScheme &to = *m_scheme;
+        OverlayScheme &blended = *m_transitionState->scheme;
+
+        LerpLine(from.bEnableHLine, from.hLineWidth, from.hLineColor,
+                 to.bEnableHLine, to.hLineWidth, to.hLineColor, t,
+                 blended.bEnableHLine, blended.hLineWidth, blended.hLineColor);
+        LerpLine(from.bEnableVLine, from.vLineWidth, from.vLineColor,
+                 to.bEnableVLine, to.vLineWidth, to.vLineColor, t,
+                 blended.bEnableVLine, blended.vLineWidth, blended.vLineColor);
+        blended.invertedBgColor = LerpColor(from.invertedBgColor, to.invertedBgColor, t);
+        m_transitionState->Update();
+
+        if (t >= 1) {
+            m_transitionState.reset();
+        } else {
+            bRunning = true;
+        }
+    }
+
+    bool bInvertedFrame = m_invertedClock.isValid();
+    if (bInvertedFrame) {
+        qreal target = m_bInverted ? 1 : 0;
+        qreal t = TransitionProgress(m_invertedClock, m_transitionMs);
+        m_invertedLevel = m_invertedFrom + (target - m_invertedFrom) * t;
+
+        if (t >= 1) {
+            m_invertedLevel = target;
+            m_invertedClock.invalidate();
+        } else {
+            bRunning = true;
+        }
+    }
+
+    // The last frame of a fade to normal has level 0, but must still clear
+    //   the background everywhere.
+    update(bInvertedFrame ? QRegion(rect()) : GetTransitionRegion());
+
+    if (!bRunning) {
+        m_timerTransition.stop();
+    }
+}
+
 void OverlayWidget::paintEvent(QPaintEvent *event)
 {
-    //L_TRACE("paintEvent. mouse pos: ({},{})", m_mousePos.x(), m_mousePos.y());
+    L_TRACE_LIMITED(4, "paintEvent. mouse pos: {}, rect: {}", m_mousePos, event->rect());
 
     QStyleOption opt;
     opt.init(this);
     QPainter painter(this);
     style()->drawPrimitive(QStyle::PE_Widget, &opt, &painter, this);
 
+    // A disabled overlay paints nothing more, but has shown its frame.
     if (!m_bEnabled) {
+        EmitFirstFramePainted();
         return;
     }
 
-    int w = width();
-    int h = height();
+    int64_t paintStartNs = FlightRecorder::NowNs();
+    FlightRecorder::Record(FLIGHT_PAINT_BEGIN, event->rect().width(), event->rect().height());
+
+    m_paintState = m_transitionState ? m_transitionState.get() : m_state.get();
+
+    // Cross-fade between normal and inverted mode.
+    if (m_invertedLevel < 1) {
+        painter.setOpacity(1 - m_invertedLevel);
+        DrawTwoLines(painter);
+    }
+    if (m_invertedLevel > 0) {
+        painter.setOpacity(m_invertedLevel);
+        DrawBgRectangles(painter);
+    }
+
+    FlightRecorder::Record(FLIGHT_PAINT_END, int32_t((FlightRecorder::NowNs() - paintStartNs) / 1000));
+
+    if (m_traceFrameStart.isValid()) {
+        L_DEBUG("{}: first frame after {} us", m_traceFrameWhat, m_traceFrameStart.nsecsElapsed() / 1000);
+        m_traceFrameStart.invalidate();
+    }
 
-    DrawTwoLines(painter);
-    DrawBgRectangles(painter);
+    EmitFirstFramePainted();
+}
+
+void OverlayWidget::EmitFirstFramePainted()
+{
+    if (!m_bFirstFramePainted) {
+        m_bFirstFramePainted = true;
+        emit SigFirstFramePainted();
+    }
 }
 
 void OverlayWidget::mouseMoveEvent(QMouseEvent *event)
 {
-    L_TRACE("mouseMoveEvent: ({}, {})", event->x(), event->y());
+    L_TRACE_LIMITED(4, "mouseMoveEvent: ({}, {})", event->x(), event->y());
 }
 
 void OverlayWidget::DrawTwoLines(QPainter &painter)
 {
-    if (m_bInverted) {
-        return;
-    }
-
     int w = width();
     int h = height();
 
-    if (m_scheme->bEnableHLine && m_scheme->hLineColor.alpha() != 0) {
-        QColor color = m_scheme->hLineColor;
-        QBrush brush(color);
-        painter.setPen(color);
-        painter.setBrush(brush);
+    if (m_paintState->scheme->bEnableHLine && m_paintState->scheme->hLineColor.alpha() != 0) {
+        painter.setPen(m_paintState->hLinePen);
+        painter.setBrush(m_paintState->hLineBrush);
 
-        if (m_scheme->hLineWidth == 1) {
+        if (m_paintState->scheme->hLineWidth == 1) {
             DrawHorizontalLine(painter);
         }
-        else if (m_scheme->hLineWidth > 1) {
+        else if (m_paintState->scheme->hLineWidth > 1) {
             DrawHorizontalRect(painter);
         }
         else {
@@ -129,16 +399,14 @@ void OverlayWidget::DrawTwoLines(QPainter &painter)
         }
     }
 
-    if (m_scheme->bEnableVLine && m_scheme->vLineColor.alpha() != 0) {
-        QColor color = m_scheme->vLineColor;
-        QBrush brush(color);
-        painter.setPen(color);
-        painter.setBrush(brush);
+    if (m_paintState->scheme->bEnableVLine && m_paintState->scheme->vLineColor.alpha() != 0) {
+        painter.setPen(m_paintState->vLinePen);
+        painter.setBrush(m_paintState->vLineBrush);
 
-        if (m_scheme->vLineWidth == 1) {
+        if (m_paintState->scheme->vLineWidth == 1) {
             DrawVerticalLine(painter);
         }
-        else if (m_scheme->vLineWidth > 1) {
+        else if (m_paintState->scheme->vLineWidth > 1) {
             DrawVerticalRect(painter);
         }
         else {
@@ -149,16 +417,11 @@ void OverlayWidget::DrawTwoLines(QPainter &painter)
 
 void OverlayWidget::DrawBgRectangles(QPainter &painter)
 {
-    if (!m_bInverted) {
-        return;
-    }
-
-    if (m_scheme->invertedBgColor.alpha() == 0) {
+    if (m_paintState->scheme->invertedBgColor.alpha() == 0) {
         return;
     }
 
-    QBrush brush(m_scheme->invertedBgColor);
-    painter.setBrush(brush);
+    painter.setBrush(m_paintState->invertedBgBrush);
 
     QPen oldPen = painter.pen();
     painter.setPen(Qt::NoPen);
@@ -166,13 +429,13 @@ void OverlayWidget::DrawBgRectangles(QPainter &painter)
     int w = width();
     int h = height();
 
-    int vLineWidth = m_scheme->vLineWidth;
-    int hLineWidth = m_scheme->hLineWidth;
+    int vLineWidth = m_paintState->scheme->vLineWidth;
+    int hLineWidth = m_paintState->scheme->hLineWidth;
 
-    if (!m_scheme->bEnableHLine) {
+    if (!m_paintState->scheme->bEnableHLine) {
         hLineWidth = 0;
     }
-    if (!m_scheme->bEnableVLine) {
+    if (!m_paintState->scheme->bEnableVLine) {
         vLineWidth = 0;
     }
 
@@ -216,10 +479,10 @@ void OverlayWidget::DrawBgRectangles(QPainter &painter)
 
 void OverlayWidget::DrawHorizontalLine(QPainter &painter)
 {
-    Q_ASSERT(m_scheme->hLineWidth == 1);
+    Q_ASSERT(m_paintState->scheme->hLineWidth == 1);
 
     int w = width();
-    int vLineWidth = GetVertialLineWidth();
+    int vLineWidth = m_paintState->vLineWidth;
 
     if (vLineWidth <= 1) {
         painter.drawLine(0, m_mousePos.y(), w, m_mousePos.y());
@@ -232,18 +495,18 @@ void OverlayWidget::DrawHorizontalLine(QPainter &painter)
 
 void OverlayWidget::DrawHorizontalRect(QPainter &painter)
 {
-    Q_ASSERT(m_scheme->hLineWidth > 1);
+    Q_ASSERT(m_paintState->scheme->hLineWidth > 1);
 
     int w = width();
-    int vLineWidth = GetVertialLineWidth();
+    int vLineWidth = m_paintState->vLineWidth;
 
     QPen oldPen = painter.pen();
     painter.setPen(Qt::NoPen);
 
     int startX = 0;
-    int startY = m_mousePos.y() - m_scheme->hLineWidth / 2;
+    int startY = m_mousePos.y() - m_paintState->scheme->hLineWidth / 2;
     int rectWidth = w;
-    int rectHeight = m_scheme->hLineWidth;
+    int rectHeight = m_paintState->scheme->hLineWidth;
     painter.drawRect(startX, startY, rectWidth, rectHeight);
 
     painter.setPen(oldPen);
@@ -251,12 +514,12 @@ void OverlayWidget::DrawHorizontalRect(QPainter &painter)
 
 void OverlayWidget::DrawVerticalLine(QPainter &painter)
 {
-    Q_ASSERT(m_scheme->vLineWidth == 1);
+    Q_ASSERT(m_paintState->scheme->vLineWidth == 1);
 
     int h = height();
-    int hLineWidth = GetHorizontalLineWidth();
+    int hLineWidth = m_paintState->hLineWidth;
 
-    if (hLineWidth <= 1 || !m_scheme->bEnableHLine) {
+    if (hLineWidth <= 1 || !m_paintState->scheme->bEnableHLine) {
         painter.drawLine(m_mousePos.x(), 0, m_mousePos.x(), h);
     } else {
         // Draw two line segments.
@@ -268,34 +531,34 @@ void OverlayWidget::DrawVerticalLine(QPainter &painter)
 
 void OverlayWidget::DrawVerticalRect(QPainter &painter)
 {
-    Q_ASSERT(m_scheme->vLineWidth > 1);
+    Q_ASSERT(m_paintState->scheme->vLineWidth > 1);
 
     int h = height();
-    int hLineWidth = GetHorizontalLineWidth();
+    int hLineWidth = m_paintState->hLineWidth;
 
     QPen oldPen = painter.pen();
     painter.setPen(Qt::NoPen);
 
-    if (hLineWidth <= 1 || !m_scheme->bEnableHLine) {
-        int startX = m_mousePos.x() - m_scheme->vLineWidth / 2;
+    if (hLineWidth <= 1 || !m_paintState->scheme->bEnableHLine) {
+        int startX = m_mousePos.x() - m_paintState->scheme->vLineWidth / 2;
         int startY = 0;
-        int rectWidth = m_scheme->vLineWidth;
+        int rectWidth = m_paintState->scheme->vLineWidth;
         int rectHeight = h;
         painter.drawRect(startX, startY, rectWidth, rectHeight);
     } else {
         // Draw two rectangles.
         int upperY = m_mousePos.y() - hLineWidth / 2;
         {
-            int startX = m_mousePos.x() - m_scheme->vLineWidth / 2;
+            int startX = m_mousePos.x() - m_paintState->scheme->vLineWidth / 2;
             int startY = 0;
-            int rectWidth = m_scheme->vLineWidth;
+            int rectWidth = m_paintState->scheme->vLineWidth;
             int rectHeight = upperY;
             painter.drawRect(startX, startY, rectWidth, rectHeight);
         }
         {
-            int startX = m_mousePos.x() - m_scheme->vLineWidth / 2;
+            int startX = m_mousePos.x() - m_paintState->scheme->vLineWidth / 2;
             int startY = upperY + hLineWidth;
-            int rectWidth = m_scheme->vLineWidth;
+            int rectWidth = m_paintState->scheme->vLineWidth;
             int rectHeight = h - startY;
             painter.drawRect(startX, startY, rectWidth, rectHeight);
         }
@@ -304,25 +567,26 @@ void OverlayWidget::DrawVerticalRect(QPainter &painter)
     painter.setPen(oldPen);
 }
 
-int OverlayWidget::GetHorizontalLineWidth()
-{
-    if (m_scheme->hLineColor.alpha() == 0)
-        return 0;
-    return m_scheme->hLineWidth;
-}
-
-int OverlayWidget::GetVertialLineWidth()
-{
-    if (m_scheme->vLineColor.alpha() == 0)
-        return 0;
-    return m_scheme->vLineWidth;
-}
-
 void OverlayWidget::OnTimerRefreshTimeout()
 {
+    int sinceLastTickMs = m_refreshClock.isValid()
+        ? int(qMin<qint64>(m_refreshClock.restart(), INT_MAX)) : 0;
+    if (!m_refreshClock.isValid()) {
+        m_refreshClock.start();
+    }
+
     // Get current mouse position.
     QPoint pos = QCursor::pos();
-    if (pos == m_mousePos) {
+    bool bMoved = pos != m_mousePos;
+    FlightRecorder::Record(FLIGHT_REFRESH_TICK, sinceLastTickMs, bMoved);
+    L_TRACE_SAMPLED(256, "Refresh tick. since last: {} ms, moved: {}", sinceLastTickMs, bMoved);
+
+    if (sinceLastTickMs > REFRESH_SPIKE_MS && sinceLastTickMs < REFRESH_SUSPEND_MS) {
+        FlightRecorder::Record(FLIGHT_LATENCY_SPIKE, sinceLastTickMs, FLIGHT_REFRESH_TICK);
+        FlightRecorder::DumpOnSpike("refresh");
+    }
+
+    if (!bMoved) {
         return;
     }
 
@@ -3,11 +3,38 @@
 
 #include "OverlayScheme.h"
 
+#include <QBrush>
+#include <QElapsedTimer>
 #include <QPainter>
+#include <QPen>
 #include <QPoint>
 #include <QTimer>
 #include <QWidget>
 
+// What paintEvent() needs, derived from a scheme once rather than per frame.
+//   Can be built ahead of time, so switching to it is a pointer swap.
+struct RenderState {
+    using Ptr = std::shared_ptr<RenderState>;
+
+    OverlayScheme::Ptr source;  // Scheme built from, not modified.
+    OverlayScheme::Ptr scheme;  // Own copy, adjusted live.
+
+    QPen hLinePen;
+    QBrush hLineBrush;
+    QPen vLinePen;
+    QBrush vLineBrush;
+    QBrush invertedBgBrush;
+
+    // Non-transparent line width. 0 if transparent.
+    int hLineWidth = 0;
+    int vLineWidth = 0;
+
+    static Ptr Build(OverlayScheme::Ptr source);
+
+    // Derive again after scheme is modified.
+    void Update();
+};
+
 namespace Ui {
 class OverlayWidget;
 }
@@ -26,15 +53,42 @@ public:
     // Enable/disable the functions.
     void SetEnabled(bool bEnabled);
 
-    // Set inverted or not.
+    // Set inverted or not. Cross-fades if transitions are enabled.
     void SetInverted(bool bInverted);
 
-    void SetOverlayScheme(OverlayScheme::Ptr pOverlayScheme);
+    // Duration of transitions between schemes, and between normal and
+    //   inverted mode. 0 to switch at once.
+    void SetTransitionDuration(int ms) { m_transitionMs = ms; }
+
+    // No-op if the scheme is the one drawn already. Switch at once without
+    //   a transition if bAnimate is false.
+    void SetOverlayScheme(OverlayScheme::Ptr pOverlayScheme, bool bAnimate = true);
+
+    // Draw a prebuilt state. It is owned by the widget from now on.
+    // A running transition continues from what is drawn at the moment,
+    //   unless bAnimate is false.
+    void SetRenderState(RenderState::Ptr state, bool bAnimate = true);
+
+    // Scheme being drawn, including live adjustments.
+    OverlayScheme::Ptr GetOverlayScheme() const { return m_state->scheme; }
+
+    // Log the time from start to the next painted frame.
+    void TraceNextFrame(QString what, QElapsedTimer start);
+
+    // Adjust the drawn scheme in place, not saved anywhere.
+    // Width applies to both lines. Opacity applies to the lines in normal
+    //   mode, and to the background in inverted mode.
+    void AdjustLineWidth(int delta);
+    void AdjustOpacity(int delta);
 
     // Toggle H/V line.
     void ToggleHLine();
     void ToggleVLine();
 
+signals:
+    // Once, after the first paint.
+    void SigFirstFramePainted();
+
 protected:
     void paintEvent(QPaintEvent *event) override;
     void mouseMoveEvent(QMouseEvent *event) override;
@@ -50,12 +104,22 @@ private:
     void DrawVerticalLine(QPainter &painter);
     void DrawVerticalRect(QPainter &painter);
 
-    // Return non-transparent line width. 0 if transparent.
-    int GetHorizontalLineWidth();
-    int GetVertialLineWidth();
+    // Start transition from what is drawn now, to m_state.
+    void StartSchemeTransition();
+
+    // Start cross-fade from current inverted level.
+    void StartInvertedTransition();
+
+    // Area covered by both lines of the transition, or whole widget if
+    //   inverted background is drawn.
+    QRegion GetTransitionRegion() const;
+
+    // Once, when the first paintEvent() has drawn everything.
+    void EmitFirstFramePainted();
 
 private slots:
     void OnTimerRefreshTimeout();
+    void OnTransitionFrame();
 
 private:
     Ui::OverlayWidget *ui;
@@ -66,7 +130,35 @@ private:
     QTimer m_timerRefresh;
     QPoint m_mousePos;
 
-    OverlayScheme::Ptr m_scheme;
+    RenderState::Ptr m_state;
+
+    // Scheme of m_state, for short.
+    OverlayScheme *m_scheme = nullptr;
+
+    // State drawn by current paintEvent(). m_state, or m_transitionState.
+    RenderState *m_paintState = nullptr;
+
+    int m_transitionMs = 0;
+    QTimer m_timerTransition;
+
+    // Scheme transition. m_transitionState is between m_transitionFrom and
+    //   m_state, and null when there is no transition.
+    QElapsedTimer m_schemeClock;
+    OverlayScheme m_transitionFrom;
+    RenderState::Ptr m_transitionState;
+
+    // 0 for normal mode, 1 for inverted, in between while cross-fading.
+    qreal m_invertedLevel = 0;
+    qreal m_invertedFrom = 0;
+    QElapsedTimer m_invertedClock;
+
+    // Since last refresh tick, for the flight recorder.
+    QElapsedTimer m_refreshClock;
+
+    QString m_traceFrameWhat;
+    QElapsedTimer m_traceFrameStart;
+
+    bool m_bFirstFramePainted = false;
 };
 
 #endif // OVERLAYWIDGET_H
@@ -0,0 +1,258 @@
+#define MYLOG_MODULE LogModule::Profiles
+
+#include "ProfileBench.h"
+#include "BenchReport.h"
+#include "ProfileBundle.h"
+#include "ProfileRepository.h"
+#include "ProfileStore.h"
+#include "mylog/mylog.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QTimer>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+#define PROFILE_STARTUP_BENCH_COUNT 10000
+#define BUNDLE_IMPORT_BENCH_COUNT   50000
+
+// Longest wait for the repository.
+#define PROFILE_BENCH_TIMEOUT_MS    60000
+
+// Profiles of distinct names and colors, as a team-shared set would be.
+static QVector<OverlayScheme::Ptr> MakeBenchProfiles(int count)
+{
+    QVector<OverlayScheme::Ptr> schemes;
+    schemes.reserve(count);
+
+    for (int i = 0; i != count; ++i) {
+        OverlayScheme::Ptr scheme = std::make_shared<OverlayScheme>();
+        scheme->schemeName = QString("Bench profile %1").arg(i, 6, 10, QChar('0'));
+        scheme->hLineWidth = SCHEME_MIN_LINE_WIDTH + i % SCHEME_MAX_LINE_WIDTH;
+        scheme->hLineColor = QColor::fromRgba(0x33000000u | (quint32(i * 2654435761u) >> 8));
+        scheme->vLineColor = QColor::fromRgba(0x33000000u | (quint32(i * 40503u) & 0xFFFFFF));
+        schemes.push_back(scheme);
+    }
+
+    return schemes;
+}
+
+// Write store of count profiles. Return false on failure.
+static bool WriteBenchStore(QString storePath, QString legacyDir, int count)
+{
+    QDir(legacyDir).mkpath(".");
+    QFile::remove(storePath);
+
+    ProfileStore store;
+    if (!store.Open(storePath, legacyDir) || !store.SaveAll(MakeBenchProfiles(count))) {
+        L_ERROR("Write benchmark store failed: {}", storePath);
+        return false;
+    }
+
+    return true;
+}
+
+// Resident memory of the process, 0 if unknown.
+static qint64 GetResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return qint64(counters.WorkingSetSize);
+#else
+    // Total and resident pages.
+    QFile file("/proc/self/statm");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    QList<QByteArray> fields = file.readAll().split(' ');
+    return fields.size() > 1 ? fields[1].toLongLong() * sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+// Run events until signal of sender is emitted, or timeout. Return false on
+//   timeout.
+template <typename Sender, typename Signal>
+static bool WaitForSignal(Sender *sender, Signal signal)
+{
+    QEventLoop loop;
+    QTimer timeout;
+    timeout.setSingleShot(true);
+    QObject::connect(&timeout, &QTimer::timeout, &loop, [&loop]() { loop.exit(1); });
+    QObject::connect(sender, signal, &loop, [&loop]() { loop.exit(0); });
+
+    timeout.start(PROFILE_BENCH_TIMEOUT_MS);
+    return loop.exec() == 0;
+}
+
+static double ElapsedMs(const QElapsedTimer &timer)
+{
+    return timer.nsecsElapsed() / 1e6;
+}
+
+bool RunProfileLoadBench(QString workDir)
+{
+    for (int count : { 10, 1000, 100000 }) {
+        QString dir = QDir(workDir).filePath(QString("load-%1").arg(count));
+        QString storePath = QDir(dir).filePath("bench.pack");
+        QString legacyDir = QDir(dir).filePath("legacy");
+        if (!WriteBenchStore(storePath, legacyDir, count)) {
+            return false;
+        }
+
+        // As at startup: open and index, then the headers for the lists.
+        ProfileStore store;
+        QElapsedTimer timer;
+        timer.start();
+        store.Open(storePath, legacyDir);
+        double openMs = ElapsedMs(timer);
+
+        timer.restart();
+        int headerCount = store.LoadHeaders().size();
+        double headersMs = ElapsedMs(timer);
+
+        // As an export does.
+        timer.restart();
+        int profileCount = store.LoadAll().size();
+        double loadAllMs = ElapsedMs(timer);
+
+        if (headerCount != count || profileCount != count) {
+            L_ERROR("Benchmark store read back wrong. written: {}, headers: {}, profiles: {}",
+                count, headerCount, profileCount);
+            return false;
+        }
+
+        ReportBenchResult(QString("profile_load profiles: %1, bytes: %2, open_ms: %3, headers_ms: %4, load_all_ms: %5")
+            .arg(count).arg(QFileInfo(storePath).size())
+            .arg(openMs, 0, 'f', 2).arg(headersMs, 0, 'f', 2).arg(loadAllMs, 0, 'f', 2));
+    }
+
+    return true;
+}
+
+bool RunProfileStartupBench(QString workDir)
+{
+    // Same layout as the working directory of the app.
+    int count = PROFILE_STARTUP_BENCH_COUNT;
+    if (!WriteBenchStore(QDir(workDir).filePath("profiles.pack"), QDir(workDir).filePath("profiles"), count)) {
+        return false;
+    }
+
+    qint64 residentBefore = GetResidentBytes();
+    QElapsedTimer timer;
+    timer.start();
+
+    ProfileRepository profiles(workDir, new ProfileStore);
+    if (!WaitForSignal(&profiles, &ProfileRepository::SigLoaded) || profiles.Count() != count) {
+        L_ERROR("Benchmark profiles not loaded. profiles: {}", profiles.Count());
+        return false;
+    }
+    double loadedMs = ElapsedMs(timer);
+    qint64 residentLoaded = GetResidentBytes();
+
+    // First use of a profile, decoded in background.
+    timer.restart();
+    QString name = profiles.NameAt(0);
+    if (!profiles.Get(name)
+            && (!WaitForSignal(&profiles, &ProfileRepository::SigProfileLoaded) || !profiles.Get(name))) {
+        L_ERROR("Benchmark profile not decoded: {}", name);
+        return false;
+    }
+    double firstProfileMs = ElapsedMs(timer);
+
+    ReportBenchResult(QString("profile_startup profiles: %1, loaded_ms: %2, first_profile_ms: %3, "
+                              "resident_kb: %4, loaded_resident_kb: %5")
+        .arg(count).arg(loadedMs, 0, 'f', 2).arg(firstProfileMs, 0, 'f', 2)
+        .arg(residentLoaded / 1024).arg((residentLoaded - residentBefore) / 1024));
+
+    return true;
+}
+
+bool RunBundleImportBench(QString workDir)
+{
+    int count = BUNDLE_IMPORT_BENCH_COUNT;
+    QString bundlePath = QDir(workDir).filePath("bench.mlfb");
+
+    QElapsedTimer timer;
+    timer.start();
+
+    BundleManifest manifest;
+    manifest.title = "Benchmark";
+    manifest.created = QDateTime::currentDateTimeUtc();
+    manifest.count = count;
+
+    BundleWriter writer;
+    bool bWritten = writer.Open(bundlePath, manifest);
+    for (const OverlayScheme::Ptr &scheme : MakeBenchProfiles(count)) {
+        bWritten = bWritten && writer.Write(*scheme);
+    }
+    if (!bWritten || !writer.Finish()) {
+        L_ERROR("Write benchmark bundle failed: {}", writer.GetError());
+        return false;
+    }
+    double writeBundleMs = ElapsedMs(timer);
+
+    std::unique_ptr<ProfileRepository> profiles(new ProfileRepository(workDir, new ProfileStore));
+    if (!WaitForSignal(profiles.get(), &ProfileRepository::SigLoaded)) {
+        L_ERROR("Benchmark profiles not loaded");
+        return false;
+    }
+
+    // What the list model and the tray menu are told.
+    int addedSignals = 0;
+    int resetSignals = 0;
+    QObject::connect(profiles.get(), &ProfileRepository::SigProfileAdded, [&addedSignals]() { ++addedSignals; });
+    QObject::connect(profiles.get(), &ProfileRepository::SigProfilesReset, [&resetSignals]() { ++resetSignals; });
+
+    BundleResult result;
+    double importMs = 0;
+    {
+        ProfileBundleJob job;
+        QObject::connect(&job, &ProfileBundleJob::SigFinished, [&result](BundleResult finished) {
+            result = finished;
+        });
+
+        timer.restart();
+        if (!job.StartImport(bundlePath, BundleConflictPolicy::Skip)
+                || !WaitForSignal(&job, &ProfileBundleJob::SigFinished)) {
+            L_ERROR("Benchmark bundle import not finished");
+            return false;
+        }
+        importMs = ElapsedMs(timer);
+    }
+
+    if (!result.bOk || result.added != count || profiles->Count() != count) {
+        L_ERROR("Benchmark bundle import failed: {}. added: {}, profiles: {}",
+            result.error, result.added, profiles->Count());
+        return false;
+    }
+
+    // Waits for the queued writes.
+    timer.restart();
+    profiles.reset();
+    double storeWrittenMs = ElapsedMs(timer);
+
+    ProfileStore store;
+    int storedCount = store.Open(QDir(workDir).filePath("profiles.pack"), QDir(workDir).filePath("profiles"))
+        ? store.LoadHeaders().size() : 0;
+    if (storedCount != count) {
+        L_ERROR("Benchmark store written wrong. imported: {}, stored: {}", count, storedCount);
+        return false;
+    }
+
+    ReportBenchResult(QString("bundle_import profiles: %1, bytes: %2, write_bundle_ms: %3, import_ms: %4, "
+                              "store_written_ms: %5, added_signals: %6, reset_signals: %7")
+        .arg(count).arg(QFileInfo(bundlePath).size()).arg(writeBundleMs, 0, 'f', 2)
+        .arg(importMs, 0, 'f', 2).arg(storeWrittenMs, 0, 'f', 2).arg(addedSignals).arg(resetSignals));
+
+    return true;
+}
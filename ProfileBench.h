@@ -0,0 +1,21 @@
+#ifndef PROFILEBENCH_H
+#define PROFILEBENCH_H
+
+#include <QString>
+
+// Time opening a profile store of 10, 1k and 100k profiles, reading the
+//   headers of all, and decoding all. Stores are written in workDir. Print
+//   one result line per size, return false if a store cannot be written.
+bool RunProfileLoadBench(QString workDir);
+
+// Time a profile repository of 10k profiles in workDir until it is loaded,
+//   and until the first profile is decoded, and print the resident memory it
+//   takes. Needs the application's event loop thread.
+bool RunProfileStartupBench(QString workDir);
+
+// Time importing a bundle of 50k profiles into an empty profile repository in
+//   workDir, until the views are told and until the store is written, and
+//   count the signals views get. Needs the application's event loop thread.
+bool RunBundleImportBench(QString workDir);
+
+#endif // PROFILEBENCH_H
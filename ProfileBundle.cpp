@@ -0,0 +1,502 @@
+#define MYLOG_MODULE LogModule::Profiles
+
+#include "ProfileBundle.h"
+#include "mylog/mylog.h"
+#include "ProfileRepository.h"
+#include "ProfileStore.h"
+#include "SchemeCodec.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtConcurrent>
+#include <QtEndian>
+
+#define BUNDLE_FILE_MAGIC       0x42464C4D  // "MLFB"
+#define BUNDLE_FORMAT_VERSION   1
+#define BUNDLE_HEADER_SIZE      16
+#define BUNDLE_TRAILER_SIZE     8
+
+// Far above any encoded scheme, to reject garbage early.
+#define BUNDLE_MAX_MANIFEST_SIZE    (64 * 1024)
+#define BUNDLE_MAX_RECORD_SIZE      (64 * 1024)
+
+// Records per batch handed to the GUI thread, and batches in flight.
+#define BUNDLE_IMPORT_BATCH     256
+#define BUNDLE_BATCHES_IN_FLIGHT 4
+
+bool BundleWriter::Open(QString filePath, const BundleManifest &manifest)
+{
+    m_count = 0;
+    m_crc = 0;
+    m_error.clear();
+
+    m_file.setFileName(filePath);
+    if (!m_file.open(QIODevice::WriteOnly)) {
+        m_error = m_file.errorString();
+        return false;
+    }
+
+    QJsonObject json;
+    json["title"] = manifest.title;
+    json["created"] = manifest.created.toString(Qt::ISODate);
+    json["count"] = qint64(manifest.count);
+    QByteArray manifestData = QJsonDocument(json).toJson(QJsonDocument::Compact);
+
+    uchar header[BUNDLE_HEADER_SIZE];
+    qToLittleEndian<quint32>(BUNDLE_FILE_MAGIC, header);
+    qToLittleEndian<quint16>(BUNDLE_FORMAT_VERSION, header + 4);
+    qToLittleEndian<quint16>(0, header + 6);
+    qToLittleEndian<quint32>(manifestData.size(), header + 8);
+    qToLittleEndian<quint32>(Crc32(manifestData.constData(), manifestData.size()), header + 12);
+
+    return WriteAll(QByteArray(reinterpret_cast<const char *>(header), BUNDLE_HEADER_SIZE))
+        && WriteAll(manifestData);
+}
+
+bool BundleWriter::Write(const OverlayScheme &scheme)
+{
+    QByteArray data = EncodeScheme(scheme);
+
+    uchar size[4];
+    qToLittleEndian<quint32>(data.size(), size);
+
+    m_crc = Crc32(size, sizeof(size), m_crc);
+    m_crc = Crc32(data.constData(), data.size(), m_crc);
+    ++m_count;
+
+    return WriteAll(QByteArray(reinterpret_cast<const char *>(size), sizeof(size)))
+        && WriteAll(data);
+}
+
+bool BundleWriter::Finish()
+{
+    uchar trailer[4 + BUNDLE_TRAILER_SIZE];
+    qToLittleEndian<quint32>(0, trailer);
+    qToLittleEndian<quint32>(m_count, trailer + 4);
+    qToLittleEndian<quint32>(m_crc, trailer + 8);
+
+    if (!WriteAll(QByteArray(reinterpret_cast<const char *>(trailer), sizeof(trailer)))) {
+        return false;
+    }
+
+    if (!m_file.commit()) {
+        m_error = m_file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+bool BundleWriter::WriteAll(const QByteArray &data)
+{
+    if (m_file.write(data) != data.size()) {
+        m_error = m_file.errorString();
+        m_file.cancelWriting();
+        return false;
+    }
+
+    return true;
+}
+
+bool BundleReader::Open(QString filePath)
+{
+    m_error.clear();
+
+    m_file.setFileName(filePath);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        m_error = m_file.errorString();
+        return false;
+    }
+
+    QByteArray header = m_file.read(BUNDLE_HEADER_SIZE);
+    if (header.size() != BUNDLE_HEADER_SIZE) {
+        m_error = "File too short";
+        return false;
+    }
+
+    const uchar *p = reinterpret_cast<const uchar *>(header.constData());
+    if (qFromLittleEndian<quint32>(p) != BUNDLE_FILE_MAGIC) {
+        m_error = "Not a profile bundle";
+        return false;
+    }
+    if (qFromLittleEndian<quint16>(p + 4) > BUNDLE_FORMAT_VERSION) {
+        m_error = QString("Unsupported bundle version %1").arg(qFromLittleEndian<quint16>(p + 4));
+        return false;
+    }
+
+    quint32 manifestSize = qFromLittleEndian<quint32>(p + 8);
+    if (manifestSize > BUNDLE_MAX_MANIFEST_SIZE) {
+        m_error = "Manifest too large";
+        return false;
+    }
+
+    QByteArray manifestData = m_file.read(manifestSize);
+    if (manifestData.size() != int(manifestSize)
+        || Crc32(manifestData.constData(), manifestData.size()) != qFromLittleEndian<quint32>(p + 12)) {
+        m_error = "Manifest is damaged";
+        return false;
+    }
+
+    QJsonObject json = QJsonDocument::fromJson(manifestData).object();
+    m_manifest.title = json["title"].toString();
+    m_manifest.created = QDateTime::fromString(json["created"].toString(), Qt::ISODate);
+    m_manifest.count = quint32(json["count"].toVariant().toLongLong());
+
+    m_firstRecordPos = m_file.pos();
+
+    return true;
+}
+
+bool BundleReader::Verify()
+{
+    quint32 crc = 0;
+    quint32 count = 0;
+    QByteArray buffer;
+
+    for (;;) {
+        qint64 size = ReadRecordSize();
+        if (size < 0) {
+            return false;
+        }
+
+        if (size == 0) {
+            break;
+        }
+
+        uchar sizeBytes[4];
+        qToLittleEndian<quint32>(quint32(size), sizeBytes);
+        crc = Crc32(sizeBytes, sizeof(sizeBytes), crc);
+
+        buffer.resize(int(size));
+        if (m_file.read(buffer.data(), size) != size) {
+            m_error = "Bundle is truncated";
+            return false;
+        }
+        crc = Crc32(buffer.constData(), size, crc);
+        ++count;
+    }
+
+    QByteArray trailer = m_file.read(BUNDLE_TRAILER_SIZE);
+    if (trailer.size() != BUNDLE_TRAILER_SIZE) {
+        m_error = "Bundle is truncated";
+        return false;
+    }
+
+    const uchar *p = reinterpret_cast<const uchar *>(trailer.constData());
+    if (qFromLittleEndian<quint32>(p) != count || qFromLittleEndian<quint32>(p + 4) != crc) {
+        m_error = "Bundle is damaged";
+        return false;
+    }
+
+    m_file.seek(m_firstRecordPos);
+
+    return true;
+}
+
+OverlayScheme::Ptr BundleReader::Next()
+{
+    m_error.clear();
+
+    qint64 size = ReadRecordSize();
+    if (size <= 0) {
+        return nullptr;
+    }
+
+    QByteArray data = m_file.read(size);
+    if (data.size() != size) {
+        m_error = "Bundle is truncated";
+        return nullptr;
+    }
+
+    OverlayScheme::Ptr scheme = DecodeScheme(data);
+    if (!scheme) {
+        m_error = "Invalid profile record";
+    }
+
+    return scheme;
+}
+
+qint64 BundleReader::ReadRecordSize()
+{
+    uchar size[4];
+    if (m_file.read(reinterpret_cast<char *>(size), sizeof(size)) != sizeof(size)) {
+        m_error = "Bundle is truncated";
+        return -1;
+    }
+
+    quint32 value = qFromLittleEndian<quint32>(size);
+    if (value > BUNDLE_MAX_RECORD_SIZE) {
+        m_error = "Bundle is damaged";
+        return -1;
+    }
+
+    return value;
+}
+
+bool ParseBundleConflictPolicy(QString text, BundleConflictPolicy *policy)
+{
+    if (text == "skip") {
+        *policy = BundleConflictPolicy::Skip;
+    } else if (text == "overwrite") {
+        *policy = BundleConflictPolicy::Overwrite;
+    } else if (text == "rename") {
+        *policy = BundleConflictPolicy::Rename;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+ProfileBundleJob::ProfileBundleJob(QObject *parent)
+    : QObject(parent)
+{
+    qRegisterMetaType<BundleResult>("BundleResult");
+
+    m_pool.setMaxThreadCount(1);
+}
+
+ProfileBundleJob::~ProfileBundleJob()
+{
+    Cancel();
+
+    // Unblock a worker waiting for a batch slot.
+    m_batchSlots.release(BUNDLE_BATCHES_IN_FLIGHT);
+    m_pool.waitForDone();
+}
+
+bool ProfileBundleJob::StartExport(QString filePath, QStringList names, QString title)
+{
+    if (m_bRunning) {
+        return false;
+    }
+    m_bRunning = true;
+    m_bCanceled = 0;
+
+    QtConcurrent::run(&m_pool, [this, filePath, names, title]() {
+        RunExport(filePath, names, title);
+    });
+
+    return true;
+}
+
+bool ProfileBundleJob::StartImport(QString filePath, BundleConflictPolicy policy)
+{
+    if (m_bRunning) {
+        return false;
+    }
+    m_bRunning = true;
+    m_bCanceled = 0;
+    m_importResult = BundleResult();
+
+    // Drop slots left over from a canceled import.
+    m_batchSlots.tryAcquire(m_batchSlots.available());
+    m_batchSlots.release(BUNDLE_BATCHES_IN_FLIGHT);
+
+    QtConcurrent::run(&m_pool, [this, filePath, policy]() {
+        RunImport(filePath, policy);
+    });
+
+    return true;
+}
+
+void ProfileBundleJob::Cancel()
+{
+    m_bCanceled = 1;
+}
+
+void ProfileBundleJob::RunExport(QString filePath, QStringList names, QString title)
+{
+    BundleResult result;
+    ProfileRepository *profiles = ProfileRepository::Instance();
+
+    // The manifest has the exact record count, so drop removed profiles
+    //   first. Nothing is decoded for that.
+    QStringList existing;
+    for (const QString &name : names) {
+        if (profiles->Exists(name)) {
+            existing.append(name);
+        }
+    }
+    names = existing;
+
+    BundleManifest manifest;
+    manifest.title = title;
+    manifest.created = QDateTime::currentDateTimeUtc();
+    manifest.count = names.size();
+
+    BundleWriter writer;
+    bool bOk = writer.Open(filePath, manifest);
+
+    for (int i = 0; bOk && i != names.size(); ++i) {
+        if (m_bCanceled) {
+            result.error = "Canceled";
+            bOk = false;
+            break;
+        }
+
+        OverlayScheme::Ptr scheme = profiles->Read(names[i]);
+        if (!scheme) {
+            result.error = QString("Profile removed during export: %1").arg(names[i]);
+            bOk = false;
+            break;
+        }
+
+        bOk = writer.Write(*scheme);
+        if (bOk) {
+            ++result.exported;
+        }
+
+        if ((i + 1) % BUNDLE_IMPORT_BATCH == 0) {
+            emit SigProgress(i + 1, names.size());
+        }
+    }
+
+    bOk = bOk && writer.Finish();
+    if (!bOk && result.error.isEmpty()) {
+        result.error = writer.GetError();
+    }
+    result.bOk = bOk;
+
+    QMetaObject::invokeMethod(this, [this, result]() {
+        Finish(result);
+    }, Qt::QueuedConnection);
+}
+
+void ProfileBundleJob::RunImport(QString filePath, BundleConflictPolicy policy)
+{
+    BundleResult result;
+    BundleReader reader;
+
+    bool bOk = reader.Open(filePath) && reader.Verify();
+    int total = int(reader.GetManifest().count);
+    if (bOk) {
+        emit SigProgress(total, 2 * total);
+    }
+
+    int done = 0;
+    QVector<OverlayScheme::Ptr> batch;
+
+    while (bOk) {
+        OverlayScheme::Ptr scheme = reader.Next();
+        if (!scheme && !reader.GetError().isEmpty()) {
+            bOk = false;
+            break;
+        }
+
+        if (scheme) {
+            batch.append(scheme);
+        }
+        if (batch.size() != BUNDLE_IMPORT_BATCH && scheme) {
+            continue;
+        }
+
+        // Full batch, or end of bundle.
+        m_batchSlots.acquire();
+        if (m_bCanceled) {
+            result.error = "Canceled";
+            bOk = false;
+            break;
+        }
+
+        done += batch.size();
+        QMetaObject::invokeMethod(this, [this, batch, policy, done, total]() {
+            ImportBatch(batch, policy);
+            m_batchSlots.release();
+            emit SigProgress(total + done, 2 * total);
+        }, Qt::QueuedConnection);
+        batch.clear();
+
+        if (!scheme) {
+            break;
+        }
+    }
+
+    if (!bOk && result.error.isEmpty()) {
+        result.error = reader.GetError();
+    }
+    result.bOk = bOk;
+
+    // Queued after the last batch.
+    QMetaObject::invokeMethod(this, [this, result]() {
+        BundleResult merged = m_importResult;
+        merged.bOk = result.bOk && merged.failed == 0;
+        merged.error = result.error;
+        if (merged.error.isEmpty() && merged.failed != 0) {
+            merged.error = QString("%1 profiles not saved").arg(merged.failed);
+        }
+        Finish(merged);
+    }, Qt::QueuedConnection);
+}
+
+void ProfileBundleJob::ImportBatch(QVector<OverlayScheme::Ptr> batch, BundleConflictPolicy policy)
+{
+    ProfileRepository *profiles = ProfileRepository::Instance();
+
+    // Names of this batch, not in the repository until SaveAll().
+    QSet<QString> batchNames;
+    QVector<OverlayScheme::Ptr> saves;
+    saves.reserve(batch.size());
+
+    for (OverlayScheme::Ptr scheme : batch) {
+        if (!ProfileRepository::IsValidName(scheme->schemeName)) {
+            L_ERROR("Import profile failed: {}", scheme->schemeName);
+            ++m_importResult.failed;
+            continue;
+        }
+
+        int *counter = &m_importResult.added;
+        if (profiles->Contains(scheme->schemeName) || batchNames.contains(scheme->schemeName)) {
+            switch (policy) {
+            case BundleConflictPolicy::Skip:
+                ++m_importResult.skipped;
+                continue;
+            case BundleConflictPolicy::Overwrite:
+                counter = &m_importResult.overwritten;
+                break;
+            case BundleConflictPolicy::Rename:
+                scheme->schemeName = GetFreeName(scheme->schemeName, batchNames);
+                counter = &m_importResult.renamed;
+                break;
+            }
+        }
+
+        batchNames.insert(scheme->schemeName);
+        saves.push_back(scheme);
+        ++*counter;
+    }
+
+    // One reset for the views, instead of a signal per profile.
+    if (!saves.isEmpty()) {
+        profiles->SaveAll(saves);
+    }
+}
+
+void ProfileBundleJob::Finish(BundleResult result)
+{
+    m_bRunning = false;
+
+    if (result.bOk) {
+        L_INFO("Bundle job finished, exported: {}, added: {}, overwritten: {}, renamed: {}, skipped: {}",
+               result.exported, result.added, result.overwritten, result.renamed, result.skipped);
+    } else {
+        L_ERROR("Bundle job failed: {}. exported: {}, added: {}, overwritten: {}, renamed: {}, "
+                "skipped: {}, failed: {}", result.error, result.exported, result.added,
+                result.overwritten, result.renamed, result.skipped, result.failed);
+    }
+
+    emit SigFinished(result);
+}
+
+QString ProfileBundleJob::GetFreeName(QString name, const QSet<QString> &taken)
+{
+    ProfileRepository *profiles = ProfileRepository::Instance();
+
+    for (int n = 2; ; ++n) {
+        QString suffix = QString(" (%1)").arg(n);
+        QString candidate = name.left(PROFILE_STORE_MAX_NAME_LENGTH - suffix.size()) + suffix;
+        if (!profiles->Contains(candidate) && !taken.contains(candidate)) {
+            return candidate;
+        }
+    }
+}
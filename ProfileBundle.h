@@ -0,0 +1,166 @@
+#ifndef PROFILEBUNDLE_H
+#define PROFILEBUNDLE_H
+
+#include "OverlayScheme.h"
+
+#include <QAtomicInt>
+#include <QDateTime>
+#include <QFile>
+#include <QObject>
+#include <QSaveFile>
+#include <QSemaphore>
+#include <QSet>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+
+// Bundle file, many profiles in one file for distribution.
+//
+// Header (16 bytes, little endian):
+//   magic "MLFB"(4) format version(2) flags(2) manifest size(4) manifest crc32(4)
+// Manifest: UTF-8 JSON object with "title", "created" and "count".
+// Records: size(4) and a scheme encoded by EncodeScheme(), as many as needed.
+// Trailer: size 0(4), record count(4), crc32 of all record bytes(4).
+//
+// Bundles are written and read one record at a time, so memory does not grow
+//   with the number of profiles.
+
+struct BundleManifest {
+    QString title;
+    QDateTime created;
+    quint32 count = 0;
+};
+
+// Write a bundle. The file is replaced only when Finish() succeeds.
+class BundleWriter
+{
+public:
+    // manifest.count is the number of records that will be written.
+    bool Open(QString filePath, const BundleManifest &manifest);
+
+    bool Write(const OverlayScheme &scheme);
+
+    bool Finish();
+
+    QString GetError() const { return m_error; }
+
+private:
+    bool WriteAll(const QByteArray &data);
+
+    QSaveFile m_file;
+    quint32 m_count = 0;
+    quint32 m_crc = 0;
+    QString m_error;
+};
+
+// Read a bundle.
+class BundleReader
+{
+public:
+    // Open and read the manifest.
+    bool Open(QString filePath);
+
+    const BundleManifest &GetManifest() const { return m_manifest; }
+
+    // Check record sizes, record count and checksum of the whole file, then
+    //   rewind to the first record. Nothing is decoded.
+    bool Verify();
+
+    // Next scheme. nullptr at the end, or if the record cannot be decoded;
+    //   GetError() is empty at the end only.
+    OverlayScheme::Ptr Next();
+
+    // Bytes read so far, and file size.
+    qint64 GetPosition() const { return m_file.pos(); }
+    qint64 GetSize() const { return m_file.size(); }
+
+    QString GetError() const { return m_error; }
+
+private:
+    // Read size of next record. 0 at trailer. -1 on error.
+    qint64 ReadRecordSize();
+
+    QFile m_file;
+    BundleManifest m_manifest;
+    qint64 m_firstRecordPos = 0;
+    QString m_error;
+};
+
+enum class BundleConflictPolicy {
+    Skip,       // Keep existing profile.
+    Overwrite,  // Replace existing profile.
+    Rename,     // Import as "name (2)", "name (3)"...
+};
+
+// Parse "skip", "overwrite" or "rename". Return false if unknown.
+bool ParseBundleConflictPolicy(QString text, BundleConflictPolicy *policy);
+
+struct BundleResult {
+    bool bOk = false;
+    QString error;
+
+    int exported = 0;
+    int added = 0;
+    int overwritten = 0;
+    int renamed = 0;
+    int skipped = 0;
+    int failed = 0;     // Not saved, e.g. invalid name. bOk is false then.
+};
+
+// Import or export a bundle on a worker thread, one job at a time.
+//
+// Export reads profiles straight from the profile store. Import checks the
+//   whole bundle before changing anything, then decodes records in batches on
+//   the worker thread and saves them to ProfileRepository on the GUI thread.
+//   Only a few batches are in flight at once.
+class ProfileBundleJob : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ProfileBundleJob(QObject *parent = nullptr);
+
+    // Cancel running job and wait for it.
+    ~ProfileBundleJob();
+
+    bool IsRunning() const { return m_bRunning; }
+
+    // Export given profiles. Profiles removed before the export starts are
+    //   left out; the export fails if one is removed while it runs.
+    bool StartExport(QString filePath, QStringList names, QString title);
+
+    bool StartImport(QString filePath, BundleConflictPolicy policy);
+
+    // Stop at the next record. Profiles imported so far are kept, an
+    //   exported file is not written.
+    void Cancel();
+
+signals:
+    // Records done out of total. Import counts every record twice: once when
+    //   checking the bundle and once when importing it.
+    void SigProgress(int done, int total);
+
+    void SigFinished(BundleResult result);
+
+private:
+    void RunExport(QString filePath, QStringList names, QString title);
+    void RunImport(QString filePath, BundleConflictPolicy policy);
+
+    // GUI thread.
+    void ImportBatch(QVector<OverlayScheme::Ptr> batch, BundleConflictPolicy policy);
+    void Finish(BundleResult result);
+
+    // Free name for policy Rename, also not in taken.
+    static QString GetFreeName(QString name, const QSet<QString> &taken);
+
+    QThreadPool m_pool;
+    bool m_bRunning = false;
+    QAtomicInt m_bCanceled;
+
+    // Batches the worker may have queued for the GUI thread.
+    QSemaphore m_batchSlots;
+
+    // Import counts, GUI thread.
+    BundleResult m_importResult;
+};
+
+#endif // PROFILEBUNDLE_H
@@ -0,0 +1,100 @@
+#include "ProfileListModel.h"
+#include "ProfileRepository.h"
+
+#include <QIcon>
+#include <QPainter>
+#include <QPixmap>
+
+#define SWATCH_SIZE 12
+
+// Distinct color pairs kept as icons.
+#define SWATCH_CACHE_SIZE 256
+
+// Horizontal line color on top, vertical line color at bottom.
+static QIcon MakeSwatch(const ProfileHeader &header)
+{
+    QPixmap pixmap(SWATCH_SIZE, SWATCH_SIZE);
+    pixmap.fill(Qt::transparent);
+
+    QPainter painter(&pixmap);
+    painter.fillRect(0, 0, SWATCH_SIZE, SWATCH_SIZE / 2, QColor::fromRgba(header.hLineColor));
+    painter.fillRect(0, SWATCH_SIZE / 2, SWATCH_SIZE, SWATCH_SIZE / 2, QColor::fromRgba(header.vLineColor));
+
+    return QIcon(pixmap);
+}
+
+ProfileListModel::ProfileListModel(QObject *parent)
+    : QAbstractListModel(parent), m_swatches(SWATCH_CACHE_SIZE)
+{
+    ProfileRepository *profiles = ProfileRepository::Instance();
+    connect(profiles, &ProfileRepository::SigLoaded, this, &ProfileListModel::OnProfilesLoaded);
+    connect(profiles, &ProfileRepository::SigProfilesReset, this, &ProfileListModel::OnProfilesLoaded);
+    connect(profiles, &ProfileRepository::SigProfileAdded, this, &ProfileListModel::OnProfileAdded);
+    connect(profiles, &ProfileRepository::SigProfileChanged, this, &ProfileListModel::OnProfileChanged);
+    connect(profiles, &ProfileRepository::SigProfileRemoved, this, &ProfileListModel::OnProfileRemoved);
+
+    m_rowCount = profiles->Count();
+}
+
+int ProfileListModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_rowCount;
+}
+
+QVariant ProfileListModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_rowCount) {
+        return QVariant();
+    }
+
+    ProfileRepository *profiles = ProfileRepository::Instance();
+
+    switch (role) {
+    case Qt::DisplayRole:
+    case Qt::EditRole:
+        return profiles->NameAt(index.row());
+    case Qt::DecorationRole: {
+        // Asked for on every repaint of a row.
+        ProfileHeader header = profiles->HeaderAt(index.row());
+        quint64 key = quint64(header.hLineColor) << 32 | header.vLineColor;
+        if (QIcon *swatch = m_swatches.object(key)) {
+            return *swatch;
+        }
+
+        QIcon swatch = MakeSwatch(header);
+        m_swatches.insert(key, new QIcon(swatch));
+        return swatch;
+    }
+    case IdRole:
+        return profiles->GetId(profiles->NameAt(index.row()));
+    default:
+        return QVariant();
+    }
+}
+
+void ProfileListModel::OnProfilesLoaded()
+{
+    beginResetModel();
+    m_rowCount = ProfileRepository::Instance()->Count();
+    endResetModel();
+}
+
+void ProfileListModel::OnProfileAdded(int /*id*/, int index)
+{
+    beginInsertRows(QModelIndex(), index, index);
+    ++m_rowCount;
+    endInsertRows();
+}
+
+void ProfileListModel::OnProfileChanged(int /*id*/, int index)
+{
+    QModelIndex modelIndex = this->index(index);
+    emit dataChanged(modelIndex, modelIndex);
+}
+
+void ProfileListModel::OnProfileRemoved(int /*id*/, int index)
+{
+    beginRemoveRows(QModelIndex(), index, index);
+    --m_rowCount;
+    endRemoveRows();
+}
@@ -0,0 +1,38 @@
+#ifndef PROFILELISTMODEL_H
+#define PROFILELISTMODEL_H
+
+#include <QAbstractListModel>
+#include <QCache>
+#include <QIcon>
+
+// Profiles of ProfileRepository as a list, for combo boxes and list views.
+//   Rows follow the repository order and are only created by views when
+//   shown, so large profile lists cost nothing until scrolled to.
+class ProfileListModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    // Role for profile id.
+    static const int IdRole = Qt::UserRole;
+
+    explicit ProfileListModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+private slots:
+    void OnProfilesLoaded();
+    void OnProfileAdded(int id, int index);
+    void OnProfileChanged(int id, int index);
+    void OnProfileRemoved(int id, int index);
+
+private:
+    // Repository is changed before it notifies, so the row count seen by
+    //   views is kept here.
+    int m_rowCount = 0;
+
+    // Swatch icons by line colors, shared by profiles of the same colors.
+    mutable QCache<quint64, QIcon> m_swatches;
+};
+
+#endif // PROFILELISTMODEL_H
@@ -0,0 +1,79 @@
+#include "ProfilePickerDialog.h"
+#include "ProfileListModel.h"
+#include "ProfileRepository.h"
+
+#include <QDialogButtonBox>
+#include <QLineEdit>
+#include <QListView>
+#include <QSortFilterProxyModel>
+#include <QVBoxLayout>
+
+ProfilePickerDialog::ProfilePickerDialog(QWidget *parent) :
+    QDialog(parent)
+{
+    setWindowFlags(windowFlags() & ~Qt::WindowContextHelpButtonHint);
+    setWindowTitle("Choose profile");
+
+    m_filterModel = new QSortFilterProxyModel(this);
+    m_filterModel->setSourceModel(new ProfileListModel(this));
+    m_filterModel->setFilterCaseSensitivity(Qt::CaseInsensitive);
+
+    m_editFilter = new QLineEdit(this);
+    m_editFilter->setPlaceholderText("Search");
+    m_editFilter->setClearButtonEnabled(true);
+
+    // Only visible rows are laid out.
+    m_listProfiles = new QListView(this);
+    m_listProfiles->setModel(m_filterModel);
+    m_listProfiles->setUniformItemSizes(true);
+    m_listProfiles->setEditTriggers(QAbstractItemView::NoEditTriggers);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(
+        QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(m_editFilter);
+    layout->addWidget(m_listProfiles);
+    layout->addWidget(buttons);
+
+    connect(m_editFilter, &QLineEdit::textChanged, this, &ProfilePickerDialog::OnFilterChanged);
+    connect(m_listProfiles, &QListView::activated, this, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    resize(300, 400);
+}
+
+void ProfilePickerDialog::SetCurrentProfile(QString profileName)
+{
+    int row = ProfileRepository::Instance()->IndexOf(profileName);
+    if (row == -1) {
+        return;
+    }
+
+    QModelIndex sourceIndex = m_filterModel->sourceModel()->index(row, 0);
+    QModelIndex index = m_filterModel->mapFromSource(sourceIndex);
+
+    m_listProfiles->setCurrentIndex(index);
+    m_listProfiles->scrollTo(index, QAbstractItemView::PositionAtCenter);
+}
+
+QString ProfilePickerDialog::GetSelectedProfile() const
+{
+    QModelIndex index = m_listProfiles->currentIndex();
+    if (!index.isValid()) {
+        return QString();
+    }
+
+    return index.data(Qt::DisplayRole).toString();
+}
+
+void ProfilePickerDialog::OnFilterChanged(QString text)
+{
+    m_filterModel->setFilterFixedString(text);
+
+    // Keep a selection, so Enter picks the first match.
+    if (!m_listProfiles->currentIndex().isValid() && m_filterModel->rowCount() > 0) {
+        m_listProfiles->setCurrentIndex(m_filterModel->index(0, 0));
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef PROFILEPICKERDIALOG_H
+#define PROFILEPICKERDIALOG_H
+
+#include <QDialog>
+
+class QLineEdit;
+class QListView;
+class QSortFilterProxyModel;
+
+// Searchable list of all profiles, for when there are too many for a menu.
+class ProfilePickerDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit ProfilePickerDialog(QWidget *parent = nullptr);
+
+    // Select profile, and scroll to it.
+    void SetCurrentProfile(QString profileName);
+
+    // Chosen profile name. Empty if none.
+    QString GetSelectedProfile() const;
+
+private slots:
+    void OnFilterChanged(QString text);
+
+private:
+    QLineEdit *m_editFilter = nullptr;
+    QListView *m_listProfiles = nullptr;
+    QSortFilterProxyModel *m_filterModel = nullptr;
+};
+
+#endif // PROFILEPICKERDIALOG_H
@@ -0,0 +1,622 @@
+#define MYLOG_MODULE LogModule::Profiles
+
+#include "ProfileRepository.h"
+#include "SchemeCodec.h"
+#include "mylog/mylog.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QtConcurrent>
+#include <algorithm>
+
+#define PROFILE_STORE_FILE "profiles.pack"
+
+// Profiles were stored one file per profile here, before PROFILE_STORE_FILE.
+#define PROFILE_SUB_DIR "profiles"
+
+// Wait for a burst of change notifications to settle before reloading.
+#define RELOAD_DELAY_MS 300
+
+// Decoded profiles kept in memory.
+#define PROFILE_CACHE_SIZE 64
+
+ProfileRepository *ProfileRepository::s_instance = nullptr;
+
+// Case insensitive, with a case sensitive tie break for a total order.
+static bool IsNameLess(const QString &a, const QString &b)
+{
+    int result = a.compare(b, Qt::CaseInsensitive);
+    if (result != 0) {
+        return result < 0;
+    }
+
+    return a < b;
+}
+
+ProfileRepository::ProfileRepository(QObject *parent)
+    : ProfileRepository(QString(), new ProfileStore, parent)
+{
+}
+
+ProfileRepository::ProfileRepository(QString dataDir, ProfileStore *store, QObject *parent)
+    : QObject(parent),
+      m_storePath(dataDir.isEmpty() ? PROFILE_STORE_FILE : QDir(dataDir).filePath(PROFILE_STORE_FILE)),
+      m_legacyDir(dataDir.isEmpty() ? PROFILE_SUB_DIR : QDir(dataDir).filePath(PROFILE_SUB_DIR)),
+      m_cache(PROFILE_CACHE_SIZE), m_store(store)
+{
+    s_instance = this;
+
+    m_loadTimer.start();
+
+    // One thread, so store access is serialized.
+    m_ioPool.setMaxThreadCount(1);
+
+    m_timerReload.setSingleShot(true);
+    m_timerReload.setInterval(RELOAD_DELAY_MS);
+    connect(&m_timerReload, &QTimer::timeout, this, &ProfileRepository::OnReload);
+
+    connect(&m_watcher, &QFileSystemWatcher::fileChanged,
+        this, &ProfileRepository::OnPathChanged);
+    connect(&m_watcher, &QFileSystemWatcher::directoryChanged,
+        this, &ProfileRepository::OnPathChanged);
+
+    QtConcurrent::run(&m_ioPool, [this]() {
+        QVector<ProfileHeader> headers = LoadStore();
+        QMetaObject::invokeMethod(this, [this, headers]() {
+            OnLoaded(headers);
+        }, Qt::QueuedConnection);
+    });
+}
+
+ProfileRepository::~ProfileRepository()
+{
+    m_ioPool.waitForDone();
+
+    if (s_instance == this) {
+        s_instance = nullptr;
+    }
+}
+
+OverlayScheme::Ptr ProfileRepository::Get(QString name)
+{
+    if (!m_profiles.contains(name)) {
+        return nullptr;
+    }
+
+    if (OverlayScheme::Ptr *cached = m_cache.object(name)) {
+        return *cached;
+    }
+
+    OverlayScheme::Ptr scheme;
+    if (FindUnwritten(name, &scheme)) {
+        if (scheme) {
+            m_cache.insert(name, new OverlayScheme::Ptr(scheme));
+        }
+        return scheme;
+    }
+
+    // The store may be on a slow drive, never read it here.
+    LoadInBackground(name);
+
+    return nullptr;
+}
+
+OverlayScheme::Ptr ProfileRepository::GetById(int id)
+{
+    auto it = m_names.constFind(id);
+    return it == m_names.constEnd() ? nullptr : Get(it.value());
+}
+
+OverlayScheme::Ptr ProfileRepository::Read(QString name) const
+{
+    OverlayScheme::Ptr scheme;
+    if (FindUnwritten(name, &scheme)) {
+        return scheme;
+    }
+
+    return m_store->Load(name);
+}
+
+bool ProfileRepository::Exists(QString name) const
+{
+    OverlayScheme::Ptr scheme;
+    if (FindUnwritten(name, &scheme)) {
+        return scheme != nullptr;
+    }
+
+    return m_store->Contains(name);
+}
+
+int ProfileRepository::GetId(QString name) const
+{
+    auto it = m_profiles.constFind(name);
+    return it == m_profiles.constEnd() ? -1 : it->id;
+}
+
+ProfileHeader ProfileRepository::HeaderAt(int index) const
+{
+    if (index < 0 || index >= m_order.size()) {
+        return ProfileHeader();
+    }
+
+    return m_profiles.value(m_order[index]).header;
+}
+
+int ProfileRepository::IndexOf(QString name) const
+{
+    if (!m_profiles.contains(name)) {
+        return -1;
+    }
+
+    return LowerBound(name);
+}
+
+QString ProfileRepository::GetRelativeName(QString name, int offset) const
+{
+    int count = m_order.size();
+    if (count == 0) {
+        return QString();
+    }
+
+    int index = IndexOf(name);
+    if (index == -1) {
+        return m_order[0];
+    }
+
+    index = ((index + offset) % count + count) % count;
+
+    return m_order[index];
+}
+
+bool ProfileRepository::IsValidName(QString name)
+{
+    if (name.isEmpty() || name.size() > PROFILE_STORE_MAX_NAME_LENGTH) {
+        L_ERROR("Invalid profile name length: {}", name.size());
+        return false;
+    }
+
+    return true;
+}
+
+bool ProfileRepository::Save(OverlayScheme::Ptr scheme)
+{
+    if (!IsValidName(scheme->schemeName)) {
+        return false;
+    }
+
+    QueueWrite(scheme->schemeName, scheme);
+
+    m_cache.insert(scheme->schemeName, new OverlayScheme::Ptr(scheme));
+    PutProfile(ProfileHeader::FromScheme(*scheme));
+
+    return true;
+}
+
+bool ProfileRepository::SaveAll(const QVector<OverlayScheme::Ptr> &schemes)
+{
+    bool bAllValid = true;
+    QHash<QString, OverlayScheme::Ptr> writes;
+    writes.reserve(schemes.size());
+    for (const OverlayScheme::Ptr &scheme : schemes) {
+        if (!IsValidName(scheme->schemeName)) {
+            bAllValid = false;
+            continue;
+        }
+        writes.insert(scheme->schemeName, scheme);
+    }
+
+    if (writes.isEmpty()) {
+        return bAllValid;
+    }
+
+    QueueWrites(writes);
+
+    // Sort only the added names, then merge them in once. Inserting one by
+    //   one moves the whole order for every profile.
+    int oldCount = m_order.size();
+    for (auto it = writes.constBegin(); it != writes.constEnd(); ++it) {
+        const QString &name = it.key();
+        ProfileHeader header = ProfileHeader::FromScheme(*it.value());
+
+        // Bulk data would only evict the profiles in use from the cache.
+        m_cache.remove(name);
+
+        auto entryIt = m_profiles.find(name);
+        if (entryIt != m_profiles.end()) {
+            entryIt->header = header;
+            continue;
+        }
+
+        int id = m_nextId++;
+        m_profiles.insert(name, Entry{ id, header });
+        m_names.insert(id, name);
+        m_order.push_back(name);
+    }
+    std::sort(m_order.begin() + oldCount, m_order.end(), IsNameLess);
+    std::inplace_merge(m_order.begin(), m_order.begin() + oldCount, m_order.end(), IsNameLess);
+
+    emit SigProfilesReset();
+
+    return bAllValid;
+}
+
+bool ProfileRepository::Remove(QString name)
+{
+    QueueWrite(name, nullptr);
+
+    m_cache.remove(name);
+    TakeProfile(name);
+
+    return true;
+}
+
+void ProfileRepository::OnPathChanged()
+{
+    m_timerReload.start();
+}
+
+void ProfileRepository::OnReload()
+{
+    WatchPaths();
+
+    QtConcurrent::run(&m_ioPool, [this]() {
+        StoreDelta delta = ReloadStore();
+        QVector<OverlayScheme::Ptr> imported = ReadLegacyFiles(false);
+
+        QMetaObject::invokeMethod(this, [this, delta, imported]() {
+            ApplyStoreDelta(delta);
+
+            for (const OverlayScheme::Ptr &scheme : imported) {
+                L_INFO("Import profile file: {}", scheme->schemeName);
+            }
+            if (!imported.isEmpty()) {
+                SaveAll(imported);
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+ProfileRepository::FileState ProfileRepository::GetFileState(QString filePath)
+{
+    FileState state;
+
+    QFileInfo info(filePath);
+    if (info.exists()) {
+        state.size = info.size();
+        state.modified = info.lastModified();
+    }
+
+    return state;
+}
+
+QVector<ProfileHeader> ProfileRepository::LoadStore()
+{
+    // Ensure legacy dir exists, so it can be watched.
+    QDir dir(m_legacyDir);
+    if (!dir.exists()) {
+        dir.mkpath(".");
+    }
+
+    // Profiles saved meanwhile fail to write, SigWriteFailed() tells.
+    if (!m_store->Open(m_storePath, m_legacyDir)) {
+        L_ERROR("Profile store not available: {}", m_storePath);
+    }
+    m_storeState = GetFileState(m_storePath);
+    m_fingerprints = m_store->Fingerprints();
+
+    // Existing files were migrated already. Only files changed from now on
+    //   are imported.
+    ReadLegacyFiles(true);
+
+    return m_store->LoadHeaders();
+}
+
+ProfileRepository::StoreDelta ProfileRepository::ReloadStore()
+{
+    StoreDelta delta;
+
+    FileState state = GetFileState(m_storePath);
+    if (state == m_storeState) {
+        return delta;
+    }
+    m_storeState = state;
+
+    if (!m_store->Reload()) {
+        L_ERROR("Reload profile store failed: {}", m_storePath);
+        return delta;
+    }
+
+    QHash<QString, uint> fingerprints = m_store->Fingerprints();
+
+    for (auto it = m_fingerprints.constBegin(); it != m_fingerprints.constEnd(); ++it) {
+        if (!fingerprints.contains(it.key())) {
+            delta.removed.push_back(it.key());
+        }
+    }
+
+    // Read only added and changed profiles.
+    for (auto it = fingerprints.constBegin(); it != fingerprints.constEnd(); ++it) {
+        auto oldIt = m_fingerprints.constFind(it.key());
+        if (oldIt != m_fingerprints.constEnd() && oldIt.value() == it.value()) {
+            continue;
+        }
+
+        ProfileHeader header = m_store->LoadHeader(it.key());
+        if (oldIt == m_fingerprints.constEnd()) {
+            delta.added.push_back(header);
+        } else {
+            delta.changed.push_back(header);
+        }
+    }
+
+    m_fingerprints = fingerprints;
+
+    L_INFO("Profile store reloaded. added: {}, changed: {}, removed: {}",
+        delta.added.size(), delta.changed.size(), delta.removed.size());
+
+    return delta;
+}
+
+QVector<OverlayScheme::Ptr> ProfileRepository::ReadLegacyFiles(bool bRecordOnly)
+{
+    QDir dir(m_legacyDir);
+    QFileInfoList files = dir.entryInfoList(QStringList() << "*.dat", QDir::Files);
+
+    QHash<QString, FileState> states;
+    QStringList changedPaths;
+    for (const QFileInfo &info : files) {
+        FileState state;
+        state.size = info.size();
+        state.modified = info.lastModified();
+        states.insert(info.fileName(), state);
+
+        if (!bRecordOnly && !(m_legacyFileStates.value(info.fileName()) == state)) {
+            changedPaths.push_back(info.absoluteFilePath());
+        }
+    }
+
+    m_legacyFileStates = states;
+
+    // Each file may be slow to read on a network drive, read them together.
+    QVector<OverlayScheme::Ptr> parsed = QtConcurrent::blockingMapped<QVector<OverlayScheme::Ptr>>(
+        changedPaths, LoadSchemeFromFile);
+
+    QVector<OverlayScheme::Ptr> schemes;
+    for (int i = 0; i != parsed.size(); ++i) {
+        if (!parsed[i]) {
+            L_WARN("Skip unreadable profile file: {}", changedPaths[i]);
+            continue;
+        }
+        schemes.push_back(parsed[i]);
+    }
+
+    return schemes;
+}
+
+void ProfileRepository::WritePending()
+{
+    QHash<QString, OverlayScheme::Ptr> writes;
+    {
+        QMutexLocker locker(&m_pendingMutex);
+        m_writingWrites.swap(m_pendingWrites);
+        writes = m_writingWrites;
+        m_bWriteScheduled = false;
+    }
+
+    // Saves go in one append, each separate save rewrites the index.
+    QVector<OverlayScheme::Ptr> saves;
+    QStringList removes;
+    for (auto it = writes.constBegin(); it != writes.constEnd(); ++it) {
+        if (it.value()) {
+            saves.push_back(it.value());
+        } else {
+            removes.push_back(it.key());
+        }
+    }
+
+    if (!saves.isEmpty()) {
+        bool bOk = m_store->SaveAll(saves);
+        for (const OverlayScheme::Ptr &scheme : saves) {
+            const QString &name = scheme->schemeName;
+            if (!bOk) {
+                L_ERROR("Write profile failed: {}", name);
+                emit SigWriteFailed(name);
+                continue;
+            }
+
+            // Own writes are not to be reloaded.
+            m_fingerprints[name] = m_store->Fingerprint(name);
+        }
+    }
+
+    for (const QString &name : removes) {
+        if (!m_store->Remove(name)) {
+            L_ERROR("Write profile failed: {}", name);
+            emit SigWriteFailed(name);
+            continue;
+        }
+
+        m_fingerprints.remove(name);
+    }
+
+    m_storeState = GetFileState(m_storePath);
+
+    {
+        QMutexLocker locker(&m_pendingMutex);
+        m_writingWrites.clear();
+    }
+
+    L_DEBUG("Profile writes done: {}", writes.size());
+}
+
+void ProfileRepository::OnLoaded(QVector<ProfileHeader> headers)
+{
+    m_profiles.reserve(m_profiles.size() + headers.size());
+    m_names.reserve(m_names.size() + headers.size());
+    m_order.reserve(m_order.size() + headers.size());
+
+    // Profiles saved or removed before loading finished are newer.
+    for (const ProfileHeader &header : headers) {
+        if (!m_profiles.contains(header.name) && !FindUnwritten(header.name)) {
+            int id = m_nextId++;
+            m_profiles.insert(header.name, Entry{ id, header });
+            m_names.insert(id, header.name);
+            m_order.push_back(header.name);
+        }
+    }
+    std::sort(m_order.begin(), m_order.end(), IsNameLess);
+
+    m_bLoaded = true;
+    L_INFO("Profiles loaded: {}, in {} ms", m_profiles.size(), m_loadTimer.elapsed());
+
+    WatchPaths();
+
+    emit SigLoaded();
+}
+
+void ProfileRepository::LoadInBackground(QString name)
+{
+    if (m_loading.contains(name)) {
+        return;
+    }
+    m_loading.insert(name);
+
+    QtConcurrent::run(&m_ioPool, [this, name]() {
+        OverlayScheme::Ptr scheme = m_store->Load(name);
+        QMetaObject::invokeMethod(this, [this, name, scheme]() {
+            OnProfileLoaded(name, scheme);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void ProfileRepository::OnProfileLoaded(QString name, OverlayScheme::Ptr scheme)
+{
+    m_loading.remove(name);
+
+    // Loads are queued behind writes and reloads, so a profile saved since is
+    //   cached already, and one changed by others is reloaded after this.
+    auto it = m_profiles.constFind(name);
+    if (!scheme || it == m_profiles.constEnd() || m_cache.contains(name) || FindUnwritten(name)) {
+        return;
+    }
+
+    m_cache.insert(name, new OverlayScheme::Ptr(scheme));
+
+    emit SigProfileLoaded(it->id, LowerBound(name));
+}
+
+void ProfileRepository::ApplyStoreDelta(const StoreDelta &delta)
+{
+    // Local changes not written yet win over the file.
+    for (const QString &name : delta.removed) {
+        if (!FindUnwritten(name)) {
+            m_cache.remove(name);
+            TakeProfile(name);
+        }
+    }
+    for (const ProfileHeader &header : delta.added + delta.changed) {
+        if (!FindUnwritten(header.name)) {
+            m_cache.remove(header.name);
+            PutProfile(header);
+        }
+    }
+}
+
+void ProfileRepository::PutProfile(const ProfileHeader &header)
+{
+    const QString &name = header.name;
+
+    auto it = m_profiles.find(name);
+    if (it != m_profiles.end()) {
+        it->header = header;
+        emit SigProfileChanged(it->id, LowerBound(name));
+        return;
+    }
+
+    int id = m_nextId++;
+    int index = LowerBound(name);
+
+    m_profiles.insert(name, Entry{ id, header });
+    m_names.insert(id, name);
+    m_order.insert(index, name);
+
+    emit SigProfileAdded(id, index);
+}
+
+void ProfileRepository::TakeProfile(QString name)
+{
+    auto it = m_profiles.find(name);
+    if (it == m_profiles.end()) {
+        return;
+    }
+
+    int id = it->id;
+    int index = LowerBound(name);
+
+    m_profiles.erase(it);
+    m_names.remove(id);
+    m_order.remove(index);
+
+    emit SigProfileRemoved(id, index);
+}
+
+int ProfileRepository::LowerBound(QString name) const
+{
+    return std::lower_bound(m_order.begin(), m_order.end(), name, IsNameLess) - m_order.begin();
+}
+
+void ProfileRepository::QueueWrite(QString name, OverlayScheme::Ptr scheme)
+{
+    QHash<QString, OverlayScheme::Ptr> writes;
+    writes.insert(name, scheme);
+    QueueWrites(writes);
+}
+
+void ProfileRepository::QueueWrites(const QHash<QString, OverlayScheme::Ptr> &writes)
+{
+    QMutexLocker locker(&m_pendingMutex);
+
+    // Replace writes of the same profiles still waiting.
+    for (auto it = writes.constBegin(); it != writes.constEnd(); ++it) {
+        m_pendingWrites[it.key()] = it.value();
+    }
+
+    if (m_bWriteScheduled) {
+        return;
+    }
+    m_bWriteScheduled = true;
+
+    QtConcurrent::run(&m_ioPool, [this]() {
+        WritePending();
+    });
+}
+
+bool ProfileRepository::FindUnwritten(QString name, OverlayScheme::Ptr *scheme) const
+{
+    QMutexLocker locker(&m_pendingMutex);
+
+    auto it = m_pendingWrites.constFind(name);
+    if (it == m_pendingWrites.constEnd()) {
+        it = m_writingWrites.constFind(name);
+        if (it == m_writingWrites.constEnd()) {
+            return false;
+        }
+    }
+
+    if (scheme) {
+        *scheme = it.value();
+    }
+
+    return true;
+}
+
+void ProfileRepository::WatchPaths()
+{
+    if (!m_watcher.files().contains(m_storePath) && QFile::exists(m_storePath)) {
+        m_watcher.addPath(m_storePath);
+    }
+
+    if (!m_watcher.directories().contains(m_legacyDir) && QDir(m_legacyDir).exists()) {
+        m_watcher.addPath(m_legacyDir);
+    }
+}
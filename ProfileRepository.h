@@ -0,0 +1,233 @@
+#ifndef PROFILEREPOSITORY_H
+#define PROFILEREPOSITORY_H
+
+#include "OverlayScheme.h"
+#include "ProfileStore.h"
+
+#include <QCache>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+
+#include <memory>
+
+// Fake singleton. Rely on main() to initialize it.
+//
+// Profiles of the profile store. Only profile headers are kept for all
+//   profiles; whole profiles are decoded in background on first use and kept
+//   in a bounded cache. Changes made by other processes to the store, and "*.dat" files
+//   dropped or edited in the legacy profile directory, are picked up by
+//   watching the file system. Only changed profiles are read again, and every
+//   change is reported per profile.
+//
+// Loading, reloading and writing never run on the GUI thread. Writes go
+//   through one I/O thread, so they are serialized; writes queued for the same
+//   profile while another write is in progress are coalesced into the last one.
+//   Profiles are empty until SigLoaded() is emitted.
+//
+// Profiles are kept sorted by name, and each has an integer id that stays
+//   the same for the whole session. Views keep their rows in the same order,
+//   and update from the added/changed/removed signals, which carry the id and
+//   the index of the profile. Bulk saves reload all rows by one reset instead.
+class ProfileRepository : public QObject
+{
+    Q_OBJECT
+public:
+    static ProfileRepository *Instance() { return s_instance; }
+
+    ProfileRepository(QObject *parent = nullptr);
+
+    // Profiles of the store in dataDir, read and written through store,
+    //   which is owned from now on. For checks.
+    ProfileRepository(QString dataDir, ProfileStore *store, QObject *parent = nullptr);
+
+    // Wait for queued writes.
+    ~ProfileRepository();
+
+    bool IsLoaded() const { return m_bLoaded; }
+
+    bool Contains(QString name) const { return m_profiles.contains(name); }
+
+    // Profile by name. nullptr if not found, or not cached; then it is
+    //   decoded in background and SigProfileLoaded() follows.
+    OverlayScheme::Ptr Get(QString name);
+
+    // Profile by id, as Get().
+    OverlayScheme::Ptr GetById(int id);
+
+    // Profile by name, for bulk readers on any thread. Not cached.
+    //   nullptr if not found.
+    OverlayScheme::Ptr Read(QString name) const;
+
+    // Whether profile exists, for bulk readers on any thread. Nothing is
+    //   decoded.
+    bool Exists(QString name) const;
+
+    // Id of profile. -1 if not found.
+    int GetId(QString name) const;
+
+    // Name of profile by id. Empty if not found.
+    QString GetName(int id) const { return m_names.value(id); }
+
+    int Count() const { return m_order.size(); }
+
+    // Profile at index in sorted order.
+    QString NameAt(int index) const { return m_order.value(index); }
+    ProfileHeader HeaderAt(int index) const;
+
+    // Index of profile in sorted order. -1 if not found.
+    int IndexOf(QString name) const;
+
+    // Name of profile offset from the given one in sorted order, wrapping
+    //   around. The first profile if name is not found. Empty if there is none.
+    QString GetRelativeName(QString name, int offset) const;
+
+    // Whether the store can hold a profile of this name. Logs why not.
+    static bool IsValidName(QString name);
+
+    // Create or update profile. The change is visible at once and written
+    //   in background; SigWriteFailed() is emitted if writing fails.
+    //   Return false if the profile cannot be stored at all.
+    bool Save(OverlayScheme::Ptr scheme);
+
+    // Create or update profiles, as Save(), for bulk imports. Views are told
+    //   by one SigProfilesReset() instead of a signal per profile.
+    //   Return false if any profile cannot be stored; the others are saved.
+    bool SaveAll(const QVector<OverlayScheme::Ptr> &schemes);
+
+    bool Remove(QString name);
+
+signals:
+    // Initial load finished.
+    void SigLoaded();
+
+    // Many profiles changed at once, ids are kept. Views reload all rows.
+    void SigProfilesReset();
+
+    // index is the position after adding, or before removing.
+    void SigProfileAdded(int id, int index);
+    void SigProfileChanged(int id, int index);
+    void SigProfileRemoved(int id, int index);
+
+    // Profile missed by Get() is in the cache now.
+    void SigProfileLoaded(int id, int index);
+
+    void SigWriteFailed(QString name);
+
+private slots:
+    // Coalesce bursts of notifications into one reload.
+    void OnPathChanged();
+
+    void OnReload();
+
+private:
+    // Size and modification time, to skip reloading unchanged files.
+    struct FileState {
+        qint64 size = -1;
+        QDateTime modified;
+
+        bool operator==(const FileState &other) const {
+            return size == other.size && modified == other.modified;
+        }
+    };
+
+    struct Entry {
+        int id = -1;
+        ProfileHeader header;
+    };
+
+    // Changes found in the store file.
+    struct StoreDelta {
+        QStringList removed;
+        QVector<ProfileHeader> added;
+        QVector<ProfileHeader> changed;
+    };
+
+    static FileState GetFileState(QString filePath);
+
+    // The following run on the I/O thread.
+
+    QVector<ProfileHeader> LoadStore();
+
+    // Changes of the store file made by others.
+    StoreDelta ReloadStore();
+
+    // "*.dat" files created or modified in legacy directory, parsed in
+    //   parallel. Only record current files if bRecordOnly is true.
+    QVector<OverlayScheme::Ptr> ReadLegacyFiles(bool bRecordOnly);
+
+    void WritePending();
+
+    // The following run on the GUI thread.
+
+    void OnLoaded(QVector<ProfileHeader> headers);
+
+    // Decode profile on the I/O thread, for Get().
+    void LoadInBackground(QString name);
+    void OnProfileLoaded(QString name, OverlayScheme::Ptr scheme);
+
+    void ApplyStoreDelta(const StoreDelta &delta);
+
+    // Add or replace profile in memory, and notify.
+    void PutProfile(const ProfileHeader &header);
+
+    // Remove profile from memory, and notify.
+    void TakeProfile(QString name);
+
+    // Position of name in m_order, or where it would be inserted.
+    int LowerBound(QString name) const;
+
+    // nullptr scheme removes the profile.
+    void QueueWrite(QString name, OverlayScheme::Ptr scheme);
+    void QueueWrites(const QHash<QString, OverlayScheme::Ptr> &writes);
+
+    // Written or about to be written, not readable from store yet.
+    //   Return false if there is no such write.
+    bool FindUnwritten(QString name, OverlayScheme::Ptr *scheme = nullptr) const;
+
+    // Watched paths may be dropped when a file is replaced.
+    void WatchPaths();
+
+    static ProfileRepository *s_instance;
+
+    QString m_storePath;
+    QString m_legacyDir;
+
+    // GUI thread.
+    bool m_bLoaded = false;
+    QElapsedTimer m_loadTimer;
+    QHash<QString, Entry> m_profiles;
+    QHash<int, QString> m_names;    // Id -> name.
+    QVector<QString> m_order;       // Names, sorted.
+    int m_nextId = 0;
+
+    // Decoded profiles, by name.
+    QCache<QString, OverlayScheme::Ptr> m_cache;
+    QSet<QString> m_loading;
+
+    QFileSystemWatcher m_watcher;
+    QTimer m_timerReload;
+
+    // I/O thread, except ProfileStore::Load() by Read().
+    QThreadPool m_ioPool;
+    std::unique_ptr<ProfileStore> m_store;
+    QHash<QString, uint> m_fingerprints;
+    FileState m_storeState;
+    QHash<QString, FileState> m_legacyFileStates;   // File name -> state.
+
+    // Both threads.
+    mutable QMutex m_pendingMutex;
+    QHash<QString, OverlayScheme::Ptr> m_pendingWrites;
+    QHash<QString, OverlayScheme::Ptr> m_writingWrites;
+    bool m_bWriteScheduled = false;
+};
+
+#endif // PROFILEREPOSITORY_H
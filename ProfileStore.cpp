@@ -0,0 +1,613 @@
+#define MYLOG_MODULE LogModule::Profiles
+
+#include "ProfileStore.h"
+#include "SchemeCodec.h"
+#include "mylog/mylog.h"
+
+#include <QDir>
+#include <QSaveFile>
+#include <QtConcurrent>
+#include <QtEndian>
+#include <algorithm>
+
+#define PACK_MAGIC_NUMBER       0x50464C4D  // "MLFP"
+#define PACK_FORMAT_VERSION     2
+
+// Header: magic(4) format version(2) reserved(10).
+#define PACK_HEADER_SIZE        16
+
+// Record: flags(4) scheme size(4) crc32 of both(4), then the scheme encoded
+//   by EncodeScheme(), which has a checksum of its own. Little endian. A
+//   tombstone holds a scheme with only the name.
+#define REC_OFF_FLAGS           0   // quint32, REC_FLAG_*.
+#define REC_OFF_SCHEME_SIZE     4   // quint32.
+#define REC_OFF_HEADER_CRC      8   // quint32.
+#define REC_HEADER_SIZE         12
+
+#define REC_FLAG_LIVE           0x1 // Not set for tombstones.
+
+// Larger sizes are taken for garbage, a scheme is far smaller.
+#define REC_MAX_SCHEME_SIZE     (64 * 1024)
+
+// Format 1, read to be upgraded: the header has the record size at offset 6,
+//   records are fixed-size with a name of at most 64 characters.
+#define V1_OFF_FLAGS            0   // quint32, V1_FLAG_* and REC_FLAG_LIVE.
+#define V1_OFF_VERSION          4   // qint32, OverlayScheme::version.
+#define V1_OFF_HLINE_WIDTH      8   // qint32.
+#define V1_OFF_VLINE_WIDTH      12  // qint32.
+#define V1_OFF_HLINE_COLOR      16  // quint32, QRgb.
+#define V1_OFF_VLINE_COLOR      20  // quint32, QRgb.
+#define V1_OFF_INVERTED_COLOR   24  // quint32, QRgb.
+#define V1_OFF_NAME_LENGTH      28  // quint16, then 2 bytes reserved.
+#define V1_OFF_NAME             32  // UTF-16 code units.
+#define V1_MAX_NAME_LENGTH      64
+#define V1_RECORD_SIZE          (V1_OFF_NAME + V1_MAX_NAME_LENGTH * 2)
+
+#define V1_FLAG_HLINE           0x2
+#define V1_FLAG_VLINE           0x4
+
+// Compact once stale records reach this count and outnumber live ones.
+#define PACK_COMPACT_MIN_STALE  64
+
+static QByteArray EncodeHeader()
+{
+    QByteArray header(PACK_HEADER_SIZE, '\0');
+    uchar *p = reinterpret_cast<uchar *>(header.data());
+
+    qToLittleEndian<quint32>(PACK_MAGIC_NUMBER, p);
+    qToLittleEndian<quint16>(PACK_FORMAT_VERSION, p + 4);
+
+    return header;
+}
+
+// Magic number is checked by caller.
+static bool IsHeaderSupported(const uchar *p)
+{
+    quint16 formatVersion = qFromLittleEndian<quint16>(p + 4);
+
+    return formatVersion == PACK_FORMAT_VERSION
+        || (formatVersion == 1 && qFromLittleEndian<quint16>(p + 6) == V1_RECORD_SIZE);
+}
+
+static QByteArray EncodeRecord(const OverlayScheme &scheme, bool bLive)
+{
+    QByteArray data = EncodeScheme(scheme);
+
+    QByteArray record(REC_HEADER_SIZE, '\0');
+    uchar *p = reinterpret_cast<uchar *>(record.data());
+    qToLittleEndian<quint32>(bLive ? REC_FLAG_LIVE : 0, p + REC_OFF_FLAGS);
+    qToLittleEndian<quint32>(data.size(), p + REC_OFF_SCHEME_SIZE);
+    qToLittleEndian<quint32>(Crc32(p, REC_OFF_HEADER_CRC), p + REC_OFF_HEADER_CRC);
+
+    return record + data;
+}
+
+static OverlayScheme::Ptr DecodeV1Record(const uchar *p)
+{
+    OverlayScheme::Ptr scheme = std::make_shared<OverlayScheme>();
+
+    quint32 flags = qFromLittleEndian<quint32>(p + V1_OFF_FLAGS);
+    int nameLength = qMin<int>(qFromLittleEndian<quint16>(p + V1_OFF_NAME_LENGTH), V1_MAX_NAME_LENGTH);
+
+    scheme->version = qFromLittleEndian<qint32>(p + V1_OFF_VERSION);
+    scheme->schemeName.resize(nameLength);
+    for (int i = 0; i != nameLength; ++i) {
+        scheme->schemeName[i] = QChar(qFromLittleEndian<quint16>(p + V1_OFF_NAME + i * 2));
+    }
+    scheme->bEnableHLine = (flags & V1_FLAG_HLINE) != 0;
+    scheme->hLineWidth = qFromLittleEndian<qint32>(p + V1_OFF_HLINE_WIDTH);
+    scheme->hLineColor = QColor::fromRgba(qFromLittleEndian<quint32>(p + V1_OFF_HLINE_COLOR));
+    scheme->bEnableVLine = (flags & V1_FLAG_VLINE) != 0;
+    scheme->vLineWidth = qFromLittleEndian<qint32>(p + V1_OFF_VLINE_WIDTH);
+    scheme->vLineColor = QColor::fromRgba(qFromLittleEndian<quint32>(p + V1_OFF_VLINE_COLOR));
+    scheme->invertedBgColor = QColor::fromRgba(qFromLittleEndian<quint32>(p + V1_OFF_INVERTED_COLOR));
+
+    return scheme;
+}
+
+ProfileStore::~ProfileStore()
+{
+    Unmap();
+}
+
+bool ProfileStore::Open(QString filePath, QString legacyDir)
+{
+    QWriteLocker locker(&m_lock);
+
+    m_filePath = filePath;
+
+    if (!QFile::exists(m_filePath) && !Migrate(legacyDir)) {
+        return false;
+    }
+
+    MapResult result = Map(true);
+    if (result == MapResult::Ok) {
+        // An old format stays readable if it cannot be upgraded now.
+        if (m_formatVersion != PACK_FORMAT_VERSION) {
+            Upgrade();
+        }
+        return true;
+    }
+    if (result == MapResult::Failed) {
+        // A file which cannot be read now, or is written by a newer version,
+        //   is left as it is.
+        return false;
+    }
+
+    // Keep the corrupt file for inspection, and start over. Earlier ones are
+    //   kept too.
+    QString badPath = m_filePath + ".bad";
+    for (int i = 2; QFile::exists(badPath); ++i) {
+        badPath = QString("%1.bad%2").arg(m_filePath).arg(i);
+    }
+    if (!QFile::rename(m_filePath, badPath)) {
+        L_ERROR("Move corrupt profile store failed: {}", m_filePath);
+        return false;
+    }
+    L_ERROR("Corrupt profile store: {}. Moved to: {}", m_filePath, badPath);
+
+    return WriteAll({}) && Map(true) == MapResult::Ok;
+}
+
+QVector<OverlayScheme::Ptr> ProfileStore::LoadAll()
+{
+    QReadLocker locker(&m_lock);
+
+    return DecodeAll();
+}
+
+QVector<ProfileHeader> ProfileStore::LoadHeaders()
+{
+    QReadLocker locker(&m_lock);
+
+    QVector<ProfileHeader> headers;
+    headers.reserve(m_index.size());
+    for (const IndexEntry &entry : m_index) {
+        headers.push_back(entry.header);
+    }
+
+    return headers;
+}
+
+ProfileHeader ProfileStore::LoadHeader(QString name)
+{
+    QReadLocker locker(&m_lock);
+
+    return m_index.value(name).header;
+}
+
+QVector<OverlayScheme::Ptr> ProfileStore::DecodeAll() const
+{
+    QVector<qint64> offsets;
+    offsets.reserve(m_index.size());
+    for (const IndexEntry &entry : m_index) {
+        offsets.push_back(entry.offset);
+    }
+
+    // Records are independent, decode them on all cores.
+    QVector<OverlayScheme::Ptr> profiles = QtConcurrent::blockingMapped<QVector<OverlayScheme::Ptr>>(
+        offsets, [this](qint64 offset) { return DecodeAt(offset); });
+
+    // Checked when scanned, only a file changed since then fails here.
+    profiles.removeAll(nullptr);
+
+    // Same order as the old per-file directory listing.
+    std::sort(profiles.begin(), profiles.end(),
+        [](const OverlayScheme::Ptr &a, const OverlayScheme::Ptr &b) {
+            return a->schemeName.compare(b->schemeName, Qt::CaseInsensitive) < 0;
+        });
+
+    return profiles;
+}
+
+OverlayScheme::Ptr ProfileStore::Load(QString name) const
+{
+    QReadLocker locker(&m_lock);
+
+    auto it = m_index.constFind(name);
+    if (it == m_index.constEnd()) {
+        return nullptr;
+    }
+
+    return DecodeAt(it->offset);
+}
+
+bool ProfileStore::Contains(QString name) const
+{
+    QReadLocker locker(&m_lock);
+
+    return m_index.contains(name);
+}
+
+bool ProfileStore::Save(OverlayScheme::Ptr scheme)
+{
+    return SaveAll({ scheme });
+}
+
+bool ProfileStore::SaveAll(const QVector<OverlayScheme::Ptr> &schemes)
+{
+    for (const OverlayScheme::Ptr &scheme : schemes) {
+        if (scheme->schemeName.isEmpty() || scheme->schemeName.size() > PROFILE_STORE_MAX_NAME_LENGTH) {
+            L_ERROR("Invalid profile name length: {}", scheme->schemeName.size());
+            return false;
+        }
+    }
+
+    QWriteLocker locker(&m_lock);
+
+    if (!IsWritable()) {
+        return false;
+    }
+
+    QByteArray records;
+    QVector<qint64> offsets;
+    offsets.reserve(schemes.size());
+    for (const OverlayScheme::Ptr &scheme : schemes) {
+        offsets.push_back(m_validSize + records.size());
+        records += EncodeRecord(*scheme, true);
+    }
+
+    if (!Append(records)) {
+        return false;
+    }
+
+    for (int i = 0; i != schemes.size(); ++i) {
+        const QString &name = schemes[i]->schemeName;
+        if (m_index.contains(name)) {
+            ++m_staleCount;
+        }
+        m_index[name] = IndexEntry{ offsets[i], ProfileHeader::FromScheme(*schemes[i]) };
+    }
+
+    CompactIfNeeded();
+
+    return true;
+}
+
+bool ProfileStore::Remove(QString name)
+{
+    QWriteLocker locker(&m_lock);
+
+    if (!m_index.contains(name)) {
+        return true;
+    }
+    if (!IsWritable()) {
+        return false;
+    }
+
+    OverlayScheme tombstone;
+    tombstone.schemeName = name;
+    if (!Append(EncodeRecord(tombstone, false))) {
+        return false;
+    }
+
+    // The removed record and the tombstone itself.
+    m_index.remove(name);
+    m_staleCount += 2;
+
+    CompactIfNeeded();
+
+    return true;
+}
+
+bool ProfileStore::Reload()
+{
+    QWriteLocker locker(&m_lock);
+
+    return Map(true) == MapResult::Ok;
+}
+
+uint ProfileStore::Fingerprint(QString name) const
+{
+    QReadLocker locker(&m_lock);
+
+    auto it = m_index.constFind(name);
+    if (it == m_index.constEnd()) {
+        return 0;
+    }
+
+    return qHashBits(m_data + it->offset, RecordSizeAt(it->offset));
+}
+
+QHash<QString, uint> ProfileStore::Fingerprints() const
+{
+    QReadLocker locker(&m_lock);
+
+    QHash<QString, uint> fingerprints;
+    fingerprints.reserve(m_index.size());
+
+    for (auto it = m_index.constBegin(); it != m_index.constEnd(); ++it) {
+        fingerprints.insert(it.key(), qHashBits(m_data + it->offset, RecordSizeAt(it->offset)));
+    }
+
+    return fingerprints;
+}
+
+ProfileStore::MapResult ProfileStore::Map(bool bScan)
+{
+    MapResult result = MapFile();
+    if (result != MapResult::Ok) {
+        // No records to index, and none to be appended to.
+        Unmap();
+        m_index.clear();
+        m_staleCount = 0;
+        return result;
+    }
+
+    // A partly written record at the end is ignored, and cut by next append.
+    qint64 size = m_file.size();
+    m_validSize = size;
+    qint64 offset = PACK_HEADER_SIZE;
+    for (qint64 recordSize; (recordSize = RecordSizeAt(offset)) != 0; ) {
+        offset += recordSize;
+    }
+    if (offset != size) {
+        L_WARN("Ignore incomplete or damaged records at end of profile store: {} bytes", size - offset);
+    }
+    m_validSize = offset;
+
+    if (bScan) {
+        ScanRecords();
+    }
+
+    return MapResult::Ok;
+}
+
+ProfileStore::MapResult ProfileStore::MapFile()
+{
+    Unmap();
+
+    m_file.setFileName(m_filePath);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        L_ERROR("Open profile store failed: {}, {}", m_filePath, m_file.errorString());
+        return MapResult::Failed;
+    }
+
+    // The file is always replaced whole with its header, never left shorter.
+    qint64 size = m_file.size();
+    if (size < PACK_HEADER_SIZE) {
+        return MapResult::Corrupt;
+    }
+
+    m_data = m_file.map(0, size);
+    if (m_data == nullptr) {
+        L_ERROR("Map profile store failed: {}, {}", m_filePath, m_file.errorString());
+        return MapResult::Failed;
+    }
+
+    if (qFromLittleEndian<quint32>(m_data) != PACK_MAGIC_NUMBER) {
+        return MapResult::Corrupt;
+    }
+
+    if (!IsHeaderSupported(m_data)) {
+        L_ERROR("Unsupported profile store: {}, format version: {}", m_filePath,
+            qFromLittleEndian<quint16>(m_data + 4));
+        return MapResult::Failed;
+    }
+    m_formatVersion = qFromLittleEndian<quint16>(m_data + 4);
+
+    return MapResult::Ok;
+}
+
+void ProfileStore::Unmap()
+{
+    if (m_data != nullptr) {
+        m_file.unmap(const_cast<uchar *>(m_data));
+        m_data = nullptr;
+    }
+
+    m_file.close();
+}
+
+void ProfileStore::ScanRecords()
+{
+    m_index.clear();
+    m_staleCount = 0;
+
+    QVector<qint64> offsets;
+    for (qint64 offset = PACK_HEADER_SIZE; offset < m_validSize; offset += RecordSizeAt(offset)) {
+        offsets.push_back(offset);
+    }
+
+    // Records are checked on all cores, and only their headers decoded. Then
+    //   they are indexed in file order, where the last record of a name wins.
+    QVector<ProfileHeader> headers = QtConcurrent::blockingMapped<QVector<ProfileHeader>>(
+        offsets, [this](qint64 offset) { return DecodeHeaderAt(offset); });
+
+    for (int i = 0; i != offsets.size(); ++i) {
+        qint64 offset = offsets[i];
+
+        // A damaged record loses only itself, the checksum tells.
+        if (headers[i].name.isEmpty()) {
+            L_WARN("Skip damaged profile record at: {}", offset);
+            ++m_staleCount;
+            continue;
+        }
+
+        const QString &name = headers[i].name;
+        bool bLive = (qFromLittleEndian<quint32>(m_data + offset + REC_OFF_FLAGS) & REC_FLAG_LIVE) != 0;
+
+        auto it = m_index.find(name);
+        if (it != m_index.end()) {
+            ++m_staleCount;
+            if (!bLive) {
+                m_index.erase(it);
+            }
+        }
+
+        if (bLive) {
+            m_index[name] = IndexEntry{ offset, headers[i] };
+        } else {
+            ++m_staleCount;
+        }
+    }
+
+    L_INFO("Profile store scanned. profiles: {}, stale records: {}", m_index.size(), m_staleCount);
+}
+
+qint64 ProfileStore::RecordSizeAt(qint64 offset) const
+{
+    if (m_formatVersion == 1) {
+        return offset + V1_RECORD_SIZE <= m_validSize ? V1_RECORD_SIZE : 0;
+    }
+
+    // A damaged record header leaves no way to find the next record.
+    const uchar *p = m_data + offset;
+    if (offset + REC_HEADER_SIZE > m_validSize
+            || Crc32(p, REC_OFF_HEADER_CRC) != qFromLittleEndian<quint32>(p + REC_OFF_HEADER_CRC)) {
+        return 0;
+    }
+
+    qint64 schemeSize = qFromLittleEndian<quint32>(p + REC_OFF_SCHEME_SIZE);
+    if (schemeSize > REC_MAX_SCHEME_SIZE || offset + REC_HEADER_SIZE + schemeSize > m_validSize) {
+        return 0;
+    }
+
+    return REC_HEADER_SIZE + schemeSize;
+}
+
+OverlayScheme::Ptr ProfileStore::DecodeAt(qint64 offset) const
+{
+    const uchar *p = m_data + offset;
+    if (m_formatVersion == 1) {
+        return DecodeV1Record(p);
+    }
+
+    // No copy, the mapping outlives the decoding.
+    int schemeSize = qFromLittleEndian<quint32>(p + REC_OFF_SCHEME_SIZE);
+    return DecodeScheme(QByteArray::fromRawData(
+        reinterpret_cast<const char *>(p + REC_HEADER_SIZE), schemeSize));
+}
+
+ProfileHeader ProfileStore::DecodeHeaderAt(qint64 offset) const
+{
+    const uchar *p = m_data + offset;
+    if (m_formatVersion == 1) {
+        return ProfileHeader::FromScheme(*DecodeV1Record(p));
+    }
+
+    ProfileHeader header;
+    int schemeSize = qFromLittleEndian<quint32>(p + REC_OFF_SCHEME_SIZE);
+    if (!DecodeSchemeHeader(QByteArray::fromRawData(
+            reinterpret_cast<const char *>(p + REC_HEADER_SIZE), schemeSize), &header)) {
+        return ProfileHeader();
+    }
+
+    return header;
+}
+
+bool ProfileStore::IsWritable()
+{
+    if (!IsMapped()) {
+        return false;
+    }
+
+    // Records of the current format are never appended to an older file.
+    return m_formatVersion == PACK_FORMAT_VERSION || Upgrade();
+}
+
+bool ProfileStore::Upgrade()
+{
+    L_INFO("Upgrade profile store from format {}: {}", m_formatVersion, m_filePath);
+
+    QVector<OverlayScheme::Ptr> profiles = DecodeAll();
+    bool bOk = WriteAll(profiles);
+
+    // Old file is still in place if writing failed.
+    return Map(true) == MapResult::Ok && bOk;
+}
+
+bool ProfileStore::Append(const QByteArray &record)
+{
+    qint64 validSize = m_validSize;
+
+    // The file cannot be extended while mapped on every platform.
+    Unmap();
+
+    QFile file(m_filePath);
+    bool bOk = file.open(QIODevice::ReadWrite)
+        && (file.size() == validSize || file.resize(validSize))
+        && file.seek(validSize)
+        && file.write(record) == record.size();
+    file.close();
+
+    if (!bOk) {
+        L_ERROR("Append to profile store failed: {}", file.errorString());
+    }
+
+    // Index is updated by caller.
+    return Map(false) == MapResult::Ok && bOk;
+}
+
+bool ProfileStore::WriteAll(const QVector<OverlayScheme::Ptr> &schemes)
+{
+    Unmap();
+
+    QSaveFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        L_ERROR("Create profile store failed: {}", m_filePath);
+        return false;
+    }
+
+    file.write(EncodeHeader());
+    for (const OverlayScheme::Ptr &scheme : schemes) {
+        file.write(EncodeRecord(*scheme, true));
+    }
+
+    if (!file.commit()) {
+        L_ERROR("Write profile store failed: {}", file.errorString());
+        return false;
+    }
+
+    return true;
+}
+
+void ProfileStore::CompactIfNeeded()
+{
+    if (m_staleCount < PACK_COMPACT_MIN_STALE || m_staleCount <= m_index.size()) {
+        return;
+    }
+
+    L_INFO("Compact profile store. profiles: {}, stale records: {}", m_index.size(), m_staleCount);
+
+    QVector<OverlayScheme::Ptr> profiles = DecodeAll();
+    if (WriteAll(profiles)) {
+        Map(true);
+    } else {
+        // Old file is still in place.
+        Map(false);
+    }
+}
+
+bool ProfileStore::Migrate(QString legacyDir)
+{
+    QVector<OverlayScheme::Ptr> profiles;
+
+    QDir dir(legacyDir);
+    QStringList files = dir.entryList(QStringList() << "*.dat", QDir::Files);
+    for (const QString &fileName : files) {
+        OverlayScheme::Ptr scheme = LoadSchemeFromFile(dir.absoluteFilePath(fileName));
+        if (!scheme) {
+            L_WARN("Skip unreadable profile: {}", fileName);
+            continue;
+        }
+        if (scheme->schemeName.isEmpty()) {
+            L_WARN("Skip profile without name: {}", fileName);
+            continue;
+        }
+
+        // Only a file of the QDataStream format can have such a name. The
+        //   file stays, and is imported once changed to a shorter name.
+        if (scheme->schemeName.size() > PROFILE_STORE_MAX_NAME_LENGTH) {
+            L_ERROR("Skip profile with name too long for store: {}, length: {}",
+                fileName, scheme->schemeName.size());
+            continue;
+        }
+
+        profiles.push_back(scheme);
+    }
+
+    L_INFO("Migrate {} profiles from {} to {}", profiles.size(), legacyDir, m_filePath);
+
+    return WriteAll(profiles);
+}
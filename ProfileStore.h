@@ -0,0 +1,141 @@
+#ifndef PROFILESTORE_H
+#define PROFILESTORE_H
+
+#include "OverlayScheme.h"
+#include "SchemeCodec.h"
+
+#include <QColor>
+#include <QFile>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+#include <QVector>
+
+// Longest profile name the store can hold, in UTF-16 code units.
+#define PROFILE_STORE_MAX_NAME_LENGTH SCHEME_MAX_NAME_LENGTH
+
+// All profiles in one packed file.
+//
+// The file is a small header followed by records, each a size-prefixed
+//   scheme in the format of EncodeScheme(), so fields added to schemes are
+//   stored too, and each record is checksummed on its own. Saving a profile
+//   appends a record and the last record of a name wins; deleting appends a
+//   tombstone. Once stale records outnumber live ones, the file is compacted
+//   and replaced atomically. Records are decoded straight from a read-only
+//   mapping of the file. Scanning the file checks each record, but decodes
+//   only its header, which the index keeps; whole profiles are decoded by
+//   Load(). Files of the first, fixed-size record format are upgraded when
+//   opened.
+//
+// Load(), Contains() and Fingerprint() may be called from any thread. Everything else
+//   must come from one thread at a time. Access is virtual, for stand-ins in
+//   checks.
+class ProfileStore
+{
+public:
+    ProfileStore() = default;
+    virtual ~ProfileStore();
+
+    // Open store file. If it does not exist yet, it is created from the
+    //   "*.dat" profile files in legacyDir, leaving out those with names too
+    //   long for the store. A file found to be corrupt is
+    //   renamed to "*.bad" and replaced by an empty store. A file which
+    //   cannot be opened, or has an unknown format, is not touched; false is
+    //   returned and nothing can be saved until Reload() succeeds.
+    virtual bool Open(QString filePath, QString legacyDir);
+
+    // All profiles, sorted by name.
+    virtual QVector<OverlayScheme::Ptr> LoadAll();
+
+    // Headers of all profiles, not sorted. Kept in the index, nothing is
+    //   decoded.
+    virtual QVector<ProfileHeader> LoadHeaders();
+
+    // Header of profile by name. Name is empty if not found.
+    virtual ProfileHeader LoadHeader(QString name);
+
+    // Profile by name. nullptr if not found.
+    virtual OverlayScheme::Ptr Load(QString name) const;
+
+    virtual bool Contains(QString name) const;
+
+    // Create or update profile.
+    bool Save(OverlayScheme::Ptr scheme);
+
+    // Create or update profiles, appended in one write. Nothing is saved if
+    //   a name is invalid.
+    virtual bool SaveAll(const QVector<OverlayScheme::Ptr> &schemes);
+
+    virtual bool Remove(QString name);
+
+    // Rebuild index from file, after it was changed by someone else.
+    virtual bool Reload();
+
+    // Hash of the raw record of a profile, 0 if not found. Tells whether a
+    //   profile changed without decoding it.
+    virtual uint Fingerprint(QString name) const;
+    virtual QHash<QString, uint> Fingerprints() const;
+
+private:
+    enum class MapResult {
+        Ok,
+        Failed,     // Cannot be read now, or unknown format version.
+        Corrupt,    // Not a profile store.
+    };
+
+    // Map the file. Rebuild index if bScan is true. The index is cleared
+    //   if mapping fails.
+    MapResult Map(bool bScan);
+    MapResult MapFile();
+    void Unmap();
+
+    bool IsMapped() const { return m_data != nullptr; }
+
+    void ScanRecords();
+
+    // Size of record at offset, 0 if it does not fit in the valid size.
+    qint64 RecordSizeAt(qint64 offset) const;
+
+    // nullptr if the record is damaged.
+    OverlayScheme::Ptr DecodeAt(qint64 offset) const;
+
+    // Name is empty if the record is damaged.
+    ProfileHeader DecodeHeaderAt(qint64 offset) const;
+
+    // Mapped, in the current format. Upgrade if needed.
+    bool IsWritable();
+
+    // Rewrite file in the current format.
+    bool Upgrade();
+
+    QVector<OverlayScheme::Ptr> DecodeAll() const;
+
+    bool Append(const QByteArray &record);
+
+    // Write schemes as a new compacted file, replacing the old one atomically.
+    bool WriteAll(const QVector<OverlayScheme::Ptr> &schemes);
+
+    void CompactIfNeeded();
+
+    bool Migrate(QString legacyDir);
+
+    QString m_filePath;
+    QFile m_file;
+
+    // Held for writing while mapping or index change.
+    mutable QReadWriteLock m_lock;
+
+    const uchar *m_data = nullptr;
+    qint64 m_validSize = 0;     // Header and complete records.
+    int m_formatVersion = 0;
+
+    struct IndexEntry {
+        qint64 offset = 0;
+        ProfileHeader header;
+    };
+
+    QHash<QString, IndexEntry> m_index;     // Profile name -> live record.
+    int m_staleCount = 0;                   // Overwritten records and tombstones.
+};
+
+#endif // PROFILESTORE_H
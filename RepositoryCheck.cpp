@@ -0,0 +1,191 @@
+#define MYLOG_MODULE LogModule::Profiles
+
+#include "RepositoryCheck.h"
+#include "ProfileRepository.h"
+#include "ProfileStore.h"
+#include "mylog/mylog.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QThread>
+#include <QTimer>
+
+// Time each access of the slow store takes.
+#define SLOW_STORE_DELAY_MS     300
+
+// Longest the GUI thread may go without handling events.
+#define SLOW_STORE_MAX_STALL_MS 100
+
+// Interval of the responsiveness probe.
+#define SLOW_STORE_PROBE_MS     10
+
+// Longest wait for a step.
+#define SLOW_STORE_TIMEOUT_MS   10000
+
+#define SLOW_STORE_PROFILES     200
+
+// Each is a slow write.
+#define SLOW_STORE_CHANGES      5
+#define SLOW_STORE_REMOVALS     3
+
+// Store on a slow drive: every access waits first.
+class SlowProfileStore : public ProfileStore
+{
+public:
+    bool Open(QString filePath, QString legacyDir) override
+    {
+        Wait();
+        return ProfileStore::Open(filePath, legacyDir);
+    }
+
+    QVector<ProfileHeader> LoadHeaders() override
+    {
+        Wait();
+        return ProfileStore::LoadHeaders();
+    }
+
+    OverlayScheme::Ptr Load(QString name) const override
+    {
+        Wait();
+        return ProfileStore::Load(name);
+    }
+
+    bool SaveAll(const QVector<OverlayScheme::Ptr> &schemes) override
+    {
+        Wait();
+        return ProfileStore::SaveAll(schemes);
+    }
+
+    bool Remove(QString name) override
+    {
+        Wait();
+        return ProfileStore::Remove(name);
+    }
+
+    bool Reload() override
+    {
+        Wait();
+        return ProfileStore::Reload();
+    }
+
+private:
+    static void Wait()
+    {
+        QThread::msleep(SLOW_STORE_DELAY_MS);
+    }
+};
+
+static QString GetProfileName(int i)
+{
+    return QString("Slow profile %1").arg(i, 3, 10, QChar('0'));
+}
+
+// Run events until bDone, or timeout. Return bDone.
+static bool WaitFor(const bool &bDone)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    while (!bDone && timer.elapsed() < SLOW_STORE_TIMEOUT_MS) {
+        QEventLoop loop;
+        QTimer::singleShot(SLOW_STORE_PROBE_MS, &loop, &QEventLoop::quit);
+        loop.exec();
+    }
+
+    return bDone;
+}
+
+bool CheckSlowStore(QString workDir)
+{
+    QVector<OverlayScheme::Ptr> schemes;
+    for (int i = 0; i != SLOW_STORE_PROFILES; ++i) {
+        OverlayScheme::Ptr scheme = std::make_shared<OverlayScheme>();
+        scheme->schemeName = GetProfileName(i);
+        schemes.push_back(scheme);
+    }
+
+    QString storePath = QDir(workDir).filePath("profiles.pack");
+    QString legacyDir = QDir(workDir).filePath("profiles");
+    QDir(legacyDir).mkpath(".");
+    {
+        ProfileStore store;
+        if (!store.Open(storePath, legacyDir) || !store.SaveAll(schemes)) {
+            L_ERROR("Write store for slow store check failed: {}", storePath);
+            return false;
+        }
+    }
+
+    // Longest gap between two probes, on this thread.
+    QElapsedTimer probeClock;
+    qint64 maxStallMs = 0;
+    QTimer probe;
+    probe.setInterval(SLOW_STORE_PROBE_MS);
+    QObject::connect(&probe, &QTimer::timeout, [&]() {
+        maxStallMs = qMax(maxStallMs, probeClock.restart());
+    });
+    probeClock.start();
+    probe.start();
+
+    int failures = 0;
+    int changedCount = SLOW_STORE_CHANGES;
+    int removedCount = SLOW_STORE_REMOVALS;
+    {
+        ProfileRepository profiles(workDir, new SlowProfileStore);
+
+        bool bLoaded = false;
+        QObject::connect(&profiles, &ProfileRepository::SigLoaded, [&]() { bLoaded = true; });
+        if (!WaitFor(bLoaded) || profiles.Count() != SLOW_STORE_PROFILES) {
+            L_ERROR("Slow store not loaded. profiles: {}", profiles.Count());
+            ++failures;
+        }
+
+        // A miss returns at once, the profile follows.
+        QString name = GetProfileName(0);
+        bool bProfileLoaded = false;
+        QObject::connect(&profiles, &ProfileRepository::SigProfileLoaded, [&]() { bProfileLoaded = true; });
+        if (!profiles.Get(name) && (!WaitFor(bProfileLoaded) || !profiles.Get(name))) {
+            L_ERROR("Profile not decoded from slow store: {}", name);
+            ++failures;
+        }
+
+        // Bulk changes are visible at once, and written behind.
+        for (int i = 0; i != changedCount; ++i) {
+            OverlayScheme::Ptr changed = std::make_shared<OverlayScheme>(*schemes[i]);
+            changed->hLineWidth = SCHEME_MAX_LINE_WIDTH;
+            profiles.Save(changed);
+        }
+        for (int i = SLOW_STORE_PROFILES - removedCount; i != SLOW_STORE_PROFILES; ++i) {
+            profiles.Remove(GetProfileName(i));
+        }
+        if (profiles.Count() != SLOW_STORE_PROFILES - removedCount) {
+            L_ERROR("Bulk changes not visible. profiles: {}", profiles.Count());
+            ++failures;
+        }
+
+        // Let writes and the reload they cause run for a while.
+        bool bSettled = false;
+        QTimer::singleShot(SLOW_STORE_DELAY_MS * 4, [&]() { bSettled = true; });
+        WaitFor(bSettled);
+
+        probe.stop();
+    }
+
+    if (maxStallMs > SLOW_STORE_MAX_STALL_MS) {
+        L_ERROR("GUI thread stalled by slow store: {} ms", maxStallMs);
+        ++failures;
+    }
+
+    // Everything is written once the repository is gone.
+    ProfileStore store;
+    OverlayScheme::Ptr changed = store.Open(storePath, legacyDir) ? store.Load(GetProfileName(0)) : nullptr;
+    if (!changed || changed->hLineWidth != SCHEME_MAX_LINE_WIDTH
+            || store.LoadHeaders().size() != SLOW_STORE_PROFILES - removedCount) {
+        L_ERROR("Changes to slow store not written");
+        ++failures;
+    }
+
+    L_INFO("Slow store check {}, longest GUI thread stall: {} ms", failures == 0 ? "passed" : "FAILED", maxStallMs);
+
+    return failures == 0;
+}
@@ -0,0 +1,13 @@
+#ifndef REPOSITORYCHECK_H
+#define REPOSITORYCHECK_H
+
+#include <QString>
+
+// Check that the GUI thread stays responsive while profiles are loaded,
+//   decoded and written through a store which takes a long time for every
+//   access, as on a slow network drive. Profiles are written in workDir.
+//   Log each failure, return true if none. Needs the application's event
+//   loop thread.
+bool CheckSlowStore(QString workDir);
+
+#endif // REPOSITORYCHECK_H
@@ -0,0 +1,358 @@
+#include "SchemeCodec.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QtEndian>
+#include <array>
+
+#define SCHEME_FILE_MAGIC           0x53464C4D  // "MLFS"
+#define SCHEME_FORMAT_VERSION       2
+#define SCHEME_HEADER_SIZE          16
+#define SCHEME_FLAG_CANONICAL       0x1
+
+// Field tags. Never reuse a number.
+#define TAG_VERSION                 1
+#define TAG_NAME                    2
+#define TAG_HLINE_ENABLED           3
+#define TAG_HLINE_WIDTH             4
+#define TAG_HLINE_COLOR             5
+#define TAG_VLINE_ENABLED           6
+#define TAG_VLINE_WIDTH             7
+#define TAG_VLINE_COLOR             8
+#define TAG_INVERTED_BG_COLOR       9
+
+#define FIELD_HEADER_SIZE           4
+
+// Value offsets in a canonical payload: the fixed-size fields in tag order
+//   without the name, then the name.
+#define CANON_OFF_VERSION           4
+#define CANON_OFF_HLINE_ENABLED     12
+#define CANON_OFF_HLINE_WIDTH       17
+#define CANON_OFF_HLINE_COLOR       25
+#define CANON_OFF_VLINE_ENABLED     33
+#define CANON_OFF_VLINE_WIDTH       38
+#define CANON_OFF_VLINE_COLOR       46
+#define CANON_OFF_INVERTED_BG_COLOR 54
+#define CANON_OFF_NAME_FIELD        58
+#define CANON_FIXED_SIZE            (CANON_OFF_NAME_FIELD + FIELD_HEADER_SIZE)
+
+static const quint32 *GetCrc32Table()
+{
+    // Built once on first use, safe when first used by several threads.
+    static const std::array<quint32, 256> table = []() {
+        std::array<quint32, 256> crcs;
+        for (quint32 i = 0; i != 256; ++i) {
+            quint32 c = i;
+            for (int k = 0; k != 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            crcs[i] = c;
+        }
+        return crcs;
+    }();
+
+    return table.data();
+}
+
+quint32 Crc32(const void *data, qint64 size, quint32 crc)
+{
+    const quint32 *table = GetCrc32Table();
+    const uchar *p = static_cast<const uchar *>(data);
+
+    crc = ~crc;
+    for (qint64 i = 0; i != size; ++i) {
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+template <typename T>
+static void AppendField(QByteArray &payload, quint16 tag, T value)
+{
+    uchar field[FIELD_HEADER_SIZE + sizeof(T)];
+    qToLittleEndian<quint16>(tag, field);
+    qToLittleEndian<quint16>(sizeof(T), field + 2);
+    qToLittleEndian<T>(value, field + FIELD_HEADER_SIZE);
+
+    payload.append(reinterpret_cast<const char *>(field), sizeof(field));
+}
+
+static QString DecodeName(const uchar *p, int byteLength)
+{
+    int length = byteLength / 2;
+
+    QString name(length, Qt::Uninitialized);
+    QChar *chars = name.data();
+    for (int i = 0; i != length; ++i) {
+        chars[i] = QChar(qFromLittleEndian<quint16>(p + i * 2));
+    }
+
+    return name;
+}
+
+static bool IsNameLengthValid(int byteLength)
+{
+    return byteLength % 2 == 0 && byteLength / 2 <= SCHEME_MAX_NAME_LENGTH;
+}
+
+QByteArray EncodeScheme(const OverlayScheme &scheme)
+{
+    QByteArray payload;
+
+    // Canonical order, see CANON_OFF_*.
+    AppendField<qint32>(payload, TAG_VERSION, scheme.version);
+    AppendField<quint8>(payload, TAG_HLINE_ENABLED, scheme.bEnableHLine ? 1 : 0);
+    AppendField<qint32>(payload, TAG_HLINE_WIDTH, scheme.hLineWidth);
+    AppendField<quint32>(payload, TAG_HLINE_COLOR, scheme.hLineColor.rgba());
+    AppendField<quint8>(payload, TAG_VLINE_ENABLED, scheme.bEnableVLine ? 1 : 0);
+    AppendField<qint32>(payload, TAG_VLINE_WIDTH, scheme.vLineWidth);
+    AppendField<quint32>(payload, TAG_VLINE_COLOR, scheme.vLineColor.rgba());
+    AppendField<quint32>(payload, TAG_INVERTED_BG_COLOR, scheme.invertedBgColor.rgba());
+    Q_ASSERT(payload.size() == CANON_OFF_NAME_FIELD);
+
+    int nameLength = qMin(scheme.schemeName.size(), SCHEME_MAX_NAME_LENGTH);
+    uchar nameHeader[FIELD_HEADER_SIZE];
+    qToLittleEndian<quint16>(TAG_NAME, nameHeader);
+    qToLittleEndian<quint16>(nameLength * 2, nameHeader + 2);
+    payload.append(reinterpret_cast<const char *>(nameHeader), FIELD_HEADER_SIZE);
+
+    const ushort *name = scheme.schemeName.utf16();
+    for (int i = 0; i != nameLength; ++i) {
+        uchar c[2];
+        qToLittleEndian<quint16>(name[i], c);
+        payload.append(reinterpret_cast<const char *>(c), 2);
+    }
+
+    QByteArray data(SCHEME_HEADER_SIZE, '\0');
+    uchar *header = reinterpret_cast<uchar *>(data.data());
+    qToLittleEndian<quint32>(SCHEME_FILE_MAGIC, header);
+    qToLittleEndian<quint16>(SCHEME_FORMAT_VERSION, header + 4);
+    qToLittleEndian<quint16>(SCHEME_FLAG_CANONICAL, header + 6);
+    qToLittleEndian<quint32>(payload.size(), header + 8);
+    qToLittleEndian<quint32>(Crc32(payload.constData(), payload.size()), header + 12);
+
+    return data + payload;
+}
+
+// Byte length of the name in a canonical payload, -1 if it is not canonical
+//   after all.
+static int GetCanonicalNameLength(const uchar *p, qint64 size)
+{
+    if (size < CANON_FIXED_SIZE
+            || qFromLittleEndian<quint16>(p + CANON_OFF_NAME_FIELD) != TAG_NAME) {
+        return -1;
+    }
+
+    int nameByteLength = qFromLittleEndian<quint16>(p + CANON_OFF_NAME_FIELD + 2);
+    if (CANON_FIXED_SIZE + nameByteLength != size || !IsNameLengthValid(nameByteLength)) {
+        return -1;
+    }
+
+    return nameByteLength;
+}
+
+// Decode payload at fixed offsets. nullptr if it is not canonical after all.
+static OverlayScheme::Ptr DecodeCanonicalPayload(const uchar *p, qint64 size)
+{
+    int nameByteLength = GetCanonicalNameLength(p, size);
+    if (nameByteLength < 0) {
+        return nullptr;
+    }
+
+    OverlayScheme::Ptr scheme = std::make_shared<OverlayScheme>();
+
+    scheme->version = qFromLittleEndian<qint32>(p + CANON_OFF_VERSION);
+    scheme->bEnableHLine = p[CANON_OFF_HLINE_ENABLED] != 0;
+    scheme->hLineWidth = qFromLittleEndian<qint32>(p + CANON_OFF_HLINE_WIDTH);
+    scheme->hLineColor = QColor::fromRgba(qFromLittleEndian<quint32>(p + CANON_OFF_HLINE_COLOR));
+    scheme->bEnableVLine = p[CANON_OFF_VLINE_ENABLED] != 0;
+    scheme->vLineWidth = qFromLittleEndian<qint32>(p + CANON_OFF_VLINE_WIDTH);
+    scheme->vLineColor = QColor::fromRgba(qFromLittleEndian<quint32>(p + CANON_OFF_VLINE_COLOR));
+    scheme->invertedBgColor = QColor::fromRgba(qFromLittleEndian<quint32>(p + CANON_OFF_INVERTED_BG_COLOR));
+    scheme->schemeName = DecodeName(p + CANON_FIXED_SIZE, nameByteLength);
+
+    return scheme;
+}
+
+// Decode payload field by field, skipping unknown tags.
+static OverlayScheme::Ptr DecodeTaggedPayload(const uchar *p, qint64 size)
+{
+    OverlayScheme::Ptr scheme = std::make_shared<OverlayScheme>();
+
+    qint64 pos = 0;
+    while (pos < size) {
+        if (pos + FIELD_HEADER_SIZE > size) {
+            return nullptr;
+        }
+
+        quint16 tag = qFromLittleEndian<quint16>(p + pos);
+        int length = qFromLittleEndian<quint16>(p + pos + 2);
+        const uchar *value = p + pos + FIELD_HEADER_SIZE;
+
+        pos += FIELD_HEADER_SIZE + length;
+        if (pos > size) {
+            return nullptr;
+        }
+
+        // Known tags must have their exact size.
+        switch (tag) {
+        case TAG_VERSION:
+            if (length != 4) return nullptr;
+            scheme->version = qFromLittleEndian<qint32>(value);
+            break;
+        case TAG_NAME:
+            if (!IsNameLengthValid(length)) return nullptr;
+            scheme->schemeName = DecodeName(value, length);
+            break;
+        case TAG_HLINE_ENABLED:
+            if (length != 1) return nullptr;
+            scheme->bEnableHLine = value[0] != 0;
+            break;
+        case TAG_HLINE_WIDTH:
+            if (length != 4) return nullptr;
+            scheme->hLineWidth = qFromLittleEndian<qint32>(value);
+            break;
+        case TAG_HLINE_COLOR:
+            if (length != 4) return nullptr;
+            scheme->hLineColor = QColor::fromRgba(qFromLittleEndian<quint32>(value));
+            break;
+        case TAG_VLINE_ENABLED:
+            if (length != 1) return nullptr;
+            scheme->bEnableVLine = value[0] != 0;
+            break;
+        case TAG_VLINE_WIDTH:
+            if (length != 4) return nullptr;
+            scheme->vLineWidth = qFromLittleEndian<qint32>(value);
+            break;
+        case TAG_VLINE_COLOR:
+            if (length != 4) return nullptr;
+            scheme->vLineColor = QColor::fromRgba(qFromLittleEndian<quint32>(value));
+            break;
+        case TAG_INVERTED_BG_COLOR:
+            if (length != 4) return nullptr;
+            scheme->invertedBgColor = QColor::fromRgba(qFromLittleEndian<quint32>(value));
+            break;
+        default:
+            // Written by a newer version.
+            break;
+        }
+    }
+
+    return scheme;
+}
+
+// First format: QDataStream fields in fixed order.
+static OverlayScheme::Ptr DecodeLegacyScheme(const QByteArray &data)
+{
+    OverlayScheme::Ptr scheme = std::make_shared<OverlayScheme>();
+
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_0);
+    int magicNumber;
+
+    stream
+        >> magicNumber
+        >> scheme->version
+        >> scheme->schemeName
+        >> scheme->bEnableHLine >> scheme->hLineWidth >> scheme->hLineColor
+        >> scheme->bEnableVLine >> scheme->vLineWidth >> scheme->vLineColor
+        >> scheme->invertedBgColor
+        ;
+
+    if (magicNumber != SCHEME_MAGIC_NUMBER || stream.status() != QDataStream::Ok) {
+        return nullptr;
+    }
+
+    return scheme;
+}
+
+// Payload of data in the current format, checksum verified. nullptr if data
+//   is not valid.
+static const uchar *GetCheckedPayload(const QByteArray &data, qint64 *payloadSize, quint16 *flags)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data.constData());
+    qint64 size = data.size();
+
+    // Validate header before touching the payload.
+    if (size < SCHEME_HEADER_SIZE
+            || qFromLittleEndian<quint32>(p) != SCHEME_FILE_MAGIC
+            || qFromLittleEndian<quint16>(p + 4) != SCHEME_FORMAT_VERSION
+            || qFromLittleEndian<quint32>(p + 8) != size - SCHEME_HEADER_SIZE) {
+        return nullptr;
+    }
+
+    const uchar *payload = p + SCHEME_HEADER_SIZE;
+    *payloadSize = size - SCHEME_HEADER_SIZE;
+    if (Crc32(payload, *payloadSize) != qFromLittleEndian<quint32>(p + 12)) {
+        return nullptr;
+    }
+
+    *flags = qFromLittleEndian<quint16>(p + 6);
+    return payload;
+}
+
+static bool IsLegacyScheme(const QByteArray &data)
+{
+    return data.size() >= 4
+        && qFromBigEndian<qint32>(reinterpret_cast<const uchar *>(data.constData())) == SCHEME_MAGIC_NUMBER;
+}
+
+OverlayScheme::Ptr DecodeScheme(const QByteArray &data)
+{
+    if (IsLegacyScheme(data)) {
+        return DecodeLegacyScheme(data);
+    }
+
+    qint64 payloadSize = 0;
+    quint16 flags = 0;
+    const uchar *payload = GetCheckedPayload(data, &payloadSize, &flags);
+    if (!payload) {
+        return nullptr;
+    }
+
+    if (flags & SCHEME_FLAG_CANONICAL) {
+        OverlayScheme::Ptr scheme = DecodeCanonicalPayload(payload, payloadSize);
+        if (scheme) {
+            return scheme;
+        }
+    }
+
+    return DecodeTaggedPayload(payload, payloadSize);
+}
+
+bool DecodeSchemeHeader(const QByteArray &data, ProfileHeader *header)
+{
+    qint64 payloadSize = 0;
+    quint16 flags = 0;
+    const uchar *payload = IsLegacyScheme(data) ? nullptr : GetCheckedPayload(data, &payloadSize, &flags);
+
+    int nameByteLength = payload && (flags & SCHEME_FLAG_CANONICAL)
+        ? GetCanonicalNameLength(payload, payloadSize) : -1;
+    if (nameByteLength >= 0) {
+        header->name = DecodeName(payload + CANON_FIXED_SIZE, nameByteLength);
+        header->version = qFromLittleEndian<qint32>(payload + CANON_OFF_VERSION);
+        header->hLineColor = qFromLittleEndian<quint32>(payload + CANON_OFF_HLINE_COLOR);
+        header->vLineColor = qFromLittleEndian<quint32>(payload + CANON_OFF_VLINE_COLOR);
+        return true;
+    }
+
+    // Files of other writers are rare, and decoded whole.
+    OverlayScheme::Ptr scheme = DecodeScheme(data);
+    if (!scheme) {
+        return false;
+    }
+
+    *header = ProfileHeader::FromScheme(*scheme);
+    return true;
+}
+
+OverlayScheme::Ptr LoadSchemeFromFile(QString filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return nullptr;
+    }
+
+    return DecodeScheme(file.readAll());
+}
@@ -0,0 +1,60 @@
+#ifndef SCHEMECODEC_H
+#define SCHEMECODEC_H
+
+#include "OverlayScheme.h"
+
+#include <QByteArray>
+#include <QColor>
+#include <QString>
+
+// Scheme file format.
+//
+// Header (16 bytes, little endian):
+//   magic "MLFS"(4) format version(2) flags(2) payload size(4) payload crc32(4)
+// Payload: tagged fields, each as tag(2) length(2) value. Readers skip tags
+//   they do not know, so new fields can be added without a format version
+//   bump. Files written by EncodeScheme() use a canonical field order, which
+//   is decoded at fixed offsets.
+//
+// Files of the first format (QDataStream, SCHEME_MAGIC_NUMBER first) are
+//   still read.
+
+// Longest name a scheme can hold, in UTF-16 code units. Longer names are cut
+//   by EncodeScheme().
+#define SCHEME_MAX_NAME_LENGTH 1024
+
+// What a profile list shows, without decoding the whole profile.
+struct ProfileHeader {
+    QString name;
+    int version = 0;
+
+    // Thumbnail colors.
+    QRgb hLineColor = 0;
+    QRgb vLineColor = 0;
+
+    static ProfileHeader FromScheme(const OverlayScheme &scheme) {
+        ProfileHeader header;
+        header.name = scheme.schemeName;
+        header.version = scheme.version;
+        header.hLineColor = scheme.hLineColor.rgba();
+        header.vLineColor = scheme.vLineColor.rgba();
+        return header;
+    }
+};
+
+// CRC-32 (IEEE). Pass the previous result as crc to continue a checksum.
+quint32 Crc32(const void *data, qint64 size, quint32 crc = 0);
+
+QByteArray EncodeScheme(const OverlayScheme &scheme);
+
+// nullptr if data is not a valid scheme.
+OverlayScheme::Ptr DecodeScheme(const QByteArray &data);
+
+// Header of scheme, read from a canonical payload without decoding the rest.
+//   Checked as by DecodeScheme(). Return false if data is not a valid scheme.
+bool DecodeSchemeHeader(const QByteArray &data, ProfileHeader *header);
+
+// Load scheme from file.
+OverlayScheme::Ptr LoadSchemeFromFile(QString filePath);
+
+#endif // SCHEMECODEC_H
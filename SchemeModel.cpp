@@ -0,0 +1,73 @@
+#include "SchemeModel.h"
+
+#include <QtMath>
+
+SchemeModel::SchemeModel(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void SchemeModel::SetScheme(const OverlayScheme &scheme)
+{
+    m_scheme = scheme;
+}
+
+template <typename T>
+void SchemeModel::Assign(T &field, const T &value)
+{
+    if (field == value) {
+        return;
+    }
+
+    field = value;
+    emit SigChanged();
+}
+
+void SchemeModel::SetHLineEnabled(bool bEnabled)
+{
+    Assign(m_scheme.bEnableHLine, bEnabled);
+}
+
+void SchemeModel::SetHLineWidth(int width)
+{
+    Assign(m_scheme.hLineWidth, width);
+}
+
+void SchemeModel::SetHLineColor(QColor color)
+{
+    Assign(m_scheme.hLineColor, color);
+}
+
+void SchemeModel::SetVLineEnabled(bool bEnabled)
+{
+    Assign(m_scheme.bEnableVLine, bEnabled);
+}
+
+void SchemeModel::SetVLineWidth(int width)
+{
+    Assign(m_scheme.vLineWidth, width);
+}
+
+void SchemeModel::SetVLineColor(QColor color)
+{
+    Assign(m_scheme.vLineColor, color);
+}
+
+void SchemeModel::SetInvertedBgColor(QColor color)
+{
+    Assign(m_scheme.invertedBgColor, color);
+}
+
+int SchemeModel::AlphaToPercent(int alpha)
+{
+    return qFloor(alpha * 100.0 / 255 + 0.5);
+}
+
+void SchemeModel::SetAlphaPercent(QColor &color, int percent)
+{
+    if (AlphaToPercent(color.alpha()) == percent) {
+        return;
+    }
+
+    color.setAlpha(qFloor(percent * 255.0 / 100 + 0.5));
+}
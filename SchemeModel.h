@@ -0,0 +1,49 @@
+#ifndef SCHEMEMODEL_H
+#define SCHEMEMODEL_H
+
+#include "OverlayScheme.h"
+
+#include <QObject>
+
+// Scheme edited by SettingsDialog. Widgets show it and change it through
+//   setters; every real change emits SigChanged(). Colors keep their exact
+//   alpha, whatever percentage the widgets show.
+class SchemeModel : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SchemeModel(QObject *parent = nullptr);
+
+    const OverlayScheme &GetScheme() const { return m_scheme; }
+
+    // Replace whole scheme, without SigChanged().
+    void SetScheme(const OverlayScheme &scheme);
+
+    void SetHLineEnabled(bool bEnabled);
+    void SetHLineWidth(int width);
+    void SetHLineColor(QColor color);
+
+    void SetVLineEnabled(bool bEnabled);
+    void SetVLineWidth(int width);
+    void SetVLineColor(QColor color);
+
+    void SetInvertedBgColor(QColor color);
+
+    // Opacity as percent, for spin boxes. Alpha changes only if the percent
+    //   shown changes, so it is not rounded by showing it.
+    static int AlphaToPercent(int alpha);
+    static void SetAlphaPercent(QColor &color, int percent);
+
+signals:
+    // Edited.
+    void SigChanged();
+
+private:
+    template <typename T>
+    void Assign(T &field, const T &value);
+
+    OverlayScheme m_scheme;
+};
+
+#endif // SCHEMEMODEL_H
@@ -7,6 +7,24 @@
 #define COMMON_ENABLED              "enabled"
 #define COMMON_INVERTED             "inverted"
 #define COMMON_ENABLE_EDIT          "enable_edit"
+#define COMMON_TRANSITION_MS        "transition_ms"
+#define COMMON_LAST_SCHEME          "last_scheme"
+
+#define GROUP_HOTKEYS               "hotkeys"
+#define HOTKEYS_REPEAT_SUFFIX       "_repeat"
+
+#define GROUP_HOOK                  "hook"
+#define HOOK_LATENCY_BUDGET_MS      "latency_budget_ms"
+
+// Levels are "trace", "debug", "info", "warn", "error" or "off".
+#define GROUP_LOG                   "log"
+#define LOG_LEVEL                   "level"             // All modules.
+#define LOG_MODULE_LEVEL_SUFFIX     "_level"            // After module name, e.g. "overlay_level".
+#define LOG_CONSOLE                 "console"
+#define LOG_CONSOLE_LEVEL           "console_level"
+#define LOG_CONSOLE_PATTERN         "console_pattern"
+#define LOG_FILE_LEVEL              "file_level"
+#define LOG_FILE_PATTERN            "file_pattern"
 
 
 #endif // SETTINGKEYS_H
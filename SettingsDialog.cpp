@@ -1,15 +1,27 @@
+#define MYLOG_MODULE LogModule::Settings
+
 #include "SettingsDialog.h"
 #include "ui_SettingsDialog.h"
 #include "AnchorSettings.h"
 #include "GetInputDialog.h"
+#include "HotkeyEdit.h"
+#include "ProfileListModel.h"
+#include "ProfileRepository.h"
+#include "SchemeModel.h"
+#include "ShortcutDefine.h"
 #include "mylog.h"
+#include "HotkeyHook/KeyboardHook.h"
 
 #include <QColorDialog>
+#include <QCompleter>
+#include <QElapsedTimer>
+#include <QGridLayout>
 #include <QGuiApplication>
+#include <QLabel>
+#include <QListView>
 #include <QMessageBox>
 #include <QScreen>
 #include <QTimer>
-#include <QtMath>
 
 SettingsDialog::SettingsDialog(QWidget *parent) :
     QDialog(parent),
@@ -27,6 +39,18 @@ SettingsDialog::SettingsDialog(QWidget *parent) :
 
     //ui->btnSave->hide();
 
+    // Profile list may be long. Rows are created only when shown, and the
+    //   profile can be searched by typing part of its name.
+    ui->comboProfiles->setModel(new ProfileListModel(this));
+    ui->comboProfiles->setEditable(true);
+    ui->comboProfiles->setInsertPolicy(QComboBox::NoInsert);
+    ui->comboProfiles->completer()->setCompletionMode(QCompleter::PopupCompletion);
+    ui->comboProfiles->completer()->setFilterMode(Qt::MatchContains);
+    ui->comboProfiles->completer()->setCaseSensitivity(Qt::CaseInsensitive);
+    if (QListView *view = qobject_cast<QListView *>(ui->comboProfiles->view())) {
+        view->setUniformItemSizes(true);
+    }
+
     // Connect some signals.
     connect(ui->checkEnableEdit, &QCheckBox::stateChanged,
         this, &SettingsDialog::OnEnableEditChanged);
@@ -46,9 +70,28 @@ SettingsDialog::SettingsDialog(QWidget *parent) :
         this, &SettingsDialog::OnBtnDeleteProfileClicked);
     connect(ui->btnApply, &QPushButton::clicked, this, &SettingsDialog::OnApplySettings);
     connect(ui->btnSave, &QPushButton::clicked, this, &SettingsDialog::OnBtnSaveClicked);
+    connect(ui->btnCancel, &QPushButton::clicked, this, &SettingsDialog::close);
+
+    // Edits are shown on the overlay at once, and saved only when applied.
+    m_timerPreview.setSingleShot(true);
+    m_timerPreview.setInterval(1000 / 60);
+    connect(&m_timerPreview, &QTimer::timeout, this, &SettingsDialog::OnPreviewTimeout);
+
+    connect(&m_model, &SchemeModel::SigChanged, this, &SettingsDialog::UpdateColorSwatches);
+    connect(&m_model, &SchemeModel::SigChanged, this, &SettingsDialog::SchedulePreview);
+    ConnectModelEdits();
+
+    ProfileRepository *profiles = ProfileRepository::Instance();
+    connect(profiles, &ProfileRepository::SigLoaded, this, &SettingsDialog::OnProfilesLoaded);
+    connect(profiles, &ProfileRepository::SigProfilesReset, this, &SettingsDialog::OnProfilesLoaded);
+    connect(profiles, &ProfileRepository::SigWriteFailed, this, &SettingsDialog::OnProfileWriteFailed);
+    connect(profiles, &ProfileRepository::SigProfileChanged, this, &SettingsDialog::OnProfileChanged);
+    connect(profiles, &ProfileRepository::SigProfileLoaded, this, &SettingsDialog::OnProfileLoaded);
 
     RefreshScreenList();
 
+    InitHotkeyEdits();
+
     // Connect some signals after UI is updated.
     connect(ui->comboScreens, QOverload<int>::of(&QComboBox::currentIndexChanged),
         this, &SettingsDialog::OnScreenCurrentIndexChanged);
@@ -86,7 +129,7 @@ void SettingsDialog::SetOverlayInvertedUI(bool bInverted)
 
 void SettingsDialog::SetCurrentProfile(QString profileName)
 {
-    int index = ui->comboProfiles->findText(profileName);
+    int index = ProfileRepository::Instance()->IndexOf(profileName);
     if (index == -1) {
         L_WARN("profile name not found: {}", profileName);
         return;
@@ -95,8 +138,40 @@ void SettingsDialog::SetCurrentProfile(QString profileName)
     ui->comboProfiles->setCurrentIndex(index);
 }
 
+OverlayScheme::Ptr SettingsDialog::SaveAdjustedProfile(OverlayScheme::Ptr adjusted)
+{
+    OverlayScheme::Ptr current = GetCurrentProfile();
+    if (!current || current->schemeName != adjusted->schemeName) {
+        L_WARN("Adjusted profile is not current, not saved: {}", adjusted->schemeName);
+        return nullptr;
+    }
+
+    // Line toggles on the overlay are not part of the adjustment.
+    OverlayScheme::Ptr scheme = std::make_shared<OverlayScheme>(*current);
+    scheme->hLineWidth = adjusted->hLineWidth;
+    scheme->vLineWidth = adjusted->vLineWidth;
+    scheme->hLineColor = adjusted->hLineColor;
+    scheme->vLineColor = adjusted->vLineColor;
+    scheme->invertedBgColor = adjusted->invertedBgColor;
+
+    // UI is updated by OnProfileChanged().
+    m_bSavingProfile = true;
+    bool bSaved = ProfileRepository::Instance()->Save(scheme);
+    m_bSavingProfile = false;
+
+    if (!bSaved) {
+        L_ERROR("Save adjusted profile failed: {}", scheme->schemeName);
+        return nullptr;
+    }
+
+    L_INFO("Adjusted profile saved: {}", scheme->schemeName);
+    return scheme;
+}
+
 void SettingsDialog::hideEvent(QHideEvent *event)
 {
+    RevertPreview();
+
     emit SigDialogHided();
 }
 
@@ -104,6 +179,8 @@ void SettingsDialog::RefreshScreenList()
 {
     QList<QScreen *> screens = QGuiApplication::screens();
 
+    // Refilling is no choice of the user.
+    ui->comboScreens->blockSignals(true);
     ui->comboScreens->clear();
 
     for (int i = 0; i != screens.size(); ++i) {
@@ -114,6 +191,41 @@ void SettingsDialog::RefreshScreenList()
 
         ui->comboScreens->addItem(screenName);
     }
+
+    int screenIndex = AnchorSettings::Instance()->GetScreenIndex();
+    if (screenIndex >= 0 && screenIndex < ui->comboScreens->count()) {
+        ui->comboScreens->setCurrentIndex(screenIndex);
+    }
+    ui->comboScreens->blockSignals(false);
+}
+
+void SettingsDialog::InitHotkeyEdits()
+{
+    // What the hook has, settings which conflicted were not registered.
+    QMap<int, Hotkey> registered = KeyboardHook::getInstance().getHotkeys();
+
+    // Two columns of "label: edit".
+    int i = 0;
+    for (const ShortcutAction &action : SHORTCUT_ACTIONS) {
+        Hotkey hotkey = registered.value(action.id);
+
+        HotkeyEdit *edit = new HotkeyEdit(ui->groupHotkeys);
+        edit->SetHotkey(hotkey);
+
+        int row = i / 2;
+        int column = (i % 2) * 2;
+        ui->gridLayoutHotkeys->addWidget(new QLabel(QString("%1:").arg(action.description)), row, column);
+        ui->gridLayoutHotkeys->addWidget(edit, row, column + 1);
+        ++i;
+
+        int id = action.id;
+        connect(edit, &HotkeyEdit::SigHotkeyCaptured, this, [this, id](Hotkey hotkey) {
+            OnHotkeyCaptured(id, hotkey);
+        });
+
+        m_hotkeyEdits[id] = edit;
+        m_hotkeys[id] = hotkey;
+    }
 }
 
 void SettingsDialog::UpdateUI()
@@ -142,45 +254,28 @@ void SettingsDialog::UpdateUI()
     ui->checkInverted->setChecked(bInverted);
     ui->checkEnableEdit->setChecked(bEnableEdit);
 
-    ReadAllProfiles();
-
-    RefreshProfileList();
+    // Otherwise done by OnProfilesLoaded().
+    if (ProfileRepository::Instance()->IsLoaded()) {
+        RefreshProfileList();
+    }
 
     // Make height minimum.
     resize(width(), 100);
 }
 
-void SettingsDialog::ReadAllProfiles()
-{
-    AnchorSettings *settings = AnchorSettings::Instance();
-
-    // Get all profiles.
-    QVector<OverlayScheme::Ptr> profiles = settings->GetAllProfiles();
-
-    m_profiles = profiles;
-}
-
 void SettingsDialog::RefreshProfileList()
 {
     AnchorSettings *settings = AnchorSettings::Instance();
 
     ui->comboProfiles->blockSignals(true);
 
-    // Update current profiles.
+    // Rows are filled by ProfileListModel.
     QString currentProfile = settings->GetCurrentProfile();
-    int currentProfileIndex = -1;
-    for (int i = 0; i != m_profiles.size(); ++i) {
-        OverlayScheme::Ptr scheme = m_profiles[i];
-
-        ui->comboProfiles->addItem(scheme->schemeName);
+    ProfileRepository *profiles = ProfileRepository::Instance();
+    int currentProfileIndex = profiles->IndexOf(currentProfile);
 
-        if (scheme->schemeName == currentProfile) {
-            currentProfileIndex = i;
-        }
-    }
-    
     // Default to first profile if no current profile found.
-    if (currentProfileIndex < 0 && m_profiles.size() > 0) {
+    if (currentProfileIndex < 0 && profiles->Count() > 0) {
         currentProfileIndex = 0;
     }
 
@@ -188,15 +283,19 @@ void SettingsDialog::RefreshProfileList()
 
     ui->comboProfiles->blockSignals(false);
 
+    m_bProfileListReady = true;
+    m_currentProfileName = GetCurrentProfileName();
+
     if (currentProfileIndex == -1) {
         L_WARN("current profile not found: {}", currentProfile);
         return;
     }
 
-    EmitProfilesUpdate();
-
-    // Emit current profile for first time.
-    emit SigOverlaySchemeChanged(GetCurrentProfile());
+    // Emit current profile for first time. If it is not decoded yet,
+    //   OnProfileLoaded() does.
+    if (OverlayScheme::Ptr scheme = GetCurrentProfile()) {
+        emit SigOverlaySchemeChanged(scheme);
+    }
 
     UpdateCurrentProfileToUI();
 }
@@ -207,50 +306,56 @@ void SettingsDialog::UpdateCurrentProfileToUI()
 
     OverlayScheme::Ptr scheme = GetCurrentProfile();
     if (!scheme) {
-        L_ERROR("current profile not found");
+        L_DEBUG("current profile not available yet: {}", GetCurrentProfileName());
         return;
     }
 
-    qreal opacity;
-    int opacityInt;
+    QElapsedTimer timer;
+    timer.start();
+
+    // Not an edit, nothing to preview.
+    m_bUpdatingProfileUI = true;
+    m_timerPreview.stop();
+    m_bPreviewing = false;
+
+    m_model.SetScheme(*scheme);
 
     // Update.
     ui->checkEnableHLine->setChecked(scheme->bEnableHLine);
     ui->spinHLineThick->setValue(scheme->hLineWidth);
-    ui->btnHLineColor->setStyleSheet(QString("background-color: %1").arg(scheme->hLineColor.name()));
-    opacity = 1.0 * scheme->hLineColor.alpha() * 100 / 255;
-    opacityInt = qFloor(opacity + 0.5);
-    ui->spinHLineOpacity->setValue(opacityInt);
+    ui->spinHLineOpacity->setValue(SchemeModel::AlphaToPercent(scheme->hLineColor.alpha()));
 
     ui->checkEnableVLine->setChecked(scheme->bEnableVLine);
     ui->spinVLineThick->setValue(scheme->vLineWidth);
-    ui->btnVLineColor->setStyleSheet(QString("background-color: %1").arg(scheme->vLineColor.name()));
-    opacity = 1.0 * scheme->vLineColor.alpha() * 100 / 255;
-    opacityInt = qFloor(opacity + 0.5);
-    ui->spinVLineOpacity->setValue(opacityInt);
+    ui->spinVLineOpacity->setValue(SchemeModel::AlphaToPercent(scheme->vLineColor.alpha()));
 
-    ui->btnInvertBgColor->setStyleSheet(QString("background-color: %1").arg(scheme->invertedBgColor.name()));
-    opacity = 1.0 * scheme->invertedBgColor.alpha() * 100 / 255;
-    opacityInt = qFloor(opacity + 0.5);
-    ui->spinInvertBgOpacity->setValue(opacityInt);
+    ui->spinInvertBgOpacity->setValue(SchemeModel::AlphaToPercent(scheme->invertedBgColor.alpha()));
+
+    UpdateColorSwatches();
+
+    m_bUpdatingProfileUI = false;
+
+    L_DEBUG("Profile shown in UI in {} us: {}", timer.nsecsElapsed() / 1000, scheme->schemeName);
 }
 
-OverlayScheme::Ptr SettingsDialog::GetProfileByName(QString profileName)
+void SettingsDialog::UpdateColorSwatches()
 {
-    for (int i = 0; i != m_profiles.size(); ++i) {
-        OverlayScheme::Ptr scheme = m_profiles[i];
-        if (scheme->schemeName == profileName) {
-            return scheme;
-        }
-    }
+    const OverlayScheme &scheme = m_model.GetScheme();
 
-    return nullptr;
+    ui->btnHLineColor->SetColor(scheme.hLineColor);
+    ui->btnVLineColor->SetColor(scheme.vLineColor);
+    ui->btnInvertBgColor->SetColor(scheme.invertedBgColor);
+}
+
+QString SettingsDialog::GetCurrentProfileName()
+{
+    // Not currentText(), which is what is typed for searching.
+    return ui->comboProfiles->itemText(ui->comboProfiles->currentIndex());
 }
 
 OverlayScheme::Ptr SettingsDialog::GetCurrentProfile()
 {
-    QString currentProfile = ui->comboProfiles->currentText();
-    return GetProfileByName(currentProfile);
+    return ProfileRepository::Instance()->Get(GetCurrentProfileName());
 }
 
 int SettingsDialog::GetCurrentProfileIndex()
@@ -260,31 +365,93 @@ int SettingsDialog::GetCurrentProfileIndex()
 
 OverlayScheme::Ptr SettingsDialog::GetCurrentProfileFromUI()
 {
-    OverlayScheme::Ptr scheme = std::make_shared<OverlayScheme>();
+    return std::make_shared<OverlayScheme>(m_model.GetScheme());
+}
 
-    qreal opacity;
-    int opacityInt;
+void SettingsDialog::ConnectModelEdits()
+{
+    auto connectSpin = [this](QSpinBox *spin, void (SettingsDialog::*edit)(int)) {
+        connect(spin, QOverload<int>::of(&QSpinBox::valueChanged), this, [this, edit](int value) {
+            if (!m_bUpdatingProfileUI) {
+                (this->*edit)(value);
+            }
+            });
+    };
+    connectSpin(ui->spinHLineThick, &SettingsDialog::EditHLineWidth);
+    connectSpin(ui->spinVLineThick, &SettingsDialog::EditVLineWidth);
+    connectSpin(ui->spinHLineOpacity, &SettingsDialog::EditHLineOpacity);
+    connectSpin(ui->spinVLineOpacity, &SettingsDialog::EditVLineOpacity);
+    connectSpin(ui->spinInvertBgOpacity, &SettingsDialog::EditInvertedBgOpacity);
+
+    connect(ui->checkEnableHLine, &QCheckBox::toggled, this, [this](bool bChecked) {
+        if (!m_bUpdatingProfileUI) {
+            m_model.SetHLineEnabled(bChecked);
+        }
+        });
+    connect(ui->checkEnableVLine, &QCheckBox::toggled, this, [this](bool bChecked) {
+        if (!m_bUpdatingProfileUI) {
+            m_model.SetVLineEnabled(bChecked);
+        }
+        });
+}
 
-    scheme->bEnableHLine = ui->checkEnableHLine->isChecked();
-    scheme->hLineWidth = ui->spinHLineThick->value();
-    scheme->hLineColor = ui->btnHLineColor->palette().color(QPalette::Button);
-    opacity = 1.0 * ui->spinHLineOpacity->value() * 255 / 100;
-    opacityInt = qFloor(opacity + 0.5);
-    scheme->hLineColor.setAlpha(opacityInt);
+void SettingsDialog::EditHLineWidth(int width)
+{
+    m_model.SetHLineWidth(width);
+}
 
-    scheme->bEnableVLine = ui->checkEnableVLine->isChecked();
-    scheme->vLineWidth = ui->spinVLineThick->value();
-    scheme->vLineColor = ui->btnVLineColor->palette().color(QPalette::Button);
-    opacity = 1.0 * ui->spinVLineOpacity->value() * 255 / 100;
-    opacityInt = qFloor(opacity + 0.5);
-    scheme->vLineColor.setAlpha(opacityInt);
+void SettingsDialog::EditVLineWidth(int width)
+{
+    m_model.SetVLineWidth(width);
+}
 
-    scheme->invertedBgColor = ui->btnInvertBgColor->palette().color(QPalette::Button);
-    opacity = 1.0 * ui->spinInvertBgOpacity->value() * 255 / 100;
-    opacityInt = qFloor(opacity + 0.5);
-    scheme->invertedBgColor.setAlpha(opacityInt);
+void SettingsDialog::EditHLineOpacity(int percent)
+{
+    QColor color = m_model.GetScheme().hLineColor;
+    SchemeModel::SetAlphaPercent(color, percent);
+    m_model.SetHLineColor(color);
+}
 
-    return scheme;
+void SettingsDialog::EditVLineOpacity(int percent)
+{
+    QColor color = m_model.GetScheme().vLineColor;
+    SchemeModel::SetAlphaPercent(color, percent);
+    m_model.SetVLineColor(color);
+}
+
+void SettingsDialog::EditInvertedBgOpacity(int percent)
+{
+    QColor color = m_model.GetScheme().invertedBgColor;
+    SchemeModel::SetAlphaPercent(color, percent);
+    m_model.SetInvertedBgColor(color);
+}
+
+void SettingsDialog::SchedulePreview()
+{
+    if (m_bUpdatingProfileUI || m_timerPreview.isActive()) {
+        return;
+    }
+
+    m_timerPreview.start();
+}
+
+void SettingsDialog::RevertPreview()
+{
+    m_timerPreview.stop();
+
+    if (!m_bPreviewing) {
+        return;
+    }
+
+    OverlayScheme::Ptr scheme = GetCurrentProfile();
+    if (!scheme) {
+        return;
+    }
+
+    L_TRACE("Preview reverted: {}", scheme->schemeName);
+
+    UpdateCurrentProfileToUI();
+    emit SigOverlaySchemeChanged(scheme);
 }
 
 void SettingsDialog::SaveEnabled(bool bEnabled)
@@ -299,10 +466,6 @@ void SettingsDialog::SaveInverted(bool bInverted)
     settings->SetInverted(bInverted);
 }
 
-void SettingsDialog::EmitProfilesUpdate()
-{
-    emit SigProfilesUpdated(m_profiles);
-}
 
 void SettingsDialog::OnProfileCurrentIndexChanged(int index)
 {
@@ -311,14 +474,72 @@ void SettingsDialog::OnProfileCurrentIndexChanged(int index)
     L_TRACE("current profile index changed. index: {}, profile: {}",
         index, profileName);
 
+    // Rows are moved by profiles added or removed before the current one,
+    //   and the list is reset when profiles are loaded.
+    if (!m_bProfileListReady || profileName == m_currentProfileName) {
+        return;
+    }
+    m_currentProfileName = profileName;
+
     // Save current profile name.
     AnchorSettings *settings = AnchorSettings::Instance();
     settings->SetCurrentProfile(profileName);
 
-    // Update UI.
+    // Update UI. If the profile is not decoded yet, OnProfileLoaded() does.
+    UpdateCurrentProfileToUI();
+
+    if (OverlayScheme::Ptr scheme = GetCurrentProfile()) {
+        emit SigOverlaySchemeChanged(scheme);
+    }
+}
+
+void SettingsDialog::OnProfilesLoaded()
+{
+    RefreshProfileList();
+}
+
+void SettingsDialog::OnProfileWriteFailed(QString profileName)
+{
+    QString warning = QString("Failed to save profile \"%1\"!").arg(profileName);
+    QMessageBox::warning(this, "Warning", warning);
+}
+
+void SettingsDialog::OnProfileChanged(int id, int index)
+{
+    OverlayScheme::Ptr scheme = ProfileRepository::Instance()->GetById(id);
+    if (!scheme) {
+        // Removed again, or being decoded and OnProfileLoaded() follows.
+        return;
+    }
+    L_TRACE("profile changed: {}", scheme->schemeName);
+
+    if (index != GetCurrentProfileIndex()) {
+        return;
+    }
+
     UpdateCurrentProfileToUI();
 
-    emit SigOverlaySchemeChanged(GetCurrentProfile());
+    // Changed outside this dialog, apply it.
+    if (!m_bSavingProfile) {
+        emit SigOverlaySchemeChanged(scheme);
+    }
+}
+
+void SettingsDialog::OnProfileLoaded(int id, int index)
+{
+    // Only the current profile may wait for decoding. Edits being previewed
+    //   are kept.
+    if (!m_bProfileListReady || index != GetCurrentProfileIndex() || m_bPreviewing) {
+        return;
+    }
+
+    OverlayScheme::Ptr scheme = ProfileRepository::Instance()->GetById(id);
+    if (!scheme) {
+        return;
+    }
+
+    UpdateCurrentProfileToUI();
+    emit SigOverlaySchemeChanged(scheme);
 }
 
 void SettingsDialog::OnScreenCurrentIndexChanged(int index)
@@ -398,8 +619,6 @@ void SettingsDialog::OnEnableEditChanged(int /*state*/)
 
 void SettingsDialog::OnBtnCreateProfileClicked()
 {
-    AnchorSettings *settings = AnchorSettings::Instance();
-
     GetInputDialog dialog(this);
     dialog.setWindowTitle("Input new profile name");
 
@@ -419,8 +638,17 @@ void SettingsDialog::OnBtnCreateProfileClicked()
         return;
     }
 
+    if (profileName.size() > PROFILE_STORE_MAX_NAME_LENGTH) {
+        L_WARN("profile name too long: {}", profileName.size());
+
+        QString warning = QString("Profile name cannot be longer than %1 characters!")
+            .arg(PROFILE_STORE_MAX_NAME_LENGTH);
+        QMessageBox::warning(this, "Warning", warning);
+        return;
+    }
+
     // Check if the profile name already exists.
-    if (GetProfileByName(profileName)) {
+    if (ProfileRepository::Instance()->Contains(profileName)) {
         L_WARN("profile name already exists.");
 
         QMessageBox::warning(this, "Warning", 
@@ -432,23 +660,15 @@ void SettingsDialog::OnBtnCreateProfileClicked()
     OverlayScheme::Ptr scheme = std::make_shared<OverlayScheme>();
     scheme->schemeName = profileName;
     
-    // Save to settings.
-    if (!settings->SaveProfile(scheme)) {
+    // Save. Added to combo box by ProfileListModel.
+    if (!ProfileRepository::Instance()->Save(scheme)) {
         L_ERROR("save profile failed.");
         QMessageBox::warning(this, "Warning", "Failed to save profile!");  
         return;
     }
 
-    // Add to m_profiles.
-    m_profiles.push_back(scheme);
-
-    // Add to combo box.
-    ui->comboProfiles->addItem(profileName);
-
-    EmitProfilesUpdate();
-
     // Set current profile.
-    ui->comboProfiles->setCurrentIndex(ui->comboProfiles->count() - 1);
+    ui->comboProfiles->setCurrentIndex(ProfileRepository::Instance()->IndexOf(profileName));
 
     L_INFO("create profile success: {}", profileName);
 
@@ -459,7 +679,7 @@ void SettingsDialog::OnBtnCreateProfileClicked()
 void SettingsDialog::OnBtnDeleteProfileClicked()
 {
     // Get current profile name.
-    QString currentProfileName = ui->comboProfiles->currentText();
+    QString currentProfileName = GetCurrentProfileName();
 
     if (currentProfileName.isEmpty()) {
         L_WARN("current profile name is empty.");
@@ -475,24 +695,14 @@ void SettingsDialog::OnBtnDeleteProfileClicked()
         return;
     }
 
-    // Delete from settings.
-    AnchorSettings *settings = AnchorSettings::Instance();
-    settings->DeleteProfile(currentProfileName);
-
-    // Delete from m_profiles.
-    for (int i = 0; i != m_profiles.size(); ++i) {
-        OverlayScheme::Ptr scheme = m_profiles[i];
-        if (scheme->schemeName == currentProfileName) {
-            m_profiles.remove(i);
-            break;
-        }
+    // Delete. Removed from combo box by ProfileListModel, and another
+    //   profile becomes current.
+    if (!ProfileRepository::Instance()->Remove(currentProfileName)) {
+        L_ERROR("delete profile failed: {}", currentProfileName);
+        QMessageBox::warning(this, "Warning", "Failed to delete profile!");
+        return;
     }
 
-    EmitProfilesUpdate();
-
-    // Delete from combo box.
-    ui->comboProfiles->removeItem(ui->comboProfiles->currentIndex());
-
     L_INFO("delete profile success: {}", currentProfileName);
 
     QString info = QString("Profile \"%1\" deleted.").arg(currentProfileName);
@@ -504,8 +714,7 @@ void SettingsDialog::OnBtnChooseHLineColorClicked()
     QColorDialog colorDialog(this);
     colorDialog.setWindowTitle("Choose horizontal line color");
 
-    // Get current color on widget.
-    QColor currentColor = ui->btnHLineColor->palette().color(QPalette::Button);
+    QColor currentColor = m_model.GetScheme().hLineColor;
     colorDialog.setCurrentColor(currentColor);
 
     if (colorDialog.exec() != QDialog::Accepted) {
@@ -514,9 +723,11 @@ void SettingsDialog::OnBtnChooseHLineColorClicked()
     }
 
     QColor color = colorDialog.selectedColor();
-    L_INFO("Horizontal line color chosen: {}", color.name());
+    L_INFO("Horizontal line color chosen: {}", color);
 
-    ui->btnHLineColor->setStyleSheet(QString("background-color: %1").arg(color.name()));
+    // Opacity is set separately.
+    color.setAlpha(currentColor.alpha());
+    m_model.SetHLineColor(color);
 }
 
 void SettingsDialog::OnBtnChooseVLineColorClicked()
@@ -524,8 +735,7 @@ void SettingsDialog::OnBtnChooseVLineColorClicked()
     QColorDialog colorDialog(this);
     colorDialog.setWindowTitle("Choose vertical line color");
 
-    // Get current color on widget.
-    QColor currentColor = ui->btnVLineColor->palette().color(QPalette::Button);
+    QColor currentColor = m_model.GetScheme().vLineColor;
     colorDialog.setCurrentColor(currentColor);
 
     if (colorDialog.exec() != QDialog::Accepted) {
@@ -534,9 +744,11 @@ void SettingsDialog::OnBtnChooseVLineColorClicked()
     }
 
     QColor color = colorDialog.selectedColor();
-    L_INFO("Vertical line color chosen: {}", color.name());
+    L_INFO("Vertical line color chosen: {}", color);
 
-    ui->btnVLineColor->setStyleSheet(QString("background-color: %1").arg(color.name()));
+    // Opacity is set separately.
+    color.setAlpha(currentColor.alpha());
+    m_model.SetVLineColor(color);
 }
 
 void SettingsDialog::OnBtnChooseInvertBgColorClicked()
@@ -544,8 +756,7 @@ void SettingsDialog::OnBtnChooseInvertBgColorClicked()
     QColorDialog colorDialog(this);
     colorDialog.setWindowTitle("Choose inverted background color");
 
-    // Get current color on widget.
-    QColor currentColor = ui->btnInvertBgColor->palette().color(QPalette::Button);
+    QColor currentColor = m_model.GetScheme().invertedBgColor;
     colorDialog.setCurrentColor(currentColor);
 
     if (colorDialog.exec() != QDialog::Accepted) {
@@ -554,19 +765,34 @@ void SettingsDialog::OnBtnChooseInvertBgColorClicked()
     }
 
     QColor color = colorDialog.selectedColor();
-    L_INFO("Inverted background color chosen: {}", color.name());
+    L_INFO("Inverted background color chosen: {}", color);
 
-    ui->btnInvertBgColor->setStyleSheet(QString("background-color: %1").arg(color.name()));
+    // Opacity is set separately.
+    color.setAlpha(currentColor.alpha());
+    m_model.SetInvertedBgColor(color);
+}
+
+void SettingsDialog::OnPreviewTimeout()
+{
+    QString currentProfileName = GetCurrentProfileName();
+    if (currentProfileName.isEmpty()) {
+        return;
+    }
+
+    OverlayScheme::Ptr scheme = GetCurrentProfileFromUI();
+    scheme->schemeName = currentProfileName;
+    m_bPreviewing = true;
+
+    emit SigOverlaySchemePreviewed(scheme);
 }
 
 void SettingsDialog::OnApplySettings()
 {
-    AnchorSettings *settings = AnchorSettings::Instance();
     OverlayScheme::Ptr scheme = GetCurrentProfileFromUI();
 
     Q_ASSERT(scheme != nullptr);
 
-    QString currentProfileName = ui->comboProfiles->currentText();
+    QString currentProfileName = GetCurrentProfileName();
     if (currentProfileName.isEmpty()) {
         L_WARN("current profile name is empty.");
         QMessageBox::warning(this, "Warning", "Please create a new profile first!");
@@ -575,16 +801,21 @@ void SettingsDialog::OnApplySettings()
 
     scheme->schemeName = currentProfileName;
 
-    if (!settings->SaveProfile(scheme)) {
+    // Applied, nothing to revert.
+    m_timerPreview.stop();
+    m_bPreviewing = false;
+
+    // UI is updated by OnProfileChanged().
+    m_bSavingProfile = true;
+    bool bSaved = ProfileRepository::Instance()->Save(scheme);
+    m_bSavingProfile = false;
+
+    if (!bSaved) {
         L_ERROR("Save profile failed. Current profile name: {}", scheme->schemeName);
         QMessageBox::warning(this, "Warning", "Failed to save profile!");
         return;
     }
 
-    // Update m_profiles.
-    int currentProfileIndex = GetCurrentProfileIndex();
-    m_profiles[currentProfileIndex] = scheme;
-
     emit SigOverlaySchemeChanged(scheme);
 }
 
@@ -594,3 +825,35 @@ void SettingsDialog::OnBtnSaveClicked()
 
     close();
 }
+
+void SettingsDialog::OnHotkeyCaptured(int id, Hotkey hotkey)
+{
+    const ShortcutAction *action = FindShortcutAction(id);
+    Q_ASSERT(action);
+
+    Hotkey oldHotkey = m_hotkeys.value(id);
+
+    L_INFO("Hotkey of {} captured: {}", action->key, hotkey.toStr());
+
+    // Registered live, the hook thread keeps running. The hook refuses a
+    //   key combination of another action.
+    KeyboardHook &hook = KeyboardHook::getInstance();
+    if (!hook.addHotkey(id, hotkey)) {
+        int conflictId = hook.findHotkey(hotkey);
+        const ShortcutAction *conflictAction = FindShortcutAction(conflictId);
+        QString conflictDescription = conflictAction ? conflictAction->description : QString::number(conflictId);
+        L_WARN("Hotkey {} already used by {}", hotkey.toStr(), conflictDescription);
+
+        m_hotkeyEdits[id]->SetHotkey(oldHotkey);
+
+        QString info = QString("Hotkey \"%1\" is already used by \"%2\".")
+            .arg(hotkey.toStr()).arg(conflictDescription);
+        QMessageBox::warning(this, "Warning", info);
+        return;
+    }
+    m_hotkeys[id] = hotkey;
+
+    // Only a working binding is saved.
+    AnchorSettings *settings = AnchorSettings::Instance();
+    settings->SetHotkey(action->key, hotkey.getVkCode() != 0 ? hotkey.toStr() : QString());
+}
@@ -2,8 +2,15 @@
 #define SETTINGSDIALOG_H
 
 #include "OverlayScheme.h"
+#include "SchemeModel.h"
+#include "HotkeyHook/Hotkey.h"
 
 #include <QDialog>
+#include <QHash>
+#include <QMap>
+#include <QTimer>
+
+class HotkeyEdit;
 
 namespace Ui {
 class SettingsDialog;
@@ -24,7 +31,21 @@ public:
     // Set currrent profile with no changing signal emitting.
     void SetCurrentProfile(QString profileName);
 
+    // Save widths and colors adjusted on the overlay to current profile.
+    // No scheme changing signal emitted, the overlay already shows them.
+    // Return the saved profile, nullptr if not saved.
+    OverlayScheme::Ptr SaveAdjustedProfile(OverlayScheme::Ptr adjusted);
+
+    // Show the stored profile again, if a preview is shown. Edits in the
+    //   dialog are dropped.
+    void RevertPreview();
+
+    // Fill screen list again, after screens are added or removed. The
+    //   chosen screen is kept.
+    void RefreshScreenList();
+
 protected:
+    // Revert unapplied preview.
     void hideEvent(QHideEvent *event) override;
 
 signals:
@@ -32,47 +53,61 @@ signals:
     void SigOverlayInverted(bool bInverted);
 
     void SigOverlaySchemeChanged(OverlayScheme::Ptr pOverlayScheme);
+
+    // Unsaved scheme being edited, to show on the overlay only.
+    void SigOverlaySchemePreviewed(OverlayScheme::Ptr pOverlayScheme);
     void SigScreenChanged(int screenIndex);
 
     void SigDialogHided();
 
-    // Emitted when profiles list updated (first, add, delete).
-    // This signal should usually be followd by a SigOverlaySchemeChanged signal.
-    void SigProfilesUpdated(QVector<OverlayScheme::Ptr> profiles);
-
 private:
-    void RefreshScreenList();
+
+    // Create hotkey capture fields from settings.
+    void InitHotkeyEdits();
 
     // Update UI according to current settings.
     void UpdateUI();
 
-    // Read all profiles from settings.
-    void ReadAllProfiles();
-
+    // Fill comboProfiles, in ProfileRepository order.
     void RefreshProfileList();
 
     // Update current selected profile to UI widgets.
     void UpdateCurrentProfileToUI();
 
-    // Get profile by name. Search only in m_profiles.
-    OverlayScheme::Ptr GetProfileByName(QString profileName);
-
+    QString GetCurrentProfileName();
     OverlayScheme::Ptr GetCurrentProfile();
     int GetCurrentProfileIndex();
 
-    // Get current profile settings from UI.
-    // OverlayScheme::schemeName is not set.
+    // Get current profile settings as edited in UI.
     OverlayScheme::Ptr GetCurrentProfileFromUI();
 
+    // Edits of widgets go to m_model.
+    void ConnectModelEdits();
+    void EditHLineWidth(int width);
+    void EditVLineWidth(int width);
+    void EditHLineOpacity(int percent);
+    void EditVLineOpacity(int percent);
+    void EditInvertedBgOpacity(int percent);
+
+    // Colors of m_model to color buttons.
+    void UpdateColorSwatches();
+
+    // Preview UI values on the overlay, at most once per frame.
+    void SchedulePreview();
+
     // Save value to settings.
     void SaveEnabled(bool bEnabled);
     void SaveInverted(bool bInverted);
 
-    void EmitProfilesUpdate();
-
 private slots:
     void OnProfileCurrentIndexChanged(int index);
 
+    /// Profile changes from ProfileRepository.
+    void OnProfilesLoaded();
+    void OnProfileWriteFailed(QString profileName);
+    void OnProfileChanged(int id, int index);
+    void OnProfileLoaded(int id, int index);
+
     /// Global settings.
     void OnScreenCurrentIndexChanged(int index);
     void OnEnableEditChanged(int state);
@@ -88,15 +123,38 @@ private slots:
     void OnBtnChooseVLineColorClicked();
     void OnBtnChooseInvertBgColorClicked();
 
+    void OnPreviewTimeout();
+
     // Apply current settings.
     void OnApplySettings();
 
     void OnBtnSaveClicked();
 
+    void OnHotkeyCaptured(int id, Hotkey hotkey);
+
 private:
     Ui::SettingsDialog *ui;
 
-    QVector<OverlayScheme::Ptr> m_profiles;
+    // Profile applied by OnProfileCurrentIndexChanged().
+    bool m_bProfileListReady = false;
+    QString m_currentProfileName;
+
+    // Whether this dialog is saving a profile itself.
+    bool m_bSavingProfile = false;
+
+    // Profile edited in UI.
+    SchemeModel m_model;
+
+    // Profile values are being put into UI, not edited.
+    bool m_bUpdatingProfileUI = false;
+
+    // Overlay shows values not applied yet.
+    bool m_bPreviewing = false;
+    QTimer m_timerPreview;
+
+    // Hotkey bindings, by shortcut id. Conflicts are found by the hook.
+    QMap<int, Hotkey> m_hotkeys;
+    QMap<int, HotkeyEdit *> m_hotkeyEdits;
 };
 
 #endif // SETTINGSDIALOG_H
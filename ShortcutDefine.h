@@ -1,5 +1,7 @@
 #pragma once
 
+#include "HotkeyHook/HotkeyEventQueue.h"
+
 // Shortcut id
 #define SC_ID_TOGGLE_OVERLAY 1
 #define SC_ID_TOGGLE_INVERTED 2
@@ -8,3 +10,60 @@
 
 #define SC_ID_PREVIOUS_PROFILE 5
 #define SC_ID_NEXT_PROFILE 6
+
+// Jump to profile by slot number (1-based position in profile list).
+#define SC_ID_PROFILE_SLOT_FIRST 11
+#define SC_ID_PROFILE_SLOT_LAST 19
+
+// Adjust live scheme while held down.
+#define SC_ID_WIDTH_INCREASE 21
+#define SC_ID_WIDTH_DECREASE 22
+#define SC_ID_OPACITY_INCREASE 23
+#define SC_ID_OPACITY_DECREASE 24
+
+// Bindable action.
+struct ShortcutAction {
+    int id;
+    const char *key;            // Key under settings group "hotkeys".
+    const char *defaultHotkey;  // Hotkey string, empty if unbound by default.
+    const char *description;
+    HotkeyRepeatPolicy repeatPolicy;    // Default auto-repeat handling.
+};
+
+// All bindable actions, in display order.
+inline const ShortcutAction SHORTCUT_ACTIONS[] = {
+    { SC_ID_TOGGLE_OVERLAY,   "toggle_overlay",   "Ctrl+Shift+T", "Toggle overlay",         HotkeyRepeatPolicy::Ignore },
+    { SC_ID_TOGGLE_INVERTED,  "toggle_inverted",  "Ctrl+Shift+I", "Toggle inverted mode",   HotkeyRepeatPolicy::Ignore },
+    { SC_ID_TOGGLE_HLINE,     "toggle_hline",     "Ctrl+Shift+H", "Toggle horizontal line", HotkeyRepeatPolicy::Ignore },
+    { SC_ID_TOGGLE_VLINE,     "toggle_vline",     "Ctrl+Shift+V", "Toggle vertical line",   HotkeyRepeatPolicy::Ignore },
+    { SC_ID_PREVIOUS_PROFILE, "previous_profile", "Ctrl+Shift+P", "Previous profile",       HotkeyRepeatPolicy::Collapse },
+    { SC_ID_NEXT_PROFILE,     "next_profile",     "Ctrl+Shift+N", "Next profile",           HotkeyRepeatPolicy::Collapse },
+
+    { SC_ID_PROFILE_SLOT_FIRST + 0, "profile_slot_1", "", "Profile 1", HotkeyRepeatPolicy::Ignore },
+    { SC_ID_PROFILE_SLOT_FIRST + 1, "profile_slot_2", "", "Profile 2", HotkeyRepeatPolicy::Ignore },
+    { SC_ID_PROFILE_SLOT_FIRST + 2, "profile_slot_3", "", "Profile 3", HotkeyRepeatPolicy::Ignore },
+    { SC_ID_PROFILE_SLOT_FIRST + 3, "profile_slot_4", "", "Profile 4", HotkeyRepeatPolicy::Ignore },
+    { SC_ID_PROFILE_SLOT_FIRST + 4, "profile_slot_5", "", "Profile 5", HotkeyRepeatPolicy::Ignore },
+    { SC_ID_PROFILE_SLOT_FIRST + 5, "profile_slot_6", "", "Profile 6", HotkeyRepeatPolicy::Ignore },
+    { SC_ID_PROFILE_SLOT_FIRST + 6, "profile_slot_7", "", "Profile 7", HotkeyRepeatPolicy::Ignore },
+    { SC_ID_PROFILE_SLOT_FIRST + 7, "profile_slot_8", "", "Profile 8", HotkeyRepeatPolicy::Ignore },
+    { SC_ID_PROFILE_SLOT_FIRST + 8, "profile_slot_9", "", "Profile 9", HotkeyRepeatPolicy::Ignore },
+
+    // Held actions drive their own timer, repeats are not needed.
+    { SC_ID_WIDTH_INCREASE,   "width_increase",   "", "Increase width (hold)",   HotkeyRepeatPolicy::Ignore },
+    { SC_ID_WIDTH_DECREASE,   "width_decrease",   "", "Decrease width (hold)",   HotkeyRepeatPolicy::Ignore },
+    { SC_ID_OPACITY_INCREASE, "opacity_increase", "", "Increase opacity (hold)", HotkeyRepeatPolicy::Ignore },
+    { SC_ID_OPACITY_DECREASE, "opacity_decrease", "", "Decrease opacity (hold)", HotkeyRepeatPolicy::Ignore },
+};
+
+// Get action by shortcut id. nullptr if not found.
+inline const ShortcutAction *FindShortcutAction(int id)
+{
+    for (const ShortcutAction &action : SHORTCUT_ACTIONS) {
+        if (action.id == id) {
+            return &action;
+        }
+    }
+
+    return nullptr;
+}
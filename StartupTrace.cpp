@@ -0,0 +1,82 @@
+#include "StartupTrace.h"
+#include "BenchReport.h"
+#include "mylog/mylog.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTimer>
+
+static QElapsedTimer g_startupClock;
+static qint64 g_lastPhaseUs = 0;
+static bool g_bFirstFrame = false;
+static bool g_bBenchmark = false;
+
+// Phases before the log is ready.
+#define STARTUP_PENDING_MAX 4
+struct PendingPhase {
+    const char *name;
+    qint64 phaseUs;
+    qint64 totalUs;
+};
+static PendingPhase g_pendingPhases[STARTUP_PENDING_MAX];
+static int g_pendingCount = 0;
+static bool g_bLogReady = false;
+
+void StartupTrace::Start()
+{
+    g_startupClock.start();
+    g_lastPhaseUs = 0;
+}
+
+qint64 StartupTrace::ElapsedUs()
+{
+    return g_startupClock.isValid() ? g_startupClock.nsecsElapsed() / 1000 : 0;
+}
+
+void StartupTrace::Phase(const char *name)
+{
+    qint64 nowUs = ElapsedUs();
+    if (g_bLogReady) {
+        LogPhase(name, nowUs - g_lastPhaseUs, nowUs);
+    } else if (g_pendingCount != STARTUP_PENDING_MAX) {
+        g_pendingPhases[g_pendingCount++] = { name, nowUs - g_lastPhaseUs, nowUs };
+    }
+    g_lastPhaseUs = nowUs;
+}
+
+void StartupTrace::LogReady()
+{
+    g_bLogReady = true;
+
+    for (int i = 0; i != g_pendingCount; ++i) {
+        LogPhase(g_pendingPhases[i].name, g_pendingPhases[i].phaseUs, g_pendingPhases[i].totalUs);
+    }
+    g_pendingCount = 0;
+}
+
+void StartupTrace::LogPhase(const char *name, qint64 phaseUs, qint64 totalUs)
+{
+    L_INFO("Startup {}: {} us, total {} us", name, phaseUs, totalUs);
+}
+
+void StartupTrace::FirstFrame()
+{
+    if (g_bFirstFrame) {
+        return;
+    }
+    g_bFirstFrame = true;
+
+    Phase("first frame");
+
+    if (g_bBenchmark) {
+        ReportBenchResult(QString("time_to_first_frame_us: %1").arg(ElapsedUs()));
+
+        // After this paint is done.
+        QTimer::singleShot(0, qApp, &QCoreApplication::quit);
+    }
+}
+
+void StartupTrace::SetBenchmark(bool bBenchmark)
+{
+    g_bBenchmark = bBenchmark;
+}
@@ -0,0 +1,32 @@
+#ifndef STARTUPTRACE_H
+#define STARTUPTRACE_H
+
+#include <QtGlobal>
+
+// Startup phase timing. Each phase is logged with its own time and the time
+//   since Start(), up to the first frame of the overlay.
+class StartupTrace
+{
+public:
+    // First thing in main(), before QApplication.
+    static void Start();
+
+    // Log time since the previous phase ended. Phases before LogReady() are
+    //   logged by it.
+    static void Phase(const char *name);
+
+    // Log is initialized.
+    static void LogReady();
+
+    // First overlay frame is painted. Only the first call counts.
+    static void FirstFrame();
+
+    // Print time to first frame and quit once it is painted.
+    static void SetBenchmark(bool bBenchmark);
+
+private:
+    static qint64 ElapsedUs();
+    static void LogPhase(const char *name, qint64 phaseUs, qint64 totalUs);
+};
+
+#endif // STARTUPTRACE_H
@@ -1,34 +1,251 @@
 #include "MainWindow.h"
 #include "mylog/mylog.h"
 #include "AnchorSettings.h"
+#include "FlightRecorder.h"
+#include "FormatCheck.h"
+#include "LogBench.h"
+#include "OverlayCheck.h"
+#include "ProfileBench.h"
+#include "ProfileBundle.h"
+#include "ProfileRepository.h"
+#include "RepositoryCheck.h"
+#include "StartupTrace.h"
 #include "HotkeyHook/KeyboardHook.h"
 
 #include <QAction>
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QDir>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+
+#include <memory>
+
+// Import or export a profile bundle without UI. Return exit code.
+static int RunBundleCommand(QString importPath, QString exportPath, QString conflict)
+{
+    BundleConflictPolicy policy;
+    if (!ParseBundleConflictPolicy(conflict, &policy)) {
+        L_ERROR("Unknown conflict policy: {}", conflict);
+        return 2;
+    }
+
+    QEventLoop loop;
+    ProfileRepository *profiles = ProfileRepository::Instance();
+    if (!profiles->IsLoaded()) {
+        QObject::connect(profiles, &ProfileRepository::SigLoaded, &loop, &QEventLoop::quit);
+        loop.exec();
+    }
+
+    ProfileBundleJob job;
+    BundleResult result;
+
+    QObject::connect(&job, &ProfileBundleJob::SigProgress, [](int done, int total) {
+        L_INFO("Bundle progress: {}/{}", done, total);
+        });
+    QObject::connect(&job, &ProfileBundleJob::SigFinished, [&](BundleResult finished) {
+        result = finished;
+        loop.quit();
+        });
+
+    if (!importPath.isEmpty()) {
+        L_INFO("Importing bundle: {}, conflict policy: {}", importPath, conflict);
+        job.StartImport(importPath, policy);
+    } else {
+        QStringList names;
+        for (int i = 0; i != profiles->Count(); ++i) {
+            names.append(profiles->NameAt(i));
+        }
+
+        L_INFO("Exporting {} profiles to bundle: {}", names.size(), exportPath);
+        job.StartExport(exportPath, names, QFileInfo(exportPath).completeBaseName());
+    }
+    loop.exec();
+
+    // Imported profiles are written when the repository is destroyed.
+    return result.bOk ? 0 : 1;
+}
+
+// Decode flight recorder dump into a text file beside it. Return exit code.
+static int DecodeFlightDump(QString filePath)
+{
+    QString text;
+    if (!FlightRecorder::Decode(filePath, &text)) {
+        return 1;
+    }
+
+    QFile file(filePath + ".txt");
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        return 1;
+    }
+    file.write(text.toUtf8());
+
+    return 0;
+}
 
 int main(int argc, char *argv[])
 {
+    StartupTrace::Start();
+
     QApplication a(argc, argv);
+    StartupTrace::Phase("QApplication");
 
-    // Init log.
-    InitLog("./log/AnchorLines.log");
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption importOption("import-bundle",
+        "Import profiles from bundle file, then exit.", "file");
+    QCommandLineOption exportOption("export-bundle",
+        "Export all profiles to bundle file, then exit.", "file");
+    QCommandLineOption conflictOption("conflict",
+        "How to import profiles which exist: skip, overwrite or rename.", "policy", "skip");
+    QCommandLineOption decodeFlightOption("decode-flight-dump",
+        "Write flight recorder dump as text into <file>.txt, then exit.", "file");
+    QCommandLineOption logOverflowOption("log-overflow",
+        "When log messages come faster than written: block or drop-oldest.", "policy", "block");
+    QCommandLineOption logBenchOption("log-bench",
+        "Print log throughput and latency with overflow policy block or drop-oldest, then exit.",
+        "policy");
+    QCommandLineOption logFormatBenchOption("log-format-bench",
+        "Print time and allocations of log formatters of Qt types, then exit.");
+    QCommandLineOption checkFrameTimeOption("check-frame-time",
+        "Check that overlay trace logging costs no frame time, then exit. "
+        "Use with -platform offscreen.");
+    QCommandLineOption checkScreensOption("check-screen-changes",
+        "Check that the overlay follows a burst of screen changes once, then exit. "
+        "Use with -platform offscreen.");
+    QCommandLineOption startupBenchOption("startup-bench",
+        "Print time to the first overlay frame, then exit.");
+    QCommandLineOption checkFormatsOption("check-formats",
+        "Check that damaged profile files are rejected or recovered, then exit.");
+    QCommandLineOption profileBenchOption("profile-bench",
+        "Print time to load stores of 10, 1k and 100k profiles, then exit.");
+    QCommandLineOption profileStartupBenchOption("profile-startup-bench",
+        "Print load time and memory of 10k profiles, then exit.");
+    QCommandLineOption checkSlowStoreOption("check-slow-store",
+        "Check that a slow profile store never blocks the GUI thread, then exit.");
+    QCommandLineOption bundleBenchOption("bundle-bench",
+        "Print import time of a 50k profile bundle, then exit.");
+    parser.addOptions({ importOption, exportOption, conflictOption, decodeFlightOption,
+                        logOverflowOption, startupBenchOption, checkFormatsOption,
+                        profileBenchOption, profileStartupBenchOption, checkSlowStoreOption,
+                        bundleBenchOption, logBenchOption, logFormatBenchOption,
+                        checkFrameTimeOption, checkScreensOption });
+    parser.process(a);
+
+    // Offline, no log or settings needed.
+    if (parser.isSet(decodeFlightOption)) {
+        return DecodeFlightDump(parser.value(decodeFlightOption));
+    }
+
+    // Init log. The log benchmark floods a scratch log instead.
+    QString logOverflowName = parser.isSet(logBenchOption)
+        ? parser.value(logBenchOption) : parser.value(logOverflowOption);
+    LogOverflowPolicy logOverflow = logOverflowName == "drop-oldest"
+        ? LogOverflowPolicy::DropOldest : LogOverflowPolicy::Block;
+    QByteArray logPath = "./log/AnchorLines.log";
+    std::unique_ptr<QTemporaryDir> logBenchDir;
+    if (parser.isSet(logBenchOption)) {
+        logBenchDir.reset(new QTemporaryDir);
+        logPath = QDir(logBenchDir->path()).filePath("AnchorLines.log").toLocal8Bit();
+    }
+    InitLog(logPath.constData(), logOverflow);
     L_INFO("------------------ Start ------------------");
     L_INFO("Working directory: {}", QDir::currentPath());
+    StartupTrace::Phase("log");
+    StartupTrace::LogReady();
+
+    if (parser.isSet(logBenchOption)) {
+        bool bOk = logBenchDir->isValid()
+            && RunLogBench(logOverflow == LogOverflowPolicy::DropOldest ? "drop-oldest" : "block");
+        ShutdownLog();
+        return bOk ? 0 : 1;
+    }
+
+    if (parser.isSet(logFormatBenchOption)) {
+        bool bOk = RunLogFormatBench();
+        ShutdownLog();
+        return bOk ? 0 : 1;
+    }
+
+    // Before settings and profiles, which it must not touch.
+    if (parser.isSet(checkFormatsOption)) {
+        QTemporaryDir workDir;
+        bool bOk = workDir.isValid() && CheckFileFormats(workDir.path());
+        ShutdownLog();
+        return bOk ? 0 : 1;
+    }
+    if (parser.isSet(profileBenchOption)) {
+        QTemporaryDir workDir;
+        bool bOk = workDir.isValid() && RunProfileLoadBench(workDir.path());
+        ShutdownLog();
+        return bOk ? 0 : 1;
+    }
+    if (parser.isSet(profileStartupBenchOption)) {
+        QTemporaryDir workDir;
+        bool bOk = workDir.isValid() && RunProfileStartupBench(workDir.path());
+        ShutdownLog();
+        return bOk ? 0 : 1;
+    }
+    if (parser.isSet(bundleBenchOption)) {
+        QTemporaryDir workDir;
+        bool bOk = workDir.isValid() && RunBundleImportBench(workDir.path());
+        ShutdownLog();
+        return bOk ? 0 : 1;
+    }
+    if (parser.isSet(checkFrameTimeOption)) {
+        bool bOk = CheckOverlayFrameTime();
+        ShutdownLog();
+        return bOk ? 0 : 1;
+    }
+    if (parser.isSet(checkSlowStoreOption)) {
+        QTemporaryDir workDir;
+        bool bOk = workDir.isValid() && CheckSlowStore(workDir.path());
+        ShutdownLog();
+        return bOk ? 0 : 1;
+    }
+
+    FlightRecorder::Install("./log");
+
+    int ret = 0;
+
+    // Everything which may log is gone before the log is shut down.
+    {
+        // Initialize setting instance.
+        AnchorSettings settings;
+        StartupTrace::Phase("settings");
+
+        // Load profiles, in background.
+        ProfileRepository profiles;
+        StartupTrace::Phase("profile repository");
 
-    // Initialize setting instance.
-    AnchorSettings settings;
+        // Unattended install.
+        if (parser.isSet(importOption) || parser.isSet(exportOption)) {
+            ret = RunBundleCommand(parser.value(importOption), parser.value(exportOption),
+                                   parser.value(conflictOption));
+        } else {
+            a.setQuitOnLastWindowClosed(false);
+            StartupTrace::SetBenchmark(parser.isSet(startupBenchOption));
 
-    a.setQuitOnLastWindowClosed(false);
+//            QWidget widget;
+//            MainWindow w(&widget);
 
-//    QWidget widget;
-//    MainWindow w(&widget);
+            MainWindow w;
 
-    MainWindow w;
+            // On the real window, the check runs events itself.
+            if (parser.isSet(checkScreensOption)) {
+                ret = CheckScreenChanges(&w) ? 0 : 1;
+            } else {
+                ret = a.exec();
+            }
 
-    int ret = a.exec();
+            KeyboardHook::getInstance().endThread();
+        }
+    }
 
-    KeyboardHook::getInstance().endThread();
+    L_INFO("------------------ Exit ------------------");
+    ShutdownLog();
 
     return ret;
 }
@@ -0,0 +1,213 @@
+#include "ArchiveFileSink.h"
+#include "mylog.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#define ARCHIVE_SUFFIX ".qz"
+
+// zlib level of archives, fast with most of the gain.
+#define ARCHIVE_COMPRESSION_LEVEL 6
+
+// qCompress() takes the whole file in memory, larger files are left as they
+//   are until pruned.
+#define ARCHIVE_MAX_COMPRESS_BYTES (256 * 1024 * 1024)
+
+static spdlog::log_clock::time_point GetNextMidnight()
+{
+    QDateTime midnight(QDate::currentDate().addDays(1), QTime(0, 0));
+    return spdlog::log_clock::time_point(std::chrono::milliseconds(midnight.toMSecsSinceEpoch()));
+}
+
+ArchiveFileSink::ArchiveFileSink(QString filePath, qint64 maxFileBytes, qint64 maxTotalBytes, int maxDays)
+    : m_maxFileBytes(maxFileBytes)
+    , m_maxTotalBytes(maxTotalBytes)
+    , m_maxDays(maxDays)
+{
+    QFileInfo info(filePath);
+    m_dir = info.absoluteDir();
+    m_baseName = info.completeBaseName();
+    m_suffix = info.suffix().isEmpty() ? QString() : "." + info.suffix();
+
+    m_pool.setMaxThreadCount(1);
+    m_pool.setExpiryTimeout(-1);
+
+    OpenFile();
+}
+
+ArchiveFileSink::~ArchiveFileSink()
+{
+    WaitForArchiving();
+}
+
+void ArchiveFileSink::ArchiveOldFiles()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Files left by an earlier run, or by the old daily sink.
+    QStringList leftovers = m_dir.entryList({ m_baseName + "_*" + m_suffix }, QDir::Files);
+    for (const QString &fileName : leftovers) {
+        QString leftoverPath = m_dir.filePath(fileName);
+        if (leftoverPath != m_filePath) {
+            m_pool.start([this, leftoverPath]() { Compress(leftoverPath); });
+        }
+    }
+
+    QString currentPath = m_filePath;
+    m_pool.start([this, currentPath]() { Prune(currentPath); });
+}
+
+void ArchiveFileSink::WaitForArchiving()
+{
+    m_pool.waitForDone();
+}
+
+void ArchiveFileSink::sink_it_(const spdlog::details::log_msg &msg)
+{
+    spdlog::memory_buf_t formatted;
+    formatter_->format(msg, formatted);
+
+    bool bNewDay = msg.time >= m_nextDay;
+    bool bFull = !m_bSizeRotationBlocked && m_fileSize > 0
+        && m_fileSize + qint64(formatted.size()) > m_maxFileBytes;
+    if (bNewDay || bFull) {
+        Rotate();
+    }
+
+    m_file.write(formatted);
+    m_fileSize += formatted.size();
+}
+
+void ArchiveFileSink::flush_()
+{
+    m_file.flush();
+}
+
+void ArchiveFileSink::OpenFile()
+{
+    m_fileDate = QDate::currentDate();
+    QString fileName = QString("%1_%2%3")
+        .arg(m_baseName, m_fileDate.toString("yyyy-MM-dd"), m_suffix);
+    m_filePath = m_dir.filePath(fileName);
+    m_nextDay = GetNextMidnight();
+
+    // Size is asked once, a stat on each message is too slow.
+    m_file.open(QFile::encodeName(m_filePath).toStdString(), false);
+    m_fileSize = qint64(m_file.size());
+}
+
+void ArchiveFileSink::Rotate()
+{
+    m_file.close();
+
+    // Name by the time of rotation, unique even for several in a second. A
+    //   file finished at midnight is named by its own day, at its last second.
+    QDateTime rotateTime = QDateTime::currentDateTime();
+    if (rotateTime.date() != m_fileDate) {
+        rotateTime = QDateTime(m_fileDate, QTime(23, 59, 59));
+    }
+    QString stamp = rotateTime.toString("yyyy-MM-dd_HHmmss");
+    QString rotatedPath = m_dir.filePath(QString("%1_%2%3").arg(m_baseName, stamp, m_suffix));
+    for (int i = 2; QFile::exists(rotatedPath); ++i) {
+        rotatedPath = m_dir.filePath(QString("%1_%2-%3%4").arg(m_baseName, stamp).arg(i).arg(m_suffix));
+    }
+
+    // A failed rename keeps appending to the current file.
+    QString filePath = m_filePath;
+    bool bRenamed = QFile::rename(m_filePath, rotatedPath);
+
+    OpenFile();
+
+    // Still the same full file. Tried again on the next day, not on every
+    //   message.
+    m_bSizeRotationBlocked = !bRenamed && m_filePath == filePath;
+
+    if (bRenamed) {
+        QString currentPath = m_filePath;
+        m_pool.start([this, rotatedPath, currentPath]() {
+            Compress(rotatedPath);
+            Prune(currentPath);
+        });
+    }
+}
+
+void ArchiveFileSink::Compress(QString filePath)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QFile file(filePath);
+    if (file.size() > ARCHIVE_MAX_COMPRESS_BYTES || !file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    QByteArray data = file.readAll();
+    QDateTime modified = file.fileTime(QFileDevice::FileModificationTime);
+    file.close();
+
+    QSaveFile archive(filePath + ARCHIVE_SUFFIX);
+    QByteArray compressed = qCompress(data, ARCHIVE_COMPRESSION_LEVEL);
+    if (compressed.isEmpty() || !archive.open(QIODevice::WriteOnly)
+        || archive.write(compressed) != compressed.size() || !archive.commit()) {
+        L_ERROR("Compress log file failed: {}", filePath);
+        return;
+    }
+
+    // Prune() ages archives by modification time, which must be the log's.
+    QFile archived(filePath + ARCHIVE_SUFFIX);
+    if (!archived.open(QIODevice::WriteOnly | QIODevice::Append)
+        || !archived.setFileTime(modified, QFileDevice::FileModificationTime)) {
+        L_WARN("Keep modification time of log archive failed: {}", archived.fileName());
+    }
+    archived.close();
+
+    QFile::remove(filePath);
+
+    m_archivedBytes += data.size();
+    m_compressedBytes += compressed.size();
+    m_archiveMs += timer.elapsed();
+
+    // Cost of each MB logged: written once, read back, written compressed.
+    double loggedMb = m_archivedBytes / (1024.0 * 1024.0);
+    if (loggedMb == 0) {
+        return;
+    }
+    L_INFO("Log archived: {}, {} -> {} bytes in {} ms. Per MB logged: {:.2f} MB I/O, {:.1f} ms",
+           filePath + ARCHIVE_SUFFIX, data.size(), compressed.size(), timer.elapsed(),
+           (m_archivedBytes * 2 + m_compressedBytes) / (1024.0 * 1024.0) / loggedMb,
+           m_archiveMs / loggedMb);
+}
+
+void ArchiveFileSink::Prune(QString currentPath)
+{
+    // Archives and rotated files waiting for compression, newest first.
+    QFileInfoList files = m_dir.entryInfoList({ m_baseName + "_*" + m_suffix + ARCHIVE_SUFFIX,
+                                                m_baseName + "_*" + m_suffix },
+                                              QDir::Files, QDir::Time);
+    QDateTime oldest = QDateTime::currentDateTime().addDays(-m_maxDays);
+
+    // The current file may grow to its cap, leave room for it. Once over
+    //   budget, everything older goes too.
+    qint64 totalBytes = m_maxFileBytes;
+    bool bOverBudget = false;
+    int removed = 0;
+    for (const QFileInfo &info : files) {
+        if (info.absoluteFilePath() == QFileInfo(currentPath).absoluteFilePath()) {
+            continue;
+        }
+
+        totalBytes += info.size();
+        bOverBudget = bOverBudget || totalBytes > m_maxTotalBytes;
+        if (bOverBudget || info.lastModified() < oldest) {
+            if (QFile::remove(info.absoluteFilePath())) {
+                ++removed;
+            }
+        }
+    }
+
+    if (removed != 0) {
+        L_INFO("Removed {} old log files", removed);
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef ARCHIVEFILESINK_H
+#define ARCHIVEFILESINK_H
+
+#include <spdlog/details/file_helper.h>
+#include <spdlog/sinks/base_sink.h>
+
+#include <QDate>
+#include <QDir>
+#include <QString>
+#include <QThreadPool>
+
+#include <mutex>
+
+// File sink which rotates on size and on day, and keeps old logs compressed.
+//
+// The current file is "<base>_yyyy-MM-dd.log". A rotated file is renamed to
+//   "<base>_yyyy-MM-dd_HHmmss.log", then compressed by qCompress() into
+//   "<base>_yyyy-MM-dd_HHmmss.log.qz" (read it back with qUncompress()) on a
+//   worker thread, which also deletes archives older than maxDays and the
+//   oldest ones beyond the byte budget. The logging thread only renames.
+class ArchiveFileSink : public spdlog::sinks::base_sink<std::mutex>
+{
+public:
+    // filePath: "dir/base.log". maxTotalBytes includes the current file.
+    ArchiveFileSink(QString filePath, qint64 maxFileBytes, qint64 maxTotalBytes, int maxDays);
+    ~ArchiveFileSink();
+
+    // Compress files left by an earlier run, and prune. Call once logging
+    //   works, the worker logs what it does.
+    void ArchiveOldFiles();
+
+    // Wait until queued compression and cleanup is done.
+    void WaitForArchiving();
+
+protected:
+    void sink_it_(const spdlog::details::log_msg &msg) override;
+    void flush_() override;
+
+private:
+    // Open file of today, appending.
+    void OpenFile();
+
+    // Close current file, rename it and queue compression.
+    void Rotate();
+
+    // Worker thread.
+    void Compress(QString filePath);
+    void Prune(QString currentPath);
+
+    QDir m_dir;
+    QString m_baseName;
+    QString m_suffix;
+
+    qint64 m_maxFileBytes;
+    qint64 m_maxTotalBytes;
+    int m_maxDays;
+
+    spdlog::details::file_helper m_file;
+    QString m_filePath;
+    QDate m_fileDate;           // Day the current file is for.
+    qint64 m_fileSize = 0;      // Bytes in the current file, kept by writes.
+    bool m_bSizeRotationBlocked = false;    // Rename failed, wait for next day.
+    spdlog::log_clock::time_point m_nextDay;
+
+    // Compression and cleanup, one task at a time.
+    QThreadPool m_pool;
+
+    // Totals for the cost report, worker thread.
+    qint64 m_archivedBytes = 0;
+    qint64 m_compressedBytes = 0;
+    qint64 m_archiveMs = 0;
+};
+
+#endif // ARCHIVEFILESINK_H
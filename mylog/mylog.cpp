@@ -1,13 +1,112 @@
 #include "mylog.h"
+#include "ArchiveFileSink.h"
+#include "spdlog/async.h"
 #include "spdlog/sinks/stdout_color_sinks.h" // or "../stdout_sinks.h" if no colors needed
-#include "spdlog/sinks/daily_file_sink.h"
+#include "spdlog/details/periodic_worker.h"
 
 #include <QDir>
 #include <iostream>
 #include <string>
 
+// Queued messages, and threads writing them.
+#define LOG_QUEUE_SIZE      8192
+#define LOG_THREAD_COUNT    1
+
+// Flush interval of periodic flush, in seconds.
+#define LOG_FLUSH_INTERVAL  1
+
+// Log file rotates at this size, and at midnight.
+#define LOG_FILE_MAX_BYTES  (8 * 1024 * 1024)
+
+// Budget of current and archived log files.
+#define LOG_TOTAL_MAX_BYTES (64 * 1024 * 1024)
+#define LOG_MAX_DAYS        14
+
+// Interval of suppressed message summaries, in seconds.
+#define LOG_SUMMARY_INTERVAL 10
+
+// Pattern of both sinks unless configured.
+#define LOG_DEFAULT_PATTERN "[%T.%e] [%^%L%$] [%t] [%n] [%s:%#;%!] %v"
+
 static bool g_bInited = false;
 
+spdlog::logger *g_moduleLoggers[int(LogModule::Count)] = {};
+
+// Owners of g_moduleLoggers, and the shared sinks.
+static std::shared_ptr<spdlog::logger> g_moduleLoggerPtrs[int(LogModule::Count)];
+static std::shared_ptr<spdlog::sinks::sink> g_consoleSink;
+static std::shared_ptr<ArchiveFileSink> g_fileSink;
+
+// Sites which dropped messages. Only ever grows, sites are static.
+static std::atomic<LogSite *> g_logSites{ nullptr };
+static std::unique_ptr<spdlog::details::periodic_worker> g_summaryWorker;
+
+LogConfig::LogConfig()
+{
+    int level = spdlog::level::info;
+#ifdef _DEBUG
+    level = spdlog::level::trace;
+#endif
+
+    for (int &moduleLevel : moduleLevels) {
+        moduleLevel = level;
+    }
+
+    // A GUI subsystem program has no console to write to.
+#ifdef MYLOG_NO_CONSOLE_DEFAULT
+    bConsole = false;
+#else
+    bConsole = true;
+#endif
+    consoleLevel = spdlog::level::trace;
+    consolePattern = LOG_DEFAULT_PATTERN;
+
+    fileLevel = spdlog::level::trace;
+    filePattern = LOG_DEFAULT_PATTERN;
+}
+
+const char *GetLogModuleName(LogModule module)
+{
+    switch (module) {
+    case LogModule::App:        return "app";
+    case LogModule::Overlay:    return "overlay";
+    case LogModule::Hotkey:     return "hotkey";
+    case LogModule::Settings:   return "settings";
+    case LogModule::Profiles:   return "profiles";
+    default:                    return "";
+    }
+}
+
+void LinkLogSite(LogSite *site)
+{
+    bool bLinked = false;
+    if (!site->bLinked.compare_exchange_strong(bLinked, true)) {
+        return;
+    }
+
+    LogSite *head = g_logSites.load();
+    do {
+        site->next = head;
+    } while (!g_logSites.compare_exchange_weak(head, site));
+}
+
+// Log one line for each site which dropped messages since last time.
+static void LogSuppressedSummary()
+{
+    for (LogSite *site = g_logSites.load(); site; site = site->next) {
+        int suppressed = site->suppressed.exchange(0, std::memory_order_relaxed);
+        if (suppressed == 0) {
+            continue;
+        }
+
+        spdlog::logger *logger = GetModuleLogger(site->module);
+        if (logger->should_log(site->level)) {
+            logger->log(spdlog::source_loc{ site->file, site->line, "" }, site->level,
+                        "{} messages suppressed here", suppressed);
+        }
+    }
+}
+
 // Create directory, return 0 if success.
 static int CreateDir(const char* dirPath)
 {
@@ -17,7 +116,7 @@ static int CreateDir(const char* dirPath)
     return 0;
 }
 
-int InitLog(const char * filename)
+int InitLog(const char * filename, LogOverflowPolicy overflow)
 {
     // If inited, just return;
     if (g_bInited) {
@@ -44,33 +143,105 @@ int InitLog(const char * filename)
     } while (0);
 
     try {
-        spdlog::level::level_enum level = spdlog::level::info;
-#ifdef _DEBUG
-        level = spdlog::level::trace;
-#endif
+        g_consoleSink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+        g_fileSink = std::make_shared<ArchiveFileSink>(QString::fromLocal8Bit(filename),
+            LOG_FILE_MAX_BYTES, LOG_TOTAL_MAX_BYTES, LOG_MAX_DAYS);
 
-        auto console_sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
-        //console_sink->set_level(level);
-        console_sink->set_pattern("[%T.%e] [%^%L%$] [%t] [%s:%#;%!] %v");
+        // Callers only format and queue, the sinks are written by the pool.
+        spdlog::init_thread_pool(LOG_QUEUE_SIZE, LOG_THREAD_COUNT);
+        spdlog::async_overflow_policy policy = overflow == LogOverflowPolicy::DropOldest
+            ? spdlog::async_overflow_policy::overrun_oldest
+            : spdlog::async_overflow_policy::block;
 
-        auto daily_file_sink = std::make_shared<spdlog::sinks::daily_file_sink_mt>(filename, 0, 0);
-        //daily_file_sink->set_level(level);
-        daily_file_sink->set_pattern("[%T.%e] [%^%L%$] [%t] [%s:%#;%!] %v");
+        // One logger per module, all writing to the same sinks.
+        for (int i = 0; i != int(LogModule::Count); ++i) {
+            auto logger = std::make_shared<spdlog::async_logger>(GetLogModuleName(LogModule(i)),
+                spdlog::sinks_init_list({ g_consoleSink, g_fileSink }),
+                spdlog::thread_pool(), policy);
+            logger->flush_on(spdlog::level::err);
+            g_moduleLoggerPtrs[i] = logger;
+        }
+        spdlog::set_default_logger(g_moduleLoggerPtrs[int(LogModule::App)]);
 
-        auto logger = std::make_shared<spdlog::logger>("multi_sink",
-            spdlog::sinks_init_list({ console_sink, daily_file_sink }));
-        logger->flush_on(spdlog::level::trace);
-        logger->set_level(level);
-        spdlog::set_default_logger(logger);
+        spdlog::flush_every(std::chrono::seconds(LOG_FLUSH_INTERVAL));
     } catch (const spdlog::spdlog_ex& ex) {
         std::cout << "Log initialization failed: " << ex.what() << std::endl;
+
+        // Log through spdlog's console logger instead.
+        g_consoleSink.reset();
+        g_fileSink.reset();
+        for (auto &logger : g_moduleLoggerPtrs) {
+            logger = spdlog::default_logger();
+        }
+    }
+
+    for (int i = 0; i != int(LogModule::Count); ++i) {
+        g_moduleLoggers[i] = g_moduleLoggerPtrs[i].get();
     }
 
     g_bInited = true;
+    ApplyLogConfig(LogConfig());
+
+    if (g_fileSink) {
+        g_fileSink->ArchiveOldFiles();
+    }
+
+    g_summaryWorker = std::make_unique<spdlog::details::periodic_worker>(
+        &LogSuppressedSummary, std::chrono::seconds(LOG_SUMMARY_INTERVAL));
 
     return 0;
 }
 
+void ShutdownLog()
+{
+    if (!g_bInited) {
+        return;
+    }
+
+    g_summaryWorker.reset();
+    LogSuppressedSummary();
+
+    // Archiving logs, let it finish while loggers still work.
+    if (g_fileSink) {
+        g_fileSink->WaitForArchiving();
+    }
+
+    // Drops the loggers, which flush, then joins the pool.
+    for (int i = 0; i != int(LogModule::Count); ++i) {
+        g_moduleLoggers[i] = nullptr;
+        g_moduleLoggerPtrs[i].reset();
+    }
+    spdlog::shutdown();
+    g_bInited = false;
+}
+
+static spdlog::level::level_enum ToLevel(int level)
+{
+    return spdlog::level::level_enum(qBound<int>(spdlog::level::trace, level, spdlog::level::off));
+}
+
+void ApplyLogConfig(const LogConfig &config)
+{
+    if (!g_bInited) {
+        return;
+    }
+
+    // Levels are atomic, and sinks lock while changing patterns, so this
+    //   is safe while other threads log.
+    for (int i = 0; i != int(LogModule::Count); ++i) {
+        g_moduleLoggers[i]->set_level(ToLevel(config.moduleLevels[i]));
+    }
+
+    if (g_consoleSink) {
+        g_consoleSink->set_level(config.bConsole ? ToLevel(config.consoleLevel) : spdlog::level::off);
+        g_consoleSink->set_pattern(config.consolePattern);
+    }
+    if (g_fileSink) {
+        g_fileSink->set_level(ToLevel(config.fileLevel));
+        g_fileSink->set_pattern(config.filePattern);
+    }
+}
+
 void SetLogLevel(int level)
 {
     if (level < spdlog::level::trace || level > spdlog::level::err) {
@@ -78,5 +249,7 @@ void SetLogLevel(int level)
         return;
     }
 
-    spdlog::default_logger()->set_level(spdlog::level::level_enum(level));
+    for (int i = 0; i != int(LogModule::Count); ++i) {
+        GetModuleLogger(LogModule(i))->set_level(spdlog::level::level_enum(level));
+    }
 }
@@ -1,46 +1,325 @@
 #ifndef MY_LOG_H_
 #define MY_LOG_H_
 
-// Under DEBUG mode, we will log all from trace to error.
-// Under RELEASE mode, we will only log from info to error.
-#ifdef _DEBUG
-  #define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_TRACE
-#else
-  #define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_INFO  // Change this if want to use SetLogLevel().
-#endif
+// Levels are chosen at runtime, per module (see ApplyLogConfig()).
+// By default DEBUG builds log from trace, RELEASE builds from info.
+#define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_TRACE
 
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <string>
 #include <spdlog/spdlog.h>
 #include <spdlog/fmt/ostr.h>
 
+#include <QColor>
+#include <QPoint>
+#include <QRect>
+#include <QSize>
 #include <QString>
 #include <QStringList>
 
+// What a logging thread does when the log queue is full.
+enum class LogOverflowPolicy {
+    Block,      // Wait for room, nothing is lost.
+    DropOldest, // Overwrite oldest queued message, never wait.
+};
+
+// Each source file logs to the logger of its module. Define MYLOG_MODULE as
+//   one of these before any include, App is the default.
+enum class LogModule {
+    App,
+    Overlay,
+    Hotkey,
+    Settings,
+    Profiles,
+    Count
+};
+
+#ifndef MYLOG_MODULE
+#define MYLOG_MODULE LogModule::App
+#endif
+
+// Runtime logging configuration. Levels are spdlog levels:
+// 0: trace; 1: debug; 2: info; 3: warn; 4: error; 5: critical; 6: off.
+struct LogConfig {
+    int moduleLevels[int(LogModule::Count)];
+
+    bool bConsole;
+    int consoleLevel;
+    std::string consolePattern;
+
+    int fileLevel;
+    std::string filePattern;
+
+    // Defaults of this build.
+    LogConfig();
+};
+
+// Name of module, as used in logger names and settings keys.
+const char *GetLogModuleName(LogModule module);
+
 // Must be called before any logging.
+// Messages are written by a background thread. Files are flushed every
+//   second, and at once for errors.
 // @param[in] path log file name prefix.
-int InitLog(const char *filename);
+// @param[in] overflow what to do when messages come faster than written.
+int InitLog(const char *filename, LogOverflowPolicy overflow = LogOverflowPolicy::Block);
 
-// Set current log level.
+// Write queued messages and stop the logging thread. No logging after it.
+void ShutdownLog();
+
+// Apply levels, patterns and console switch at once, while logging.
+void ApplyLogConfig(const LogConfig &config);
+
+// Set log level of all modules.
 // 0: trace; 1: debug; 2: info; 3: warn; 4: error.
 void SetLogLevel(int level);
 
-inline std::ostream &operator<<(std::ostream &os, const QString &c)
+// Formatters of Qt types. They write straight into the fmt buffer, without
+//   temporary strings, and take no format spec: only "{}".
+
+// Write UTF-16 text as UTF-8. Unpaired surrogates become U+FFFD.
+template <typename OutputIt>
+OutputIt AppendUtf8(const QChar *data, qsizetype size, OutputIt out)
 {
-    return os << c.toStdString();
+    for (qsizetype i = 0; i < size; ++i) {
+        uint c = data[i].unicode();
+        if (QChar::isHighSurrogate(c) && i + 1 < size && data[i + 1].isLowSurrogate()) {
+            c = QChar::surrogateToUcs4(ushort(c), data[++i].unicode());
+        } else if (QChar::isSurrogate(c)) {
+            c = 0xFFFD;
+        }
+
+        if (c < 0x80) {
+            *out++ = char(c);
+        } else if (c < 0x800) {
+            *out++ = char(0xC0 | (c >> 6));
+            *out++ = char(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            *out++ = char(0xE0 | (c >> 12));
+            *out++ = char(0x80 | ((c >> 6) & 0x3F));
+            *out++ = char(0x80 | (c & 0x3F));
+        } else {
+            *out++ = char(0xF0 | (c >> 18));
+            *out++ = char(0x80 | ((c >> 12) & 0x3F));
+            *out++ = char(0x80 | ((c >> 6) & 0x3F));
+            *out++ = char(0x80 | (c & 0x3F));
+        }
+    }
+
+    return out;
 }
 
-inline std::ostream &operator<<(std::ostream &os, const QStringList &c)
+// Base of formatters which take no format spec.
+struct NoSpecFormatter {
+    constexpr auto parse(fmt::format_parse_context &ctx) -> decltype(ctx.begin())
+    {
+        auto it = ctx.begin();
+        if (it != ctx.end() && *it != '}') {
+            ctx.on_error("format spec is not supported");
+        }
+        return it;
+    }
+};
+
+template <>
+struct fmt::formatter<QString> : NoSpecFormatter {
+    template <typename FormatContext>
+    auto format(const QString &s, FormatContext &ctx) const -> decltype(ctx.out())
+    {
+        return AppendUtf8(s.constData(), s.size(), ctx.out());
+    }
+};
+
+// [a, b, c]
+template <>
+struct fmt::formatter<QStringList> : NoSpecFormatter {
+    template <typename FormatContext>
+    auto format(const QStringList &list, FormatContext &ctx) const -> decltype(ctx.out())
+    {
+        auto out = ctx.out();
+        *out++ = '[';
+        for (int i = 0; i != list.size(); ++i) {
+            if (i != 0) {
+                *out++ = ',';
+                *out++ = ' ';
+            }
+            out = AppendUtf8(list[i].constData(), list[i].size(), out);
+        }
+        *out++ = ']';
+        return out;
+    }
+};
+
+// (x, y)
+template <>
+struct fmt::formatter<QPoint> : NoSpecFormatter {
+    template <typename FormatContext>
+    auto format(const QPoint &p, FormatContext &ctx) const -> decltype(ctx.out())
+    {
+        return fmt::format_to(ctx.out(), "({}, {})", p.x(), p.y());
+    }
+};
+
+// WxH
+template <>
+struct fmt::formatter<QSize> : NoSpecFormatter {
+    template <typename FormatContext>
+    auto format(const QSize &s, FormatContext &ctx) const -> decltype(ctx.out())
+    {
+        return fmt::format_to(ctx.out(), "{}x{}", s.width(), s.height());
+    }
+};
+
+// (x, y) WxH
+template <>
+struct fmt::formatter<QRect> : NoSpecFormatter {
+    template <typename FormatContext>
+    auto format(const QRect &r, FormatContext &ctx) const -> decltype(ctx.out())
+    {
+        return fmt::format_to(ctx.out(), "({}, {}) {}x{}", r.x(), r.y(), r.width(), r.height());
+    }
+};
+
+// #AARRGGBB, or "invalid".
+template <>
+struct fmt::formatter<QColor> : NoSpecFormatter {
+    template <typename FormatContext>
+    auto format(const QColor &c, FormatContext &ctx) const -> decltype(ctx.out())
+    {
+        if (!c.isValid()) {
+            return fmt::format_to(ctx.out(), "invalid");
+        }
+        return fmt::format_to(ctx.out(), "#{:02x}{:02x}{:02x}{:02x}",
+                              c.alpha(), c.red(), c.green(), c.blue());
+    }
+};
+
+// Loggers of modules, created by InitLog() and dropped by ShutdownLog().
+extern spdlog::logger *g_moduleLoggers[int(LogModule::Count)];
+
+// Before InitLog(), spdlog's default console logger.
+inline spdlog::logger *GetModuleLogger(LogModule module)
 {
-    return os << "[" << c.join(", ") << "]";
+    spdlog::logger *logger = g_moduleLoggers[int(module)];
+    return logger ? logger : spdlog::default_logger_raw();
 }
 
+// A message below the level of its module costs one compare, and its
+//   arguments are not evaluated.
+#define MYLOG_CALL(level, ...) \
+    do { \
+        spdlog::logger *mylogLogger_ = GetModuleLogger(MYLOG_MODULE); \
+        if (mylogLogger_->should_log(level)) { \
+            mylogLogger_->log(spdlog::source_loc{ __FILE__, __LINE__, SPDLOG_FUNCTION }, \
+                              level, __VA_ARGS__); \
+        } \
+    } while (0)
+
+struct LogSite;
+
+// Add site to the summary list, once. Lock free.
+void LinkLogSite(LogSite *site);
+
+// State of one rate limited or sampled call site. Constant initialized, so
+//   a static one needs no guard, and updated with relaxed atomics only. Sites
+//   which dropped messages are linked into a list on first drop, and a
+//   summary of dropped messages is logged for them every few seconds.
+struct LogSite {
+    const char *file;
+    int line;
+    LogModule module;
+    spdlog::level::level_enum level;
+
+    std::atomic<int64_t> windowStartMs{ 0 };
+    std::atomic<int> countInWindow{ 0 };
+    std::atomic<uint32_t> sampleCount{ 0 };
+    std::atomic<int> suppressed{ 0 };
+
+    std::atomic<bool> bLinked{ false };
+    LogSite *next = nullptr;
+
+    constexpr LogSite(const char *file, int line, LogModule module, spdlog::level::level_enum level)
+        : file(file), line(line), module(module), level(level)
+    {
+    }
+
+    // At most perSecond messages in each second.
+    bool AllowRate(int perSecond)
+    {
+        int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t start = windowStartMs.load(std::memory_order_relaxed);
+
+        // The thread which moves the window resets the count. Racing threads
+        //   may let a message or two more through, which is fine.
+        if (now - start >= 1000
+            && windowStartMs.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+            countInWindow.store(0, std::memory_order_relaxed);
+        }
+
+        if (countInWindow.fetch_add(1, std::memory_order_relaxed) < perSecond) {
+            return true;
+        }
+
+        Suppress();
+        return false;
+    }
+
+    // First message of each k.
+    bool AllowSample(uint32_t k)
+    {
+        if (sampleCount.fetch_add(1, std::memory_order_relaxed) % k == 0) {
+            return true;
+        }
+
+        Suppress();
+        return false;
+    }
+
+    void Suppress()
+    {
+        suppressed.fetch_add(1, std::memory_order_relaxed);
+        if (!bLinked.load(std::memory_order_relaxed)) {
+            LinkLogSite(this);
+        }
+    }
+};
+
+// Level is checked first, a disabled message costs the same as with
+//   MYLOG_CALL(). allow is a LogSite member call.
+#define MYLOG_CALL_SITE(level, allow, ...) \
+    do { \
+        spdlog::logger *mylogLogger_ = GetModuleLogger(MYLOG_MODULE); \
+        if (mylogLogger_->should_log(level)) { \
+            static LogSite mylogSite_{ __FILE__, __LINE__, MYLOG_MODULE, level }; \
+            if (mylogSite_.allow) { \
+                mylogLogger_->log(spdlog::source_loc{ __FILE__, __LINE__, SPDLOG_FUNCTION }, \
+                                  level, __VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
 #if !defined(SPD_NO_LOG)
-#define L_TRACE(...) SPDLOG_TRACE(__VA_ARGS__)
-#define L_DEBUG(...) SPDLOG_DEBUG(__VA_ARGS__)
-#define L_INFO(...)  SPDLOG_INFO(__VA_ARGS__)
-#define L_WARN(...)  SPDLOG_WARN(__VA_ARGS__)
-#define L_ERROR(...) SPDLOG_ERROR(__VA_ARGS__)
-#define L_FATAL(...) SPDLOG_CRITICAL(__VA_ARGS__)
+#define L_TRACE(...) MYLOG_CALL(spdlog::level::trace, __VA_ARGS__)
+#define L_DEBUG(...) MYLOG_CALL(spdlog::level::debug, __VA_ARGS__)
+#define L_INFO(...)  MYLOG_CALL(spdlog::level::info, __VA_ARGS__)
+#define L_WARN(...)  MYLOG_CALL(spdlog::level::warn, __VA_ARGS__)
+#define L_ERROR(...) MYLOG_CALL(spdlog::level::err, __VA_ARGS__)
+#define L_FATAL(...) MYLOG_CALL(spdlog::level::critical, __VA_ARGS__)
+
+// At most n messages per second from this call site, for hot paths.
+#define L_TRACE_LIMITED(n, ...) MYLOG_CALL_SITE(spdlog::level::trace, AllowRate(n), __VA_ARGS__)
+#define L_DEBUG_LIMITED(n, ...) MYLOG_CALL_SITE(spdlog::level::debug, AllowRate(n), __VA_ARGS__)
+#define L_INFO_LIMITED(n, ...)  MYLOG_CALL_SITE(spdlog::level::info, AllowRate(n), __VA_ARGS__)
+#define L_WARN_LIMITED(n, ...)  MYLOG_CALL_SITE(spdlog::level::warn, AllowRate(n), __VA_ARGS__)
+
+// One message in each k from this call site.
+#define L_TRACE_SAMPLED(k, ...) MYLOG_CALL_SITE(spdlog::level::trace, AllowSample(k), __VA_ARGS__)
+#define L_DEBUG_SAMPLED(k, ...) MYLOG_CALL_SITE(spdlog::level::debug, AllowSample(k), __VA_ARGS__)
+#define L_INFO_SAMPLED(k, ...)  MYLOG_CALL_SITE(spdlog::level::info, AllowSample(k), __VA_ARGS__)
+#define L_WARN_SAMPLED(k, ...)  MYLOG_CALL_SITE(spdlog::level::warn, AllowSample(k), __VA_ARGS__)
 
 #endif  // #if !defined(SPD_NO_LOG)
 